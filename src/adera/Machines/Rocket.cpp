@@ -173,21 +173,19 @@ void SysMachineRocket::update_physics()
 
 void SysMachineRocket::attach_plume_effect(ActiveEnt ent)
 {
+    static constexpr std::string_view nodePrefix = "fx_plume_";
+
     ActiveEnt plumeNode = entt::null;
 
-    auto findPlumeHandle = [this, &plumeNode](ActiveEnt ent)
+    for (ActiveEnt node : m_scene.hier_descendants(ent))
     {
-        auto const& node = m_scene.reg_get<ACompHierarchy>(ent);
-        static constexpr std::string_view nodePrefix = "fx_plume_";
-        if (0 == node.m_name.compare(0, nodePrefix.size(), nodePrefix))
+        auto const& nodeHier = m_scene.reg_get<ACompHierarchy>(node);
+        if (0 == nodeHier.m_name.compare(0, nodePrefix.size(), nodePrefix))
         {
-            plumeNode = ent;
-            return EHierarchyTraverseStatus::Stop;  // terminate search
+            plumeNode = node;
+            break;
         }
-        return EHierarchyTraverseStatus::Continue;
-    };
-
-    m_scene.hierarchy_traverse(ent, findPlumeHandle);
+    }
 
     if (plumeNode == entt::null)
     {
@@ -1,300 +1,670 @@
-/**
- * Open Space Program
- * Copyright © 2019-2020 Open Space Program Project
- *
- * MIT License
- *
- * Permission is hereby granted, free of charge, to any person obtaining a copy
- * of this software and associated documentation files (the "Software"), to deal
- * in the Software without restriction, including without limitation the rights
- * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
- * copies of the Software, and to permit persons to whom the Software is
- * furnished to do so, subject to the following conditions:
- *
- * The above copyright notice and this permission notice shall be included in
- * all copies or substantial portions of the Software.
- *
- * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
- * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
- * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
- * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
- * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
- * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
- * SOFTWARE.
- */
-#include <iostream>
-
-#include "ActiveScene.h"
-
-using namespace osp;
-using namespace osp::active;
-
-void ACompCamera::calculate_projection()
-{
-
-    m_projection = Matrix4::perspectiveProjection(
-            m_fov, m_viewport.x() / m_viewport.y(),
-            m_near, m_far);
-}
-
-
-ActiveScene::ActiveScene(UserInputHandler &userInput, OSPApplication &app, Package& context) :
-        m_app(app),
-        m_context(context),
-        m_hierarchyDirty(false),
-        m_userInput(userInput)
-{
-    m_registry.on_construct<ACompHierarchy>()
-                    .connect<&ActiveScene::on_hierarchy_construct>(*this);
-
-    m_registry.on_destroy<ACompHierarchy>()
-                    .connect<&ActiveScene::on_hierarchy_destruct>(*this);
-
-    // "There is no need to store groups around for they are extremely cheap to
-    //  construct, even though they can be copied without problems and reused
-    //  freely. A group performs an initialization step the very first time
-    //  it's requested and this could be quite costly. To avoid it, consider
-    //  creating the group when no components have been assigned yet."
-    m_registry.group<ACompHierarchy, ACompTransform>();
-
-    // Create the root entity
-
-    m_root = m_registry.create();
-    ACompHierarchy& hierarchy = m_registry.emplace<ACompHierarchy>(m_root);
-    hierarchy.m_name = "Root Entity";
-
-}
-
-ActiveScene::~ActiveScene()
-{
-    // destruct dynamic systems before registry
-    m_dynamicSys.clear();
-    m_registry.clear();
-}
-
-
-ActiveEnt ActiveScene::hier_create_child(ActiveEnt parent,
-                                            std::string const& name)
-{
-    ActiveEnt child = m_registry.create();
-    ACompHierarchy& childHierarchy = m_registry.emplace<ACompHierarchy>(child);
-    //ACompTransform& transform = m_registry.emplace<ACompTransform>(ent);
-    childHierarchy.m_name = name;
-
-    hier_set_parent_child(parent, child);
-
-    return child;
-}
-
-void ActiveScene::hier_set_parent_child(ActiveEnt parent, ActiveEnt child)
-{
-    ACompHierarchy& childHierarchy = m_registry.get<ACompHierarchy>(child);
-    //ACompTransform& transform = m_registry.emplace<ACompTransform>(ent);
-
-    ACompHierarchy& parentHierarchy = m_registry.get<ACompHierarchy>(parent);
-
-    // if child has an existing parent, cut first
-    if (m_registry.valid(childHierarchy.m_parent))
-    {
-        hier_cut(child);
-    }
-
-    // set new child's parent
-    childHierarchy.m_parent = parent;
-    childHierarchy.m_level = parentHierarchy.m_level + 1;
-
-    // If has siblings (not first child)
-    if (parentHierarchy.m_childCount)
-    {
-        ActiveEnt sibling = parentHierarchy.m_childFirst;
-        auto& siblingHierarchy = m_registry.get<ACompHierarchy>(sibling);
-
-        // Set new child and former first child as siblings
-        siblingHierarchy.m_siblingPrev = child;
-        childHierarchy.m_siblingNext = sibling;
-    }
-
-    // Set parent's first child to new child just created
-    parentHierarchy.m_childFirst = child;
-    parentHierarchy.m_childCount ++; // increase child count
-}
-
-void ActiveScene::hier_destroy(ActiveEnt ent)
-{
-    auto &entHier = m_registry.get<ACompHierarchy>(ent);
-
-    // recurse into children. this can be optimized more but i'm lazy
-    while (entHier.m_childCount)
-    {
-        hier_destroy(entHier.m_childFirst);
-    }
-
-    hier_cut(ent);
-    m_registry.destroy(ent);
-}
-
-void ActiveScene::hier_cut(ActiveEnt ent)
-{
-    auto &entHier = m_registry.get<ACompHierarchy>(ent);
-
-    // TODO: deal with m_depth
-
-    // Set sibling's sibling's to each other
-
-    if (m_registry.valid(entHier.m_siblingNext))
-    {
-        m_registry.get<ACompHierarchy>(entHier.m_siblingNext).m_siblingPrev
-                = entHier.m_siblingPrev;
-    }
-
-    if (m_registry.valid(entHier.m_siblingPrev))
-    {
-        m_registry.get<ACompHierarchy>(entHier.m_siblingPrev).m_siblingNext
-                = entHier.m_siblingNext;
-    }
-
-    // deal with parent
-
-    auto &parentHier = m_registry.get<ACompHierarchy>(entHier.m_parent);
-    parentHier.m_childCount --;
-
-    if (parentHier.m_childFirst == ent)
-    {
-        parentHier.m_childFirst = entHier.m_siblingNext;
-    }
-
-    entHier.m_parent = entHier.m_siblingNext = entHier.m_siblingPrev
-            = entt::null;
-}
-
-void ActiveScene::on_hierarchy_construct(ActiveReg_t& reg, ActiveEnt ent)
-{
-    m_hierarchyDirty = true;
-}
-
-void ActiveScene::on_hierarchy_destruct(ActiveReg_t& reg, ActiveEnt ent)
-{
-    m_hierarchyDirty = true;
-}
-
-void ActiveScene::update()
-{
-    // Update machine systems
-    //for (ISysMachine &sysMachine : m_update_sensor)
-    //{
-    //    sysMachine.update_sensor();
-    //}
-
-    //m_wire.update_propigate();
-
-    //for (ISysMachine &sysMachine : m_update_physics)
-    //{
-    //    sysMachine.update_physics(1.0f/60.0f);
-    //}
-    m_updateOrder.call(*this);
-}
-
-
-void ActiveScene::update_hierarchy_transforms()
-{
-
-    auto group = m_registry.group<ACompHierarchy, ACompTransform>();
-
-    if (m_hierarchyDirty)
-    {
-        // Sort by level, so that objects closer to the root are iterated first
-        group.sort<ACompHierarchy>([](ACompHierarchy const& lhs,
-                                     ACompHierarchy const& rhs)
-        {
-            return lhs.m_level < rhs.m_level;
-        }, entt::insertion_sort());
-        //group.sortable();
-        m_hierarchyDirty = false;
-    }
-
-    for(auto entity: group)
-    {
-        //std::cout << "nice: " << group.get<ACompHierarchy>(entity).m_name << "\n";
-
-        ACompHierarchy& hierarchy = group.get<ACompHierarchy>(entity);
-        ACompTransform& transform = group.get<ACompTransform>(entity);
-
-        if (hierarchy.m_parent == m_root)
-        {
-            // top level object, parent is root
-
-            transform.m_transformWorld = transform.m_transform;
-
-        }
-        else
-        {
-            ACompTransform& parentTransform
-                    = group.get<ACompTransform>(hierarchy.m_parent);
-
-            // set transform relative to parent
-            transform.m_transformWorld = parentTransform.m_transformWorld
-                                          * transform.m_transform;
-
-        }
-    }
-
-}
-
-void ActiveScene::draw(ActiveEnt camera)
-{
-    //Matrix4 cameraProject;
-    //Matrix4 cameraInverse;
-
-    // TODO: check if camera has the right components
-    ACompCamera& cameraComp = reg_get<ACompCamera>(camera);
-    ACompTransform& cameraTransform = reg_get<ACompTransform>(camera);
-
-    //cameraProject = cameraComp.m_projection;
-    cameraComp.m_inverse = cameraTransform.m_transformWorld.inverted();
-
-    m_renderOrder.call(cameraComp);
-}
-
-MapSysMachine_t::iterator ActiveScene::system_machine_add(std::string_view name,
-        std::unique_ptr<ISysMachine> sysMachine)
-{
-    auto const& [it, success] = m_sysMachines.emplace(
-            name, std::move(sysMachine));
-    if (success)
-    {
-        return it;
-    }
-    return m_sysMachines.end();
-}
-
-MapSysMachine_t::iterator ActiveScene::system_machine_find(std::string_view name)
-{
-//    MapSysMachine_t::iterator sysIt = m_sysMachines.find(name);
-//    if (sysIt == m_sysMachines.end())
-//    {
-//        return nullptr;
-//    }
-//    else
-//    {
-//        return sysIt->second.get();
-//    }
-    return m_sysMachines.find(name);
-}
-
-bool ActiveScene::system_machine_it_valid(MapSysMachine_t::iterator it)
-{
-    return it != m_sysMachines.end();
-}
-
-
-
-MapDynamicSys_t::iterator ActiveScene::dynamic_system_find(std::string_view name)
-{
-    return m_dynamicSys.find(name);
-}
-
-bool ActiveScene::dynamic_system_it_valid(MapDynamicSys_t::iterator it)
-{
-    return it != m_dynamicSys.end();
-}
-
+/**
+ * Open Space Program
+ * Copyright © 2019-2020 Open Space Program Project
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <algorithm>
+#include <iostream>
+
+#include "ActiveScene.h"
+#include "TransformBatch.h"
+
+using namespace osp;
+using namespace osp::active;
+
+void ACompCamera::calculate_projection()
+{
+
+    m_projection = Matrix4::perspectiveProjection(
+            m_fov, m_viewport.x() / m_viewport.y(),
+            m_near, m_far);
+}
+
+
+ActiveScene::ActiveScene(UserInputHandler &userInput, OSPApplication &app, Package& context) :
+        m_app(app),
+        m_context(context),
+        m_hierarchyDirty(false),
+        m_userInput(userInput)
+{
+    m_registry.on_construct<ACompHierarchy>()
+                    .connect<&ActiveScene::on_hierarchy_construct>(*this);
+
+    m_registry.on_destroy<ACompHierarchy>()
+                    .connect<&ActiveScene::on_hierarchy_destruct>(*this);
+
+    m_registry.on_construct<ACompTransform>()
+                    .connect<&ActiveScene::on_transform_construct>(*this);
+
+    // "There is no need to store groups around for they are extremely cheap to
+    //  construct, even though they can be copied without problems and reused
+    //  freely. A group performs an initialization step the very first time
+    //  it's requested and this could be quite costly. To avoid it, consider
+    //  creating the group when no components have been assigned yet."
+    m_registry.group<ACompHierarchy, ACompTransform>();
+
+    // Create the root entity
+
+    m_root = m_registry.create();
+    ACompHierarchy& hierarchy = m_registry.emplace<ACompHierarchy>(m_root);
+    hierarchy.m_name = "Root Entity";
+    hierarchy.m_orderIndex = 0;
+    m_hierOrder.push_back(m_root);
+
+}
+
+ActiveScene::~ActiveScene()
+{
+    // destruct dynamic systems before registry
+    m_dynamicSys.clear();
+    m_registry.clear();
+}
+
+
+ActiveEnt ActiveScene::hier_create_child(ActiveEnt parent,
+                                            std::string const& name)
+{
+    ActiveEnt child = m_registry.create();
+    ACompHierarchy& childHierarchy = m_registry.emplace<ACompHierarchy>(child);
+    //ACompTransform& transform = m_registry.emplace<ACompTransform>(ent);
+    childHierarchy.m_name = name;
+
+    hier_set_parent_child(parent, child);
+
+    return child;
+}
+
+void ActiveScene::hier_set_parent_child(ActiveEnt parent, ActiveEnt child)
+{
+    ACompHierarchy& childHierarchy = m_registry.get<ACompHierarchy>(child);
+    //ACompTransform& transform = m_registry.emplace<ACompTransform>(ent);
+
+    ACompHierarchy& parentHierarchy = m_registry.get<ACompHierarchy>(parent);
+
+    // if child has an existing parent, cut first
+    if (m_registry.valid(childHierarchy.m_parent))
+    {
+        hier_cut(child);
+    }
+
+    // set new child's parent
+    childHierarchy.m_parent = parent;
+    childHierarchy.m_level = parentHierarchy.m_level + 1;
+
+    // If has siblings (not first child)
+    if (parentHierarchy.m_childCount)
+    {
+        ActiveEnt sibling = parentHierarchy.m_childFirst;
+        auto& siblingHierarchy = m_registry.get<ACompHierarchy>(sibling);
+
+        // Set new child and former first child as siblings
+        siblingHierarchy.m_siblingPrev = child;
+        childHierarchy.m_siblingNext = sibling;
+    }
+
+    // Set parent's first child to new child just created
+    parentHierarchy.m_childFirst = child;
+    parentHierarchy.m_childCount ++; // increase child count
+
+    // Count the child's subtree in every ancestor
+    unsigned const size = childHierarchy.m_descendants + 1;
+    for (ActiveEnt curr = parent; curr != entt::null;
+         curr = m_registry.get<ACompHierarchy>(curr).m_parent)
+    {
+        m_registry.get<ACompHierarchy>(curr).m_descendants += size;
+    }
+
+    hier_order_insert(child);
+    hier_mark_dirty(child);
+}
+
+void ActiveScene::hier_destroy(ActiveEnt ent)
+{
+    auto &entHier = m_registry.get<ACompHierarchy>(ent);
+
+    if (entHier.m_destroy)
+    {
+        return; // already queued
+    }
+
+    entHier.m_destroy = true;
+    m_hierDestroy.push_back(ent);
+}
+
+void ActiveScene::hier_destroy_flush()
+{
+    if (m_hierDestroy.empty())
+    {
+        return;
+    }
+
+    m_hierDestroyAll.clear();
+
+    // Queued entities that are within another queued subtree are destroyed
+    // along with it. Leave them in the queue with a null entity
+    for (ActiveEnt &rEnt : m_hierDestroy)
+    {
+        if (!m_registry.valid(rEnt))
+        {
+            rEnt = entt::null;
+            continue;
+        }
+
+        for (ActiveEnt curr = m_registry.get<ACompHierarchy>(rEnt).m_parent;
+             curr != entt::null;
+             curr = m_registry.get<ACompHierarchy>(curr).m_parent)
+        {
+            if (m_registry.get<ACompHierarchy>(curr).m_destroy)
+            {
+                rEnt = entt::null;
+                break;
+            }
+        }
+    }
+
+    // Gather every subtree while the hierarchy is still intact. Subtrees
+    // connected to the root are already laid out in m_hierOrder
+    std::size_t orderFirst = m_hierOrder.size();
+
+    for (ActiveEnt ent : m_hierDestroy)
+    {
+        if (ent == entt::null)
+        {
+            continue;
+        }
+
+        auto const &entHier = m_registry.get<ACompHierarchy>(ent);
+
+        if (entHier.m_orderIndex != ACompHierarchy::smc_orderNone)
+        {
+            std::size_t const first = entHier.m_orderIndex;
+            std::size_t const last = first + entHier.m_descendants + 1;
+
+            for (std::size_t i = first; i < last; i ++)
+            {
+                m_registry.get<ACompHierarchy>(m_hierOrder[i]).m_orderIndex
+                        = ACompHierarchy::smc_orderNone;
+            }
+
+            m_hierDestroyAll.insert(m_hierDestroyAll.end(),
+                                    m_hierOrder.begin() + first,
+                                    m_hierOrder.begin() + last);
+            orderFirst = std::min(orderFirst, first);
+            continue;
+        }
+
+        // Not connected to the root, walk it instead
+        m_hierDestroyAll.push_back(ent);
+        for (ActiveEnt curr : hier_descendants(ent))
+        {
+            m_hierDestroyAll.push_back(curr);
+        }
+    }
+
+    // Cut each subtree from the rest of the hierarchy. Descendants are
+    // destroyed along with their parents, so they don't need unlinking
+    for (ActiveEnt ent : m_hierDestroy)
+    {
+        if (ent != entt::null
+            && m_registry.get<ACompHierarchy>(ent).m_parent != entt::null)
+        {
+            hier_unlink(ent);
+        }
+    }
+
+    // Remove the gathered subtrees from the order all at once
+    std::size_t kept = orderFirst;
+    for (std::size_t i = orderFirst; i < m_hierOrder.size(); i ++)
+    {
+        auto &hier = m_registry.get<ACompHierarchy>(m_hierOrder[i]);
+        if (hier.m_orderIndex != ACompHierarchy::smc_orderNone)
+        {
+            hier.m_orderIndex = kept;
+            m_hierOrder[kept] = m_hierOrder[i];
+            kept ++;
+        }
+    }
+    m_hierOrder.resize(kept);
+    m_hierarchyDirty = true;
+
+    m_hierDestroy.clear();
+    m_registry.destroy(m_hierDestroyAll.begin(), m_hierDestroyAll.end());
+}
+
+void ActiveScene::hier_cut(ActiveEnt ent)
+{
+    hier_order_remove(ent);
+    hier_unlink(ent);
+}
+
+void ActiveScene::hier_mark_dirty(ActiveEnt ent)
+{
+    auto *pHier = m_registry.try_get<ACompHierarchy>(ent);
+
+    if (pHier == nullptr || pHier->m_dirty)
+    {
+        return;
+    }
+
+    pHier->m_dirty = true;
+    m_hierDirty.push_back(ent);
+}
+
+void ActiveScene::hier_order_insert(ActiveEnt ent)
+{
+    auto &entHier = m_registry.get<ACompHierarchy>(ent);
+    auto const &parentHier = m_registry.get<ACompHierarchy>(entHier.m_parent);
+
+    if (parentHier.m_orderIndex == ACompHierarchy::smc_orderNone)
+    {
+        return; // parent isn't connected to the root either
+    }
+
+    // Insert at the end of the parent's subtree, which is the end of the
+    // order when adding to the last subtree. The parent already counts the
+    // entity's subtree as its descendants.
+    std::size_t const first = parentHier.m_orderIndex
+                            + parentHier.m_descendants - entHier.m_descendants;
+
+    // Make room, then fill in the subtree depth-first, fixing levels on the
+    // way. entHier's level was already set by hier_set_parent_child
+    m_hierOrder.insert(m_hierOrder.begin() + first, entHier.m_descendants + 1,
+                       ent);
+
+    std::size_t i = first + 1;
+    for (ActiveEnt curr : hier_descendants(ent))
+    {
+        auto &currHier = m_registry.get<ACompHierarchy>(curr);
+        currHier.m_level
+                = m_registry.get<ACompHierarchy>(currHier.m_parent).m_level + 1;
+        m_hierOrder[i] = curr;
+        i ++;
+    }
+
+    hier_order_reindex(first);
+    m_hierarchyDirty = true;
+}
+
+void ActiveScene::hier_order_remove(ActiveEnt ent)
+{
+    auto const &entHier = m_registry.get<ACompHierarchy>(ent);
+
+    if (entHier.m_orderIndex == ACompHierarchy::smc_orderNone)
+    {
+        return; // not connected to the root
+    }
+
+    std::size_t const first = entHier.m_orderIndex;
+    std::size_t const last = first + entHier.m_descendants + 1;
+
+    for (std::size_t i = first; i < last; i ++)
+    {
+        m_registry.get<ACompHierarchy>(m_hierOrder[i]).m_orderIndex
+                = ACompHierarchy::smc_orderNone;
+    }
+
+    m_hierOrder.erase(m_hierOrder.begin() + first,
+                      m_hierOrder.begin() + last);
+    hier_order_reindex(first);
+    m_hierarchyDirty = true;
+}
+
+void ActiveScene::hier_order_reindex(std::size_t first)
+{
+    for (std::size_t i = first; i < m_hierOrder.size(); i ++)
+    {
+        m_registry.get<ACompHierarchy>(m_hierOrder[i]).m_orderIndex = i;
+    }
+}
+
+void ActiveScene::hier_unlink(ActiveEnt ent)
+{
+    auto &entHier = m_registry.get<ACompHierarchy>(ent);
+
+    // Uncount the subtree from every ancestor
+    unsigned const size = entHier.m_descendants + 1;
+    for (ActiveEnt curr = entHier.m_parent; curr != entt::null;
+         curr = m_registry.get<ACompHierarchy>(curr).m_parent)
+    {
+        m_registry.get<ACompHierarchy>(curr).m_descendants -= size;
+    }
+
+    // Set sibling's sibling's to each other
+
+    if (m_registry.valid(entHier.m_siblingNext))
+    {
+        m_registry.get<ACompHierarchy>(entHier.m_siblingNext).m_siblingPrev
+                = entHier.m_siblingPrev;
+    }
+
+    if (m_registry.valid(entHier.m_siblingPrev))
+    {
+        m_registry.get<ACompHierarchy>(entHier.m_siblingPrev).m_siblingNext
+                = entHier.m_siblingNext;
+    }
+
+    // deal with parent
+
+    auto &parentHier = m_registry.get<ACompHierarchy>(entHier.m_parent);
+    parentHier.m_childCount --;
+
+    if (parentHier.m_childFirst == ent)
+    {
+        parentHier.m_childFirst = entHier.m_siblingNext;
+    }
+
+    entHier.m_parent = entHier.m_siblingNext = entHier.m_siblingPrev
+            = entt::null;
+}
+
+void ActiveScene::on_hierarchy_construct(ActiveReg_t& reg, ActiveEnt ent)
+{
+    m_hierarchyDirty = true;
+}
+
+void ActiveScene::on_hierarchy_destruct(ActiveReg_t& reg, ActiveEnt ent)
+{
+    m_hierarchyDirty = true;
+}
+
+void ActiveScene::on_transform_construct(ActiveReg_t& reg, ActiveEnt ent)
+{
+    hier_mark_dirty(ent);
+}
+
+void ActiveScene::update()
+{
+    // Update machine systems
+    //for (ISysMachine &sysMachine : m_update_sensor)
+    //{
+    //    sysMachine.update_sensor();
+    //}
+
+    //m_wire.update_propigate();
+
+    //for (ISysMachine &sysMachine : m_update_physics)
+    //{
+    //    sysMachine.update_physics(1.0f/60.0f);
+    //}
+    m_updateOrder.call(*this);
+
+    hier_destroy_flush();
+}
+
+
+void ActiveScene::update_hierarchy_transforms()
+{
+
+    auto group = m_registry.group<ACompHierarchy, ACompTransform>();
+
+    if (m_hierarchyDirty)
+    {
+        // Store components in the same depth-first order, so the sweeps
+        // below read memory in order. Only entities that were added or moved
+        // are out of place, so insertion sort is close to linear
+        group.sort<ACompHierarchy>([](ACompHierarchy const& lhs,
+                                     ACompHierarchy const& rhs)
+        {
+            return lhs.m_orderIndex < rhs.m_orderIndex;
+        }, entt::insertion_sort());
+        //group.sortable();
+        m_hierarchyDirty = false;
+    }
+
+    if (m_hierDirty.empty())
+    {
+        return; // nothing moved
+    }
+
+    // Drop destroyed entities, and sort ancestors before descendants
+    m_hierDirty.erase(std::remove_if(
+            m_hierDirty.begin(), m_hierDirty.end(), [this] (ActiveEnt ent)
+    {
+        return !m_registry.valid(ent);
+    }), m_hierDirty.end());
+
+    std::sort(m_hierDirty.begin(), m_hierDirty.end(),
+              [this] (ActiveEnt lhs, ActiveEnt rhs)
+    {
+        return m_registry.get<ACompHierarchy>(lhs).m_orderIndex
+                < m_registry.get<ACompHierarchy>(rhs).m_orderIndex;
+    });
+
+    // Find subtrees to update. Dirty entities within a subtree that was
+    // already found are updated along with it
+    m_hierRanges.clear();
+    std::size_t updatedEnd = 0;
+    std::size_t updatedCount = 0;
+
+    for (ActiveEnt dirty : m_hierDirty)
+    {
+        auto &dirtyHier = m_registry.get<ACompHierarchy>(dirty);
+        dirtyHier.m_dirty = false;
+
+        if (dirtyHier.m_orderIndex == ACompHierarchy::smc_orderNone
+            || dirtyHier.m_orderIndex < updatedEnd)
+        {
+            continue;
+        }
+
+        std::size_t const first = dirtyHier.m_orderIndex;
+        updatedEnd = first + dirtyHier.m_descendants + 1;
+        updatedCount += updatedEnd - first;
+
+        if (dirtyHier.m_level >= gc_heir_physics_level)
+        {
+            m_hierRanges.emplace_back(first, updatedEnd);
+            continue;
+        }
+
+        // Split everything under the root into its top level subtrees,
+        // skipping the root itself
+        for (std::size_t i = first + 1; i < updatedEnd; )
+        {
+            std::size_t const end = i + m_registry.get<ACompHierarchy>(
+                    m_hierOrder[i]).m_descendants + 1;
+            m_hierRanges.emplace_back(i, end);
+            i = end;
+        }
+    }
+
+    WorkerPool &rWorkers = m_app.get_workers();
+
+    std::size_t const batchCount
+            = (m_hierParallel && updatedCount >= smc_hierParallelMin)
+            ? std::min(rWorkers.get_thread_count() + 1, m_hierRanges.size())
+            : 1;
+
+    if (m_hierBatches.size() < batchCount)
+    {
+        m_hierBatches.resize(batchCount);
+    }
+
+    if (batchCount <= 1)
+    {
+        hier_batch_update(m_hierBatches[0], m_hierRanges.data(),
+                          m_hierRanges.size());
+    }
+    else
+    {
+        // Give each batch a run of subtrees with about the same number of
+        // entities
+        m_hierSplits.assign(1, 0);
+        std::size_t counted = 0;
+        for (std::size_t i = 0; i < m_hierRanges.size(); i ++)
+        {
+            counted += m_hierRanges[i].second - m_hierRanges[i].first;
+            if (counted * batchCount >= updatedCount * m_hierSplits.size())
+            {
+                m_hierSplits.push_back(i + 1);
+            }
+        }
+        if (m_hierSplits.back() != m_hierRanges.size())
+        {
+            m_hierSplits.push_back(m_hierRanges.size());
+        }
+
+        rWorkers.for_each(m_hierSplits.size() - 1, [this] (std::size_t i)
+        {
+            std::size_t const first = m_hierSplits[i];
+            hier_batch_update(m_hierBatches[i], m_hierRanges.data() + first,
+                              m_hierSplits[i + 1] - first);
+        });
+    }
+
+    m_hierDirty.clear();
+}
+
+void ActiveScene::hier_batch_update(
+        HierBatch& rBatch, std::pair<std::size_t, std::size_t> const* pRanges,
+        std::size_t count)
+{
+    rBatch.m_parents.clear();
+    rBatch.m_local.clear();
+    rBatch.m_transforms.clear();
+
+    for (std::size_t r = 0; r < count; r ++)
+    {
+        auto const [first, end] = pRanges[r];
+
+        // The subtree's parent isn't part of it, but its world transform is
+        // still needed. Add it as a transform with no parent
+        auto const &firstHier
+                = m_registry.get<ACompHierarchy>(m_hierOrder[first]);
+        uint32_t parentOutside = gc_batchNoParent;
+        if (firstHier.m_parent != m_root)
+        {
+            auto *pParentTransform
+                    = m_registry.try_get<ACompTransform>(firstHier.m_parent);
+            if (pParentTransform != nullptr)
+            {
+                parentOutside = uint32_t(rBatch.m_parents.size());
+                rBatch.m_parents.push_back(gc_batchNoParent);
+                rBatch.m_local.push_back(pParentTransform->m_transformWorld);
+                rBatch.m_transforms.push_back(nullptr);
+            }
+        }
+
+        rBatch.m_index.assign(end - first, gc_batchNoParent);
+
+        for (std::size_t i = first; i < end; i ++)
+        {
+            ActiveEnt const entity = m_hierOrder[i];
+
+            auto *pTransform = m_registry.try_get<ACompTransform>(entity);
+            if (pTransform == nullptr)
+            {
+                continue;
+            }
+
+            uint32_t parent;
+            if (i == first)
+            {
+                parent = parentOutside;
+            }
+            else
+            {
+                // Parents come before children, and within the subtree
+                ActiveEnt const parentEnt
+                        = m_registry.get<ACompHierarchy>(entity).m_parent;
+                parent = rBatch.m_index[m_registry.get<ACompHierarchy>(
+                        parentEnt).m_orderIndex - first];
+            }
+
+            rBatch.m_index[i - first] = uint32_t(rBatch.m_parents.size());
+            rBatch.m_parents.push_back(parent);
+            rBatch.m_local.push_back(pTransform->m_transform);
+            rBatch.m_transforms.push_back(pTransform);
+        }
+    }
+
+    rBatch.m_world.resize(rBatch.m_local.size());
+    transform_batch_world(rBatch.m_parents.data(), rBatch.m_local.data(),
+                          rBatch.m_world.data(), rBatch.m_local.size());
+
+    for (std::size_t i = 0; i < rBatch.m_transforms.size(); i ++)
+    {
+        if (rBatch.m_transforms[i] != nullptr)
+        {
+            rBatch.m_transforms[i]->m_transformWorld = rBatch.m_world[i];
+        }
+    }
+}
+
+void ActiveScene::draw(ActiveEnt camera)
+{
+    //Matrix4 cameraProject;
+    //Matrix4 cameraInverse;
+
+    // TODO: check if camera has the right components
+    ACompCamera& cameraComp = reg_get<ACompCamera>(camera);
+    ACompTransform& cameraTransform = reg_get<ACompTransform>(camera);
+
+    //cameraProject = cameraComp.m_projection;
+    cameraComp.m_inverse = cameraTransform.m_transformWorld.inverted();
+
+    m_renderOrder.call(cameraComp);
+}
+
+MapSysMachine_t::iterator ActiveScene::system_machine_add(std::string_view name,
+        std::unique_ptr<ISysMachine> sysMachine)
+{
+    auto const& [it, success] = m_sysMachines.emplace(
+            name, std::move(sysMachine));
+    if (success)
+    {
+        return it;
+    }
+    return m_sysMachines.end();
+}
+
+MapSysMachine_t::iterator ActiveScene::system_machine_find(std::string_view name)
+{
+//    MapSysMachine_t::iterator sysIt = m_sysMachines.find(name);
+//    if (sysIt == m_sysMachines.end())
+//    {
+//        return nullptr;
+//    }
+//    else
+//    {
+//        return sysIt->second.get();
+//    }
+    return m_sysMachines.find(name);
+}
+
+bool ActiveScene::system_machine_it_valid(MapSysMachine_t::iterator it)
+{
+    return it != m_sysMachines.end();
+}
+
+
+
+MapDynamicSys_t::iterator ActiveScene::dynamic_system_find(std::string_view name)
+{
+    return m_dynamicSys.find(name);
+}
+
+bool ActiveScene::dynamic_system_it_valid(MapDynamicSys_t::iterator it)
+{
+    return it != m_dynamicSys.end();
+}
+
@@ -26,7 +26,7 @@
 
 #include <utility>
 #include <vector>
-#include <stack>
+#include <iterator>
 
 #include "../OSPApplication.h"
 #include "../UserInputHandler.h"
@@ -45,6 +45,10 @@
 namespace osp::active
 {
 
+class HierChildren;
+class HierDescendants;
+class HierAncestors;
+
 /**
  * An ECS 3D Game Engine scene that implements a scene graph hierarchy.
  *
@@ -91,11 +95,21 @@ public:
     void hier_set_parent_child(ActiveEnt parent, ActiveEnt child);
 
     /**
-     * Destroy an entity and all its descendents
+     * Queue an entity and all its descendents to be destroyed by the next
+     * hier_destroy_flush(). They stay in the hierarchy until then.
+     *
      * @param ent [in]
      */
     void hier_destroy(ActiveEnt ent);
 
+    /**
+     * Destroy everything queued by hier_destroy(). Descendants are gathered
+     * without recursion, each queued subtree is cut from its parent once,
+     * and the depth-first order is compacted in a single pass before all of
+     * the entities are destroyed together. Called at the end of update().
+     */
+    void hier_destroy_flush();
+
     /**
      * Cut an entity out of it's parent. This will leave the entity with no
      * parent.
@@ -103,6 +117,50 @@ public:
      */
     void hier_cut(ActiveEnt ent);
 
+    /**
+     * Mark an entity's ACompTransform as changed, so it and its descendants
+     * get new world transforms in the next update_hierarchy_transforms().
+     * Call this after writing to ACompTransform::m_transform.
+     *
+     * @param ent [in] Entity with an ACompHierarchy
+     */
+    void hier_mark_dirty(ActiveEnt ent);
+
+    /**
+     * Entities connected to the root, in depth-first order. The root comes
+     * first, and every entity is followed by all of its descendants; see
+     * ACompHierarchy::m_orderIndex and m_descendants.
+     *
+     * @return Entities in depth-first order
+     */
+    constexpr std::vector<ActiveEnt> const& hier_get_order() const noexcept
+    { return m_hierOrder; }
+
+    /**
+     * Range over the direct children of an entity, following sibling links.
+     * Doesn't allocate.
+     *
+     * @param ent [in] Entity with an ACompHierarchy
+     */
+    HierChildren hier_children(ActiveEnt ent) const;
+
+    /**
+     * Range over every descendant of an entity, not including itself, in
+     * depth-first order. Works for entities not connected to the root, and
+     * doesn't allocate.
+     *
+     * @param ent [in] Entity with an ACompHierarchy
+     */
+    HierDescendants hier_descendants(ActiveEnt ent) const;
+
+    /**
+     * Range over the parent of an entity, its parent, and so on up to the
+     * root entity
+     *
+     * @param ent [in] Entity with an ACompHierarchy
+     */
+    HierAncestors hier_ancestors(ActiveEnt ent) const;
+
     /**
      * Traverse the scene hierarchy
      * 
@@ -150,9 +208,24 @@ public:
     /**
      * Update the m_transformWorld of entities with ACompTransform and
      * ACompHierarchy. Intended for physics interpolation
+     *
+     * Only subtrees under entities marked with hier_mark_dirty() are updated.
+     * Subtrees are contiguous in hier_get_order(), so each is updated in one
+     * linear sweep, parents before children.
      */
     void update_hierarchy_transforms();
 
+    /**
+     * Spread update_hierarchy_transforms() over the application's
+     * WorkerPool. Dirty subtrees are split at gc_heir_physics_level, so each
+     * vehicle and anything else under the root can be updated separately.
+     * Off by default.
+     *
+     * @param parallel [in] True to use the WorkerPool
+     */
+    void hier_set_parallel(bool parallel) noexcept
+    { m_hierParallel = parallel; }
+
     /**
      * Calculate transformations relative to camera, and draw every
      * CompDrawableDebug
@@ -229,6 +302,63 @@ private:
 
     void on_hierarchy_construct(ActiveReg_t& reg, ActiveEnt ent);
     void on_hierarchy_destruct(ActiveReg_t& reg, ActiveEnt ent);
+    void on_transform_construct(ActiveReg_t& reg, ActiveEnt ent);
+
+    /**
+     * Insert an entity and its descendants into m_hierOrder, at the end of
+     * its parent's subtree
+     */
+    void hier_order_insert(ActiveEnt ent);
+
+    /**
+     * Remove an entity and its descendants from m_hierOrder
+     */
+    void hier_order_remove(ActiveEnt ent);
+
+    /**
+     * Set m_orderIndex of entities in m_hierOrder from an index onwards
+     */
+    void hier_order_reindex(std::size_t first);
+
+    /**
+     * Unlink an entity from its parent and siblings, and uncount its
+     * subtree from its ancestors, without touching m_hierOrder
+     */
+    void hier_unlink(ActiveEnt ent);
+
+    // Fewer dirty transforms than this are updated on one thread even if
+    // m_hierParallel is set, as waking the workers would take longer
+    static constexpr std::size_t smc_hierParallelMin = 2048;
+
+    /**
+     * Space for passing subtrees to transform_batch_world, kept between
+     * updates to avoid allocating
+     */
+    struct HierBatch
+    {
+        std::vector<uint32_t> m_parents;
+        std::vector<Matrix4> m_local;
+        std::vector<Matrix4> m_world;
+
+        // Where to write results, nullptr for parents outside of a subtree
+        std::vector<ACompTransform*> m_transforms;
+
+        // Index in the batch of each entity in the current subtree
+        std::vector<uint32_t> m_index;
+    };
+
+    /**
+     * Update world transforms of subtrees using a batch. Subtrees must not
+     * overlap, and parents of subtrees must not be updated at the same time,
+     * so separate batches can run on separate threads.
+     *
+     * @param rBatch  [ref] Batch to use
+     * @param pRanges [in] Subtrees as [first, end) ranges of m_hierOrder
+     * @param count   [in] Number of subtrees
+     */
+    void hier_batch_update(HierBatch& rBatch,
+                           std::pair<std::size_t, std::size_t> const* pRanges,
+                           std::size_t count);
 
     OSPApplication& m_app;
     Package& m_context;
@@ -238,6 +368,28 @@ private:
     ActiveEnt m_root;
     bool m_hierarchyDirty;
 
+    // Entities connected to the root in depth-first order
+    std::vector<ActiveEnt> m_hierOrder;
+
+    // Entities marked with hier_mark_dirty()
+    std::vector<ActiveEnt> m_hierDirty;
+
+    // Entities queued by hier_destroy(), and everything to destroy in
+    // hier_destroy_flush()
+    std::vector<ActiveEnt> m_hierDestroy;
+    std::vector<ActiveEnt> m_hierDestroyAll;
+
+    // Dirty subtrees as [first, end) ranges of m_hierOrder, found by
+    // update_hierarchy_transforms
+    std::vector<std::pair<std::size_t, std::size_t>> m_hierRanges;
+
+    // One per thread that takes part in update_hierarchy_transforms, and
+    // where each one's share of m_hierRanges starts
+    std::vector<HierBatch> m_hierBatches;
+    std::vector<std::size_t> m_hierSplits;
+
+    bool m_hierParallel{false};
+
     float m_timescale;
 
     UserInputHandler &m_userInput;
@@ -308,7 +460,8 @@ struct ACompTransform
     bool m_controlled{false};
 
     // if this is true, then transform can be modified, as long as
-    // m_transformDirty is set afterwards
+    // m_transformDirty is set afterwards. Changing m_transform also needs
+    // ActiveScene::hier_mark_dirty to update m_transformWorld
     bool m_mutable{true};
     bool m_transformDirty{false};
 };
@@ -327,6 +480,20 @@ struct ACompHierarchy
     unsigned m_childCount{0};
     ActiveEnt m_childFirst{entt::null};
 
+    // Index in ActiveScene::hier_get_order(), or smc_orderNone if not
+    // connected to the root
+    static constexpr unsigned smc_orderNone = ~0u;
+    unsigned m_orderIndex{smc_orderNone};
+
+    // Number of descendants, which follow this entity in the order
+    unsigned m_descendants{0};
+
+    // Queued for ActiveScene::update_hierarchy_transforms
+    bool m_dirty{false};
+
+    // Queued for ActiveScene::hier_destroy_flush
+    bool m_destroy{false};
+
     // transform relative to parent
 
 };
@@ -346,50 +513,198 @@ struct ACompCamera
     void calculate_projection();
 };
 
-enum class EHierarchyTraverseStatus : bool
+/**
+ * Iterator over entities linked by ACompHierarchy. Each step is done by
+ * STEP_T, which takes the registry, the entity the range started from, and
+ * the current entity, and returns the next entity or entt::null at the end.
+ */
+template<typename STEP_T>
+class HierIterator
 {
-    Continue = true,
-    Stop = false
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = ActiveEnt;
+    using difference_type = std::ptrdiff_t;
+    using pointer = ActiveEnt const*;
+    using reference = ActiveEnt;
+
+    HierIterator() = default;
+    HierIterator(ActiveReg_t const* pReg, ActiveEnt start, ActiveEnt current)
+     : m_pReg(pReg)
+     , m_start(start)
+     , m_current(current)
+    { }
+
+    ActiveEnt operator*() const noexcept { return m_current; }
+
+    HierIterator& operator++()
+    {
+        m_current = STEP_T::next(*m_pReg, m_start, m_current);
+        return *this;
+    }
+
+    HierIterator operator++(int)
+    {
+        HierIterator copy = *this;
+        ++(*this);
+        return copy;
+    }
+
+    bool operator==(HierIterator const& rhs) const noexcept
+    { return m_current == rhs.m_current; }
+
+    bool operator!=(HierIterator const& rhs) const noexcept
+    { return m_current != rhs.m_current; }
+
+private:
+    ActiveReg_t const *m_pReg{nullptr};
+    ActiveEnt m_start{entt::null};
+    ActiveEnt m_current{entt::null};
 };
 
-template<typename FUNC_T>
-void ActiveScene::hierarchy_traverse(ActiveEnt root, FUNC_T callable)
+/**
+ * Range of HierIterators, see ActiveScene::hier_children() and similar
+ */
+template<typename STEP_T>
+class HierRange
 {
-    using osp::active::ACompHierarchy;
+public:
+    using iterator = HierIterator<STEP_T>;
 
-    std::stack<ActiveEnt> parentNextSibling;
-    ActiveEnt currentEnt = root;
+    HierRange(ActiveReg_t const& reg, ActiveEnt start)
+     : m_pReg(&reg)
+     , m_start(start)
+    { }
 
-    while (true)
+    iterator begin() const
     {
-        ACompHierarchy &hier = reg_get<ACompHierarchy>(currentEnt);
+        return {m_pReg, m_start, STEP_T::first(*m_pReg, m_start)};
+    }
 
-        if (callable(currentEnt) == EHierarchyTraverseStatus::Stop) { return; }
+    iterator end() const { return {m_pReg, m_start, entt::null}; }
 
-        if (hier.m_childCount)
-        {
-            // entity has some children
-            currentEnt = hier.m_childFirst;
+    bool empty() const { return STEP_T::first(*m_pReg, m_start) == entt::null; }
+
+private:
+    ActiveReg_t const *m_pReg;
+    ActiveEnt m_start;
+};
 
+struct HierStepChildren
+{
+    static ActiveEnt first(ActiveReg_t const& reg, ActiveEnt start)
+    {
+        return reg.get<ACompHierarchy>(start).m_childFirst;
+    }
 
-            // save next sibling for later if it exists
-            if (hier.m_siblingNext != entt::null)
-            {
-                parentNextSibling.push(hier.m_siblingNext);
-            }
-        } else if (hier.m_siblingNext != entt::null)
+    static ActiveEnt next(ActiveReg_t const& reg, ActiveEnt start,
+                          ActiveEnt current)
+    {
+        return reg.get<ACompHierarchy>(current).m_siblingNext;
+    }
+};
+
+struct HierStepDescendants
+{
+    static ActiveEnt first(ActiveReg_t const& reg, ActiveEnt start)
+    {
+        return reg.get<ACompHierarchy>(start).m_childFirst;
+    }
+
+    /**
+     * Go down to the first child if there is one, otherwise to the next
+     * sibling of the nearest ancestor that has one. Parent links replace the
+     * stack a depth-first walk would need, and the walk stops on returning
+     * to start, so it never leaves start's subtree.
+     */
+    static ActiveEnt next(ActiveReg_t const& reg, ActiveEnt start,
+                          ActiveEnt current)
+    {
+        auto const *pHier = &reg.get<ACompHierarchy>(current);
+
+        if (pHier->m_childFirst != entt::null)
         {
-            // no children, move to next sibling
-            currentEnt = hier.m_siblingNext;
-        } else if (parentNextSibling.size())
+            return pHier->m_childFirst;
+        }
+
+        while (current != start)
         {
-            // last sibling, and not done yet
-            // is last sibling, move to parent's (or ancestor's) next sibling
-            currentEnt = parentNextSibling.top();
-            parentNextSibling.pop();
-        } else
+            if (pHier->m_siblingNext != entt::null)
+            {
+                return pHier->m_siblingNext;
+            }
+
+            current = pHier->m_parent;
+            pHier = &reg.get<ACompHierarchy>(current);
+        }
+
+        return entt::null;
+    }
+};
+
+struct HierStepAncestors
+{
+    static ActiveEnt first(ActiveReg_t const& reg, ActiveEnt start)
+    {
+        return reg.get<ACompHierarchy>(start).m_parent;
+    }
+
+    static ActiveEnt next(ActiveReg_t const& reg, ActiveEnt start,
+                          ActiveEnt current)
+    {
+        return reg.get<ACompHierarchy>(current).m_parent;
+    }
+};
+
+class HierChildren : public HierRange<HierStepChildren>
+{
+    using HierRange::HierRange;
+};
+
+class HierDescendants : public HierRange<HierStepDescendants>
+{
+    using HierRange::HierRange;
+};
+
+class HierAncestors : public HierRange<HierStepAncestors>
+{
+    using HierRange::HierRange;
+};
+
+inline HierChildren ActiveScene::hier_children(ActiveEnt ent) const
+{
+    return {m_registry, ent};
+}
+
+inline HierDescendants ActiveScene::hier_descendants(ActiveEnt ent) const
+{
+    return {m_registry, ent};
+}
+
+inline HierAncestors ActiveScene::hier_ancestors(ActiveEnt ent) const
+{
+    return {m_registry, ent};
+}
+
+enum class EHierarchyTraverseStatus : bool
+{
+    Continue = true,
+    Stop = false
+};
+
+template<typename FUNC_T>
+void ActiveScene::hierarchy_traverse(ActiveEnt root, FUNC_T callable)
+{
+    if (callable(root) == EHierarchyTraverseStatus::Stop)
+    {
+        return;
+    }
+
+    for (ActiveEnt ent : hier_descendants(root))
+    {
+        if (callable(ent) == EHierarchyTraverseStatus::Stop)
         {
-            break;
+            return;
         }
     }
 }
@@ -51,65 +51,194 @@ void SysAreaAssociate::update_scan(ActiveScene& rScene)
         return;
     }
 
-    //Universe& uni = m_universe;
-    //std::vector<Satellite>& satellites = uni.
-    auto view = m_universe.get_reg().view<UCompActivatable>();
+    auto &ureg = m_universe.get_reg();
+    auto const &area = ureg.get<UCompActiveArea>(m_areaSat);
+    auto viewAct = ureg.view<UCompActivatable>();
+
+    SatConjunctions const &conjunctions = m_universe.get_conjunctions();
+
+    // Deactivate satellites that left. Activated entities are positioned
+    // relative to the area, and their satellites aren't updated while
+    // activated, so use the entity's position instead. Satellites on their
+    // way in are kept, see below
+
+    auto viewActivated = m_scene.get_registry()
+            .view<ACompActivatedSat, ACompTransform>();
+
+    m_scanLeaving.clear();
+    for (ActiveEnt ent : viewActivated)
+    {
+        auto const &entAct = viewActivated.get<ACompActivatedSat>(ent);
+        auto const &entTransform = viewActivated.get<ACompTransform>(ent);
+
+        if (!viewAct.contains(entAct.m_sat))
+        {
+            // Satellite was removed from the universe
+            m_scanLeaving.push_back(ent);
+            continue;
+        }
+
+        float const reach = area.m_deactivateRadius
+                          + viewAct.get(entAct.m_sat).m_radius;
+
+        if (entTransform.m_transform.translation().dot() > reach * reach
+            && !conjunctions.is_close(m_areaSat, entAct.m_sat))
+        {
+            m_scanLeaving.push_back(ent);
+        }
+    }
+
+    for (ActiveEnt ent : m_scanLeaving)
+    {
+        sat_deactivate(ent, m_scene.reg_get<ACompActivatedSat>(ent));
+    }
+
+    // Find satellites that entered
+
+    unsigned const pass = m_universe.get_frames_pass();
 
-    for (Satellite sat : view)
+    if (pass == m_scanPass && !m_scanFull)
     {
-//        if (SatelliteObject* obj = sat.get_object())
-//        {
-//            //std::cout << "obj: " << obj->get_id().m_name
-//            //          << ", " << (void*)(&(obj->get_id())) << "\n";
-//        }
-//        else
-//        {
-//            // Satellite has no object, it's empty
-//            continue;
-//        }
-
-//        // if satellite is not loadable or is already activated
-//        if (!sat.is_activatable() || sat.get_loader())
-//        {
-//            //std::cout << "already loaded\n";
-//            continue;
-//        }
-
-
-        // ignore self (unreachable as active areas are unloadable)
-        //if (&sat == m_sat)
-        //{
-        //    continue;
-        //}
-
-        // Calculate distance to satellite
-        // For these long vectors, 1024 units = 1 meter
-        //Vector3s relativePos = m_universe.sat_calc_position(m_areaSat, sat);
-        //Vector3 relativePosMeters = Vector3(relativePos) / 1024.0f;
-
-        //using Magnum::Math::pow;
-
-        // ignore if too far
-        //if (relativePos.dot() > pow(sat.get_load_radius()
-        //    + m_sat->get_load_radius(), 2.0f))
-        //{
-        //    continue;
-        //}
-
-        //std::cout << "is near! dist: " << relativePos.length() << "/"
-        //<< (sat.get_load_radius() + m_sat->get_load_radius()) << "\n";
+        return; // nothing moved since the last scan
+    }
+
+    // Above this many moved satellites, querying the index is cheaper than
+    // checking each of them
+    constexpr std::size_t c_changedCheckMax = 256;
+
+    std::vector<Satellite> const &changed = m_universe.get_frames_changed();
+
+    // For these long vectors, 1024 units = 1 meter
+    Vector3s const areaPos = m_universe.sat_calc_pos(m_universe.sat_root(),
+                                                     m_areaSat);
+
+    // The changed list only covers the last pass, so it can't be used if
+    // any passes were missed
+    bool const consecutive = !m_scanFull && pass == m_scanPass + 1;
+    bool const useChanged = consecutive
+                         && areaPos == m_scanAreaPos
+                         && changed.size() <= c_changedCheckMax;
+
+    m_scanPass = pass;
+    m_scanAreaPos = areaPos;
+    m_scanFull = false;
+    m_scanEntering.clear();
+
+    if (!useChanged)
+    {
+        SpaceInt const radius
+                = SpaceInt(area.m_activateRadius * gc_units_per_meter);
+
+        m_universe.get_spatial_index().query_radius(
+                areaPos, radius,
+                [this, &viewAct] (Satellite sat, Vector3s const&, SpaceInt)
+        {
+            if (viewAct.contains(sat) && !m_activatedSats.contains(sat))
+            {
+                m_scanEntering.push_back(sat);
+            }
+        });
+    }
+    else
+    {
+        // Only satellites that moved can have entered. Positions of all the
+        // candidates are calculated in one batch
+        m_scanCandidates.clear();
+        for (Satellite sat : changed)
+        {
+            if (viewAct.contains(sat) && !m_activatedSats.contains(sat))
+            {
+                m_scanCandidates.push_back(sat);
+            }
+        }
+
+        m_scanPos.resize(m_scanCandidates.size());
+        m_universe.sat_calc_pos_meters(
+                m_areaSat, {m_scanCandidates.data(), m_scanCandidates.size()},
+                {m_scanPos.data(), m_scanPos.size()});
 
+        for (std::size_t i = 0; i < m_scanCandidates.size(); i ++)
+        {
+            Satellite const sat = m_scanCandidates[i];
+            float const reach = area.m_activateRadius
+                              + viewAct.get(sat).m_radius;
+
+            if (m_scanPos[i].dot() <= reach * reach)
+            {
+                m_scanEntering.push_back(sat);
+            }
+        }
+    }
+
+    // Preload satellites that will reach the activate radius within the
+    // conjunction lookahead, so they're ready by the time they arrive.
+    // Events only cover the last pass, so look at all conjunctions if any
+    // were missed
+    auto const preload = [this, &viewAct] (Satellite sat)
+    {
+        if (viewAct.contains(sat) && !m_activatedSats.contains(sat))
+        {
+            m_scanEntering.push_back(sat);
+        }
+    };
+
+    if (consecutive)
+    {
+        for (ConjunctionEvent const& event : conjunctions.get_events())
+        {
+            if (!event.m_enter)
+            {
+                continue;
+            }
+
+            if (event.m_a == m_areaSat)
+            {
+                preload(event.m_b);
+            }
+            else if (event.m_b == m_areaSat)
+            {
+                preload(event.m_a);
+            }
+        }
+    }
+    else
+    {
+        conjunctions.for_each_close(m_areaSat, preload);
+    }
+
+    // Calculate positions of everything entering in one batch, read by
+    // activators through sat_scene_pos()
+    m_scanPos.resize(m_scanEntering.size());
+    m_universe.sat_calc_pos_meters(
+            m_areaSat, {m_scanEntering.data(), m_scanEntering.size()},
+            {m_scanPos.data(), m_scanPos.size()});
+
+    // Activate after searching, as activators may modify the universe
+    for (m_scanActivating = 0; m_scanActivating < m_scanEntering.size();
+         m_scanActivating ++)
+    {
         // Satellite is near! Attempt to load it
+        Satellite const sat = m_scanEntering[m_scanActivating];
+        sat_activate(sat, viewAct.get(sat));
+    }
+}
 
-        sat_activate(sat, view.get(sat));
+Vector3 SysAreaAssociate::sat_scene_pos(universe::Satellite sat) const
+{
+    if (m_scanActivating < m_scanEntering.size()
+        && m_scanEntering[m_scanActivating] == sat)
+    {
+        return m_scanPos[m_scanActivating];
     }
 
+    return m_universe.sat_calc_pos_meters(m_areaSat, sat);
 }
 
 void SysAreaAssociate::connect(universe::Satellite sat)
 {
     // do more stuff here eventually
     m_areaSat = sat;
+    m_scanFull = true;
 }
 
 void SysAreaAssociate::disconnect()
@@ -120,7 +249,10 @@ void SysAreaAssociate::disconnect()
 
         auto viewAct = m_scene.get_registry().view<ACompActivatedSat>();
 
-        for (ActiveEnt ent : viewAct)
+        // Deactivating destroys entities, so copy them out of the view first
+        m_scanLeaving.assign(viewAct.begin(), viewAct.end());
+
+        for (ActiveEnt ent : m_scanLeaving)
         {
             sat_deactivate(ent, viewAct.get(ent));
         }
@@ -137,6 +269,7 @@ void SysAreaAssociate::area_move(Vector3s translate)
             .get<universe::UCompTransformTraj>(m_areaSat);
 
     areaPosTraj.m_position += translate;
+    m_universe.sat_mark_dirty(m_areaSat);
 
     Vector3 meters = Vector3(translate) / gc_units_per_meter;
 
@@ -149,6 +282,12 @@ void SysAreaAssociate::sat_transform_update(ActiveEnt ent)
     auto const &entTransform = m_scene.reg_get<ACompTransform>(ent);
 
     Satellite sat = entAct.m_sat;
+
+    if (!m_universe.get_reg().valid(sat))
+    {
+        return; // satellite was removed from the universe
+    }
+
     auto &satPosTraj = m_universe.get_reg()
             .get<universe::UCompTransformTraj>(sat);
 
@@ -164,7 +303,7 @@ void SysAreaAssociate::sat_transform_update(ActiveEnt ent)
     satPosTraj.m_position = areaPosTraj.m_position + posAreaRelative;
     satPosTraj.m_rotation = Quaternion::
             fromMatrix(entTransform.m_transform.rotationScaling());
-    satPosTraj.m_dirty = true;
+    m_universe.sat_mark_dirty(sat);
 }
 
 void SysAreaAssociate::activator_add(universe::ITypeSatellite const* type,
@@ -195,6 +334,7 @@ void SysAreaAssociate::floating_origin_translate(Vector3 translation)
         }
 
         entTransform.m_transform.translation() += translation;
+        m_scene.hier_mark_dirty(ent);
     }
 }
 
@@ -256,16 +396,18 @@ int SysAreaAssociate::sat_activate(universe::Satellite sat,
 int SysAreaAssociate::sat_deactivate(ActiveEnt ent, ACompActivatedSat& entAct)
 {
     IActivator *activator = entAct.m_activator->second;
+    Satellite const sat = entAct.m_sat;
 
     // this should never happen
-    if (!m_activatedSats.contains(entAct.m_sat))
+    if (!m_activatedSats.contains(sat))
     {
         return 1;
     }
 
-    activator->deactivate_sat(m_scene, *this, m_areaSat, entAct.m_sat, ent);
+    // This destroys the entity, entAct can't be used after this
+    activator->deactivate_sat(m_scene, *this, m_areaSat, sat, ent);
 
-    m_activatedSats.erase(entAct.m_sat);
+    m_activatedSats.erase(sat);
 
     return 0;
 }
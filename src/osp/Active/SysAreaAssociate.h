@@ -47,6 +47,9 @@ struct StatusActivated
 /**
  * An interface that 'activates' and 'deactivates' a type of ITypeSatellite
  * into an ActiveScene.
+ *
+ * deactivate_sat is responsible for destroying the entity created by
+ * activate_sat.
  */
 class IActivator
 {
@@ -70,10 +73,17 @@ public:
     ~SysAreaAssociate() = default;
 
     /**
-     * Attempt to activate all the Satellites in the Universe for now.
+     * Deactivate Satellites that left the ActiveArea's deactivate radius, then
+     * attempt to activate Satellites that entered its activate radius.
+     *
+     * Entering satellites are found from the satellites moved by the last
+     * Universe::sat_frames_update(). The spatial index is only queried when
+     * the area itself moved, updates were missed, or too many satellites
+     * moved to check one by one.
      *
-     * What this is suppose to do in the future:
-     * Scan for nearby Satellites and attempt to activate them
+     * Satellites in conjunction with the area are activated early, and
+     * aren't deactivated until the conjunction ends, see
+     * Universe::get_conjunctions().
      */
     void update_scan(ActiveScene& rScene);
 
@@ -99,7 +109,8 @@ public:
 
     /**
      * Update position of ent's associated Satellite in the Universe, based on
-     * it's transform in the ActiveScene.
+     * it's transform in the ActiveScene. Does nothing if the satellite was
+     * removed from the Universe.
      */
     void sat_transform_update(ActiveEnt ent);
 
@@ -111,6 +122,16 @@ public:
     void activator_add(universe::ITypeSatellite const* type,
                        IActivator &activator);
 
+    /**
+     * Get the position of a satellite in the ActiveScene, relative to the
+     * area. While update_scan() is activating satellites, this reads the
+     * position calculated in its batch instead of recalculating it.
+     *
+     * @param sat [in] Satellite to get the position of
+     * @return Position in meters
+     */
+    Vector3 sat_scene_pos(universe::Satellite sat) const;
+
     constexpr universe::Universe& get_universe() { return m_universe; }
 
     using MapActivators
@@ -127,6 +148,25 @@ private:
     //std::vector<universe::Satellite> m_activatedSats;
     entt::sparse_set<universe::Satellite> m_activatedSats;
 
+    // Universe::get_frames_pass() and area position during the last scan
+    unsigned m_scanPass{0};
+    Vector3s m_scanAreaPos;
+
+    // Set to query the spatial index on the next scan
+    bool m_scanFull{true};
+
+    // Found by the last scan, kept to reuse memory
+    std::vector<universe::Satellite> m_scanEntering;
+    std::vector<ActiveEnt> m_scanLeaving;
+
+    // Satellites to check and their positions relative to the area, in
+    // meters. After the scan, m_scanPos holds positions of m_scanEntering
+    std::vector<universe::Satellite> m_scanCandidates;
+    std::vector<Vector3> m_scanPos;
+
+    // Index into m_scanEntering of the satellite being activated
+    std::size_t m_scanActivating{0};
+
     //UpdateOrderHandle_t m_updateFloatingOrigin;
     UpdateOrderHandle_t m_updateScan;
 
@@ -143,6 +183,10 @@ private:
     int sat_activate(universe::Satellite sat,
                      universe::UCompActivatable &satAct);
 
+    /**
+     * Deactivate a satellite, destroying its entity
+     * @return status, zero for no error
+     */
     int sat_deactivate(ActiveEnt ent,
                        ACompActivatedSat& entAct);
 };
@@ -177,11 +177,13 @@ void SysNewton::update_world(ActiveScene& rScene)
         auto &entBody      = viewBodyTransform.get<ACompNwtBody>(ent);
         auto &entTransform = viewBodyTransform.get<ACompTransform>(ent);
 
-        if (entBody.m_body)
+        // Bodies that are asleep didn't move
+        if (entBody.m_body && !NewtonBodyGetSleepState(entBody.m_body))
         {
             // Get new transform matrix from newton
             NewtonBodyGetMatrix(entBody.m_body,
                                 entTransform.m_transform.data());
+            rScene.hier_mark_dirty(ent);
         }
     }
 }
@@ -191,16 +193,12 @@ void SysNewton::find_colliders_recurse(ActiveScene& rScene, ActiveEnt ent,
                                        NewtonWorld const* nwtWorld,
                                        NewtonCollision *rCompound)
 {
-    ActiveEnt nextChild = ent;
-
-    // iterate through siblings of ent
-    while(nextChild != entt::null)
+    for (ActiveEnt child : rScene.hier_children(ent))
     {
-        auto const &childHeir = rScene.reg_get<ACompHierarchy>(nextChild);
-        auto const &childTransform = rScene.reg_get<ACompTransform>(nextChild);
+        auto const &childTransform = rScene.reg_get<ACompTransform>(child);
 
         auto* childCollide = rScene.get_registry()
-                                .try_get<ACompCollisionShape>(nextChild);
+                                .try_get<ACompCollisionShape>(child);
 
         Matrix4 childMatrix = transform * childTransform.m_transform;
 
@@ -233,9 +231,8 @@ void SysNewton::find_colliders_recurse(ActiveScene& rScene, ActiveEnt ent,
             //return;
         }
 
-        find_colliders_recurse(rScene, childHeir.m_childFirst, childMatrix,
-                               nwtWorld, rCompound);
-        nextChild = childHeir.m_siblingNext;
+        find_colliders_recurse(rScene, child, childMatrix, nwtWorld,
+                               rCompound);
     }
 }
 
@@ -243,7 +240,6 @@ void SysNewton::create_body(ActiveScene& rScene, ActiveEnt entity,
                             NewtonWorld const* nwtWorld)
 {
 
-    auto const& entHeir      = rScene.reg_get<ACompHierarchy>(entity);
     auto& entTransform = rScene.reg_get<ACompTransform>(entity);
 
     auto& entBody  = rScene.reg_get<ACompNwtBody>(entity);
@@ -266,8 +262,8 @@ void SysNewton::create_body(ActiveScene& rScene, ActiveEnt entity,
 
         //
         NewtonCompoundCollisionBeginAddRemove(rCompound);
-        find_colliders_recurse(rScene, entHeir.m_childFirst, Matrix4(),
-                               nwtWorld, rCompound);
+        find_colliders_recurse(rScene, entity, Matrix4(), nwtWorld,
+                               rCompound);
         NewtonCompoundCollisionEndAddRemove(rCompound);
 
         // TODO: deal with mass and stuff
@@ -354,27 +350,29 @@ ACompNwtWorld* SysNewton::try_get_physics_world(ActiveScene &rScene)
 std::pair<ActiveEnt, ACompNwtBody*> SysNewton::find_rigidbody_ancestor(
         ActiveScene& rScene, ActiveEnt ent)
 {
-    ActiveEnt prevEnt, currEnt = ent;
-    ACompHierarchy *currHeir = nullptr;
+    auto const *entHeir = rScene.get_registry().try_get<ACompHierarchy>(ent);
 
-    do
+    if (entHeir == nullptr || entHeir->m_level < gc_heir_physics_level)
     {
+        return {entt::null, nullptr};
+    }
 
-       currHeir = rScene.get_registry().try_get<ACompHierarchy>(currEnt);
-
-        if (!currHeir)
+    // Levels go down by one for each ancestor
+    ActiveEnt bodyEnt = ent;
+    unsigned level = entHeir->m_level;
+    for (ActiveEnt curr : rScene.hier_ancestors(ent))
+    {
+        if (level == gc_heir_physics_level)
         {
-            return {entt::null, nullptr};
+            break;
         }
-
-        prevEnt = currEnt;
-        currEnt = currHeir->m_parent;
+        bodyEnt = curr;
+        level --;
     }
-    while (currHeir->m_level != gc_heir_physics_level);
 
-    auto *body = rScene.get_registry().try_get<ACompNwtBody>(prevEnt);
+    auto *body = rScene.get_registry().try_get<ACompNwtBody>(bodyEnt);
 
-    return {prevEnt, body};
+    return {bodyEnt, body};
 
 }
 
@@ -148,8 +148,8 @@ private:
      * called first.
      *
      * @param rScene    [in] ActiveScene containing entity and physics world
-     * @param ent       [in] Entity containing colliders, and recurse into children
-     * @param transform [in] Total transform from Hierarchy
+     * @param ent       [in] Entity whose children to search, recursively
+     * @param transform [in] Total transform from Hierarchy down to ent
      * @param nwtWorld  [in] Newton world from scene
      * @param rCompound [out] Compound collision to add new colliders to
      */
@@ -86,8 +86,7 @@ StatusActivated SysVehicle::activate_sat(ActiveScene &scene,
     ACompVehicle& vehicleComp = scene.reg_emplace<ACompVehicle>(vehicleEnt);
 
     // Convert position of the satellite to position in scene
-    Vector3 positionInScene
-            = area.get_universe().sat_calc_pos_meters(areaSat, tgtSat);
+    Vector3 positionInScene = area.sat_scene_pos(tgtSat);
 
     ACompTransform& vehicleTransform = scene.get_registry()
                                         .emplace<ACompTransform>(vehicleEnt);
@@ -223,7 +222,13 @@ int SysVehicle::deactivate_sat(ActiveScene &scene, SysAreaAssociate &area,
         universe::Satellite areaSat, universe::Satellite tgtSat,
         ActiveEnt tgtEnt)
 {
+    // Write the vehicle's last position back to the universe, unless the
+    // satellite was removed from it
     area.sat_transform_update(tgtEnt);
+
+    // Parts are children of the vehicle entity, and are destroyed along with
+    // it. Their rigid bodies are cleaned up by SysNewton
+    scene.hier_destroy(tgtEnt);
     return 0;
 }
 
@@ -473,6 +478,7 @@ void SysVehicle::update_vehicle_modification(ActiveScene& rScene)
                             = m_scene.reg_get<ACompTransform>(partEnt);
 
                     partTransform.m_transform.translation() -= comOffset;
+                    m_scene.hier_mark_dirty(partEnt);
                 }
 
 //                ActiveEnt child = m_scene.reg_get<ACompHierarchy>(islandEnt)
@@ -490,10 +496,18 @@ void SysVehicle::update_vehicle_modification(ActiveScene& rScene)
 
                 islandTransform.m_transform.translation() += comOffset;
 
+                // Parts and islands were moved after their world transforms
+                // were calculated
+                m_scene.hier_mark_dirty(islandEnt);
+
                 //m_scene.dynamic_system_find<SysPhysics>().create_body(islandEnt);
             }
 
         }
     }
+
+    // Destroyed parts are only queued above. Destroy them now, so they
+    // aren't included when physics rebuilds the vehicles' colliders
+    m_scene.hier_destroy_flush();
 }
 
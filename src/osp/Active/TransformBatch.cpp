@@ -0,0 +1,213 @@
+/**
+ * Open Space Program
+ * Copyright © 2019-2020 Open Space Program Project
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "TransformBatch.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+    #define OSP_TRANSFORM_BATCH_SSE
+    #include <immintrin.h>
+#endif
+
+#if defined(OSP_TRANSFORM_BATCH_SSE) && (defined(__GNUC__) || defined(__clang__))
+    #define OSP_TRANSFORM_BATCH_FMA
+#endif
+
+using namespace osp::active;
+using namespace osp;
+
+namespace
+{
+
+/**
+ * Multiply two affine column-major 4x4 matrices with scalar math
+ */
+inline void affine_mul_scalar(float const* a, float const* b, float* out)
+{
+    for (int col = 0; col < 4; col ++)
+    {
+        float const b0 = b[col * 4 + 0];
+        float const b1 = b[col * 4 + 1];
+        float const b2 = b[col * 4 + 2];
+
+        for (int row = 0; row < 4; row ++)
+        {
+            out[col * 4 + row] = a[row] * b0 + a[4 + row] * b1
+                               + a[8 + row] * b2;
+        }
+    }
+
+    // b[15] is 1, add the translation of a
+    for (int row = 0; row < 4; row ++)
+    {
+        out[12 + row] += a[12 + row];
+    }
+}
+
+#ifdef OSP_TRANSFORM_BATCH_SSE
+
+/**
+ * Multiply two affine column-major 4x4 matrices, a column at a time. Each
+ * column of the result is a sum of the columns of a, scaled by b.
+ */
+inline void affine_mul_sse(float const* a, float const* b, float* out)
+{
+    __m128 const a0 = _mm_loadu_ps(a);
+    __m128 const a1 = _mm_loadu_ps(a + 4);
+    __m128 const a2 = _mm_loadu_ps(a + 8);
+    __m128 const a3 = _mm_loadu_ps(a + 12);
+
+    for (int col = 0; col < 4; col ++)
+    {
+        float const* bCol = b + col * 4;
+        __m128 r = _mm_mul_ps(a0, _mm_set1_ps(bCol[0]));
+        r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(bCol[1])));
+        r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(bCol[2])));
+        if (col == 3)
+        {
+            r = _mm_add_ps(r, a3);
+        }
+        _mm_storeu_ps(out + col * 4, r);
+    }
+}
+
+#endif
+
+#ifdef OSP_TRANSFORM_BATCH_FMA
+
+/**
+ * AVX and FMA version, two columns at a time. Each 128-bit lane holds one
+ * column, so the parent's columns are broadcast to both lanes, and each
+ * lane takes its scale from its own column of the local transform.
+ */
+__attribute__((target("avx,fma")))
+void batch_world_avx(uint32_t const* pParents, float const* pLocal,
+                     float* pWorld, std::size_t count)
+{
+    for (std::size_t i = 0; i < count; i ++)
+    {
+        float const* b = pLocal + i * 16;
+        float* out = pWorld + i * 16;
+
+        __m256 const b01 = _mm256_loadu_ps(b);
+        __m256 const b23 = _mm256_loadu_ps(b + 8);
+
+        if (pParents[i] == gc_batchNoParent)
+        {
+            _mm256_storeu_ps(out, b01);
+            _mm256_storeu_ps(out + 8, b23);
+            continue;
+        }
+
+        float const* a = pWorld + std::size_t(pParents[i]) * 16;
+        __m256 const a0 = _mm256_broadcast_ps(
+                reinterpret_cast<__m128 const*>(a));
+        __m256 const a1 = _mm256_broadcast_ps(
+                reinterpret_cast<__m128 const*>(a + 4));
+        __m256 const a2 = _mm256_broadcast_ps(
+                reinterpret_cast<__m128 const*>(a + 8));
+
+        // Columns 0 and 1
+        __m256 r01 = _mm256_mul_ps(a0, _mm256_permute_ps(b01, 0x00));
+        r01 = _mm256_fmadd_ps(a1, _mm256_permute_ps(b01, 0x55), r01);
+        r01 = _mm256_fmadd_ps(a2, _mm256_permute_ps(b01, 0xAA), r01);
+
+        // Columns 2 and 3, with the parent's translation added to column 3
+        __m256 const a3 = _mm256_insertf128_ps(
+                _mm256_setzero_ps(), _mm_loadu_ps(a + 12), 1);
+        __m256 r23 = _mm256_fmadd_ps(a0, _mm256_permute_ps(b23, 0x00), a3);
+        r23 = _mm256_fmadd_ps(a1, _mm256_permute_ps(b23, 0x55), r23);
+        r23 = _mm256_fmadd_ps(a2, _mm256_permute_ps(b23, 0xAA), r23);
+
+        _mm256_storeu_ps(out, r01);
+        _mm256_storeu_ps(out + 8, r23);
+    }
+}
+
+#endif
+
+}
+
+void osp::active::transform_batch_world(
+        uint32_t const* pParents, Matrix4 const* pLocal, Matrix4* pWorld,
+        std::size_t count)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    float const* local = pLocal->data();
+    float* world = pWorld->data();
+
+#ifdef OSP_TRANSFORM_BATCH_FMA
+    static bool const s_hasAvx = __builtin_cpu_supports("avx")
+                              && __builtin_cpu_supports("fma");
+    if (s_hasAvx)
+    {
+        batch_world_avx(pParents, local, world, count);
+        return;
+    }
+#endif
+
+    for (std::size_t i = 0; i < count; i ++)
+    {
+        if (pParents[i] == gc_batchNoParent)
+        {
+            pWorld[i] = pLocal[i];
+            continue;
+        }
+
+        float const* a = world + std::size_t(pParents[i]) * 16;
+#ifdef OSP_TRANSFORM_BATCH_SSE
+        affine_mul_sse(a, local + i * 16, world + i * 16);
+#else
+        affine_mul_scalar(a, local + i * 16, world + i * 16);
+#endif
+    }
+}
+
+void osp::active::transform_batch_world_scalar(
+        uint32_t const* pParents, Matrix4 const* pLocal, Matrix4* pWorld,
+        std::size_t count)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    float const* local = pLocal->data();
+    float* world = pWorld->data();
+
+    for (std::size_t i = 0; i < count; i ++)
+    {
+        if (pParents[i] == gc_batchNoParent)
+        {
+            pWorld[i] = pLocal[i];
+            continue;
+        }
+
+        affine_mul_scalar(world + std::size_t(pParents[i]) * 16,
+                          local + i * 16, world + i * 16);
+    }
+}
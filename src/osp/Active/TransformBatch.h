@@ -0,0 +1,66 @@
+/**
+ * Open Space Program
+ * Copyright © 2019-2020 Open Space Program Project
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+
+#include "../types.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace osp::active
+{
+
+// Parent index of transforms in a batch that have no parent
+constexpr uint32_t gc_batchNoParent = ~uint32_t(0);
+
+/**
+ * Calculate world transforms of a batch of transforms, ordered so parents
+ * come before their children:
+ *
+ *     pWorld[i] = pWorld[pParents[i]] * pLocal[i]
+ *
+ * or pLocal[i] if pParents[i] is gc_batchNoParent.
+ *
+ * Transforms must be affine, with a bottom row of (0, 0, 0, 1), as is true
+ * for any mix of translations, rotations and scales. This skips a quarter of
+ * the math of a full Matrix4 multiply. Uses SSE on x86, and AVX with FMA on
+ * CPUs that support it when built with GCC or Clang; scalar code elsewhere.
+ *
+ * @param pParents [in] Index of each transform's parent, less than its own
+ * @param pLocal   [in] Transforms relative to the parent
+ * @param pWorld   [out] World transforms, must not overlap pLocal
+ * @param count    [in] Number of transforms
+ */
+void transform_batch_world(uint32_t const* pParents, Matrix4 const* pLocal,
+                           Matrix4* pWorld, std::size_t count);
+
+/**
+ * Scalar version of transform_batch_world(), for comparison
+ */
+void transform_batch_world_scalar(uint32_t const* pParents,
+                                  Matrix4 const* pLocal, Matrix4* pWorld,
+                                  std::size_t count);
+
+}
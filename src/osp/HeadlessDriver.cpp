@@ -0,0 +1,90 @@
+/**
+ * Open Space Program
+ * Copyright © 2019-2020 Open Space Program Project
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "HeadlessDriver.h"
+
+#include "OSPApplication.h"
+#include "UniverseReplication.h"
+#include "Active/ActiveScene.h"
+
+#include <chrono>
+
+using osp::HeadlessDriver;
+
+HeadlessDriver::HeadlessDriver(OSPApplication& rApp, double tickLength)
+ : m_app(rApp)
+ , m_tickLength(tickLength)
+{ }
+
+void HeadlessDriver::scene_add(active::ActiveScene& rScene)
+{
+    m_scenes.push_back(&rScene);
+}
+
+void HeadlessDriver::replication_add(universe::ReplicationEncoder& rEncoder)
+{
+    m_encoders.push_back(&rEncoder);
+}
+
+void HeadlessDriver::tick()
+{
+    universe::Universe &rUni = m_app.get_universe();
+    rUni.update(rUni.get_time() + m_tickLength, m_app.get_workers());
+
+    for (active::ActiveScene *pScene : m_scenes)
+    {
+        pScene->update();
+        pScene->update_hierarchy_transforms();
+    }
+
+    rUni.state_publish();
+
+    for (universe::ReplicationEncoder *pEncoder : m_encoders)
+    {
+        pEncoder->encode();
+    }
+}
+
+HeadlessDriver::Stats HeadlessDriver::run(uint64_t ticks)
+{
+    using Clock_t = std::chrono::steady_clock;
+
+    universe::Universe const &uni = m_app.get_universe();
+    double const timeStart = uni.get_time();
+
+    Clock_t::time_point const start = Clock_t::now();
+
+    for (uint64_t i = 0; i < ticks; i ++)
+    {
+        tick();
+    }
+
+    Clock_t::time_point const end = Clock_t::now();
+
+    Stats stats;
+    stats.m_ticks = ticks;
+    stats.m_seconds = std::chrono::duration<double>(end - start).count();
+    stats.m_simSeconds = uni.get_time() - timeStart;
+    return stats;
+}
@@ -0,0 +1,114 @@
+/**
+ * Open Space Program
+ * Copyright © 2019-2020 Open Space Program Project
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace osp
+{
+
+class OSPApplication;
+
+namespace active { class ActiveScene; }
+namespace universe { class ReplicationEncoder; }
+
+/**
+ * Advances the universe, and optionally some ActiveScenes, at a fixed tick
+ * length without a window or rendering.
+ *
+ * A tick is the same as a frame of OSPMagnum::drawEvent minus the drawing:
+ * Universe::update, then ActiveScene::update and
+ * ActiveScene::update_hierarchy_transforms for each scene, then
+ * Universe::state_publish, then ReplicationEncoder::encode for each encoder.
+ */
+class HeadlessDriver
+{
+public:
+
+    struct Stats
+    {
+        // Ticks run
+        uint64_t m_ticks{0};
+
+        // Wall clock time spent, in seconds
+        double m_seconds{0.0};
+
+        // Universe time advanced, in seconds
+        double m_simSeconds{0.0};
+
+        double ticks_per_second() const noexcept
+        { return (m_seconds > 0.0) ? m_ticks / m_seconds : 0.0; }
+
+        // Simulated seconds per real second
+        double time_warp() const noexcept
+        { return (m_seconds > 0.0) ? m_simSeconds / m_seconds : 0.0; }
+    };
+
+    /**
+     * @param rApp [in] Application owning the universe and worker pool
+     * @param tickLength [in] Universe seconds per tick. Scenes always step by
+     *                        ActiveScene::get_time_delta_fixed()
+     */
+    explicit HeadlessDriver(OSPApplication& rApp,
+                            double tickLength = 1.0 / 60.0);
+
+    /**
+     * Step a scene along with the universe each tick. The scene must outlive
+     * the driver, and must not be drawn or updated by anything else while
+     * ticking.
+     */
+    void scene_add(active::ActiveScene& rScene);
+
+    /**
+     * Encode a replication frame each tick. The encoder must outlive the
+     * driver.
+     */
+    void replication_add(universe::ReplicationEncoder& rEncoder);
+
+    /**
+     * Advance everything by one tick
+     */
+    void tick();
+
+    /**
+     * Run a number of ticks back to back, as fast as possible
+     *
+     * @param ticks [in] Number of ticks to run
+     * @return Timings of the run
+     */
+    Stats run(uint64_t ticks);
+
+    constexpr double get_tick_length() const noexcept { return m_tickLength; }
+
+private:
+
+    OSPApplication &m_app;
+    std::vector<active::ActiveScene*> m_scenes;
+    std::vector<universe::ReplicationEncoder*> m_encoders;
+    double m_tickLength;
+};
+
+}
@@ -23,9 +23,17 @@
  * SOFTWARE.
  */
 #include "OSPApplication.h"
+#include "Trajectories/Ephemeris.h"
 
 using namespace osp;
 
+OSPApplication::OSPApplication()
+ : m_pEphemerisFitter(std::make_unique<universe::EphemerisFitter>())
+{ }
+
+// Defined here, where EphemerisFitter is complete
+OSPApplication::~OSPApplication() = default;
+
 void OSPApplication::debug_add_package(Package&& p)
 {
     auto const& [it, success] = m_packages.emplace(p.get_prefix(), std::move(p));
@@ -25,12 +25,15 @@
 #pragma once
 
 #include <map>
+#include <memory>
 #include "Universe.h"
+#include "WorkerPool.h"
 #include "Resource/Package.h"
 
 namespace osp
 {
 
+namespace universe { class EphemerisFitter; }
 
 class OSPApplication
 {
@@ -38,7 +41,8 @@ public:
 
     // put more stuff into here eventually
 
-    OSPApplication() = default;
+    OSPApplication();
+    ~OSPApplication();
 
     /**
      * Add a resource package to the application
@@ -62,9 +66,19 @@ public:
 
     universe::Universe& get_universe() { return m_universe; }
 
+    WorkerPool& get_workers() { return m_workers; }
+
+    universe::EphemerisFitter& get_ephemeris_fitter()
+    { return *m_pEphemerisFitter; }
+
 private:
     std::map<ResPrefix_t, Package, std::less<>> m_packages;
+
+    // Declared before the universe, so it outlives the trajectories using it
+    std::unique_ptr<universe::EphemerisFitter> m_pEphemerisFitter;
+
     universe::Universe m_universe;
+    WorkerPool m_workers;
 };
 
 }
@@ -0,0 +1,457 @@
+/**
+ * Open Space Program
+ * Copyright © 2019-2020 Open Space Program Project
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "SatConjunctions.h"
+
+#include <algorithm>
+
+using namespace osp::universe;
+using namespace osp;
+
+void SatConjunctions::insert(Satellite sat, Vector3s const& pos,
+                             SpaceInt radius)
+{
+    std::size_t const index = sat_index(sat);
+
+    if (index >= m_items.size())
+    {
+        m_items.resize(index + 1);
+        m_bounds.resize(index + 1);
+        m_pairCounts.resize(index + 1);
+    }
+
+    if (m_items[index].m_sat == sat)
+    {
+        Item &rItem = m_items[index];
+        rItem.m_pos = pos;
+        rItem.m_radius = radius;
+        rItem.m_moved = true;
+        return;
+    }
+
+    if (m_items[index].m_sat != entt::null)
+    {
+        // Index was recycled without removing the old satellite
+        remove(m_items[index].m_sat);
+    }
+
+    Item &rItem = m_items[index];
+    rItem.m_sat = sat;
+    rItem.m_pos = pos;
+    rItem.m_posPrev = pos;
+    rItem.m_radius = radius;
+
+    m_adding.push_back(Index_t(index));
+    m_size ++;
+}
+
+void SatConjunctions::remove(Satellite sat)
+{
+    std::size_t const index = sat_index(sat);
+
+    if (!contains(sat))
+    {
+        return;
+    }
+
+    Item &rItem = m_items[index];
+
+    if (m_pairCounts[index] != 0)
+    {
+        for (auto it = m_pairs.begin(); it != m_pairs.end(); )
+        {
+            Index_t const a = Index_t(it->first >> 32);
+            Index_t const b = Index_t(it->first & 0xFFFFFFFFu);
+
+            if (a != index && b != index)
+            {
+                ++it;
+                continue;
+            }
+
+            if (it->second.m_close)
+            {
+                m_eventsRemoved.push_back({m_items[a].m_sat,
+                                           m_items[b].m_sat, false});
+            }
+
+            m_pairCounts[a] --;
+            m_pairCounts[b] --;
+            it = m_pairs.erase(it);
+        }
+    }
+
+    if (rItem.m_inAxes)
+    {
+        // Leave the endpoints for the next update to sweep out, so removing
+        // many satellites doesn't shift the lists every time
+        m_removedCount ++;
+    }
+    else
+    {
+        m_adding.erase(std::find(m_adding.begin(), m_adding.end(),
+                                 Index_t(index)));
+    }
+
+    rItem = Item{};
+    m_size --;
+}
+
+void SatConjunctions::clear()
+{
+    m_items.clear();
+    m_bounds.clear();
+    m_pairCounts.clear();
+    for (std::vector<Endpoint> &rList : m_axes)
+    {
+        rList.clear();
+    }
+    m_pairs.clear();
+    m_adding.clear();
+    m_removedCount = 0;
+    m_events.clear();
+    m_eventsRemoved.clear();
+    m_size = 0;
+}
+
+bool SatConjunctions::contains(Satellite sat) const
+{
+    std::size_t const index = sat_index(sat);
+    return index < m_items.size() && m_items[index].m_sat == sat;
+}
+
+bool SatConjunctions::is_close(Satellite a, Satellite b) const
+{
+    if (!contains(a) || !contains(b))
+    {
+        return false;
+    }
+
+    auto const found = m_pairs.find(pair_key(Index_t(sat_index(a)),
+                                             Index_t(sat_index(b))));
+    return found != m_pairs.end() && found->second.m_close;
+}
+
+void SatConjunctions::update(double time)
+{
+    m_events.swap(m_eventsRemoved);
+    m_eventsRemoved.clear();
+
+    double const timeDelta = time - m_timePrev;
+    m_timePrev = time;
+
+    if (m_removedCount != 0)
+    {
+        axes_compact();
+    }
+
+    // Recalculate swept boxes
+
+    for (std::size_t i = 0; i < m_items.size(); i ++)
+    {
+        Item &rItem = m_items[i];
+
+        if (rItem.m_sat == entt::null)
+        {
+            continue;
+        }
+
+        if (timeDelta > 0.0)
+        {
+            // Satellites not moved since the last update are standing still
+            rItem.m_velocity = rItem.m_moved
+                    ? Vector3d(rItem.m_pos - rItem.m_posPrev) / timeDelta
+                    : Vector3d{0.0};
+            rItem.m_posPrev = rItem.m_pos;
+            rItem.m_moved = false;
+        }
+
+        for (unsigned axis = 0; axis < 3; axis ++)
+        {
+            SpaceInt const start = rItem.m_pos[axis];
+            SpaceInt const end = start + static_cast<SpaceInt>(
+                    rItem.m_velocity[axis] * m_lookahead);
+
+            m_bounds[i][axis] = {std::min(start, end) - rItem.m_radius,
+                                 std::max(start, end) + rItem.m_radius};
+        }
+    }
+
+    // Add new items to the end of each list, sorting moves them into place
+    bool const rebuild = m_adding.size() > smc_insertMax;
+
+    for (Index_t const index : m_adding)
+    {
+        Item &rItem = m_items[index];
+
+        for (std::vector<Endpoint> &rList : m_axes)
+        {
+            rList.push_back({0, rItem.m_sat, false});
+            rList.push_back({0, rItem.m_sat, true});
+        }
+
+        rItem.m_inAxes = true;
+    }
+    m_adding.clear();
+
+    axes_refresh();
+
+    if (rebuild)
+    {
+        axes_rebuild();
+    }
+    else
+    {
+        for (unsigned axis = 0; axis < 3; axis ++)
+        {
+            axis_sort(axis);
+        }
+    }
+
+    // Check closest approach of overlapping pairs
+
+    for (auto &[key, rPair] : m_pairs)
+    {
+        Item const &a = m_items[key >> 32];
+        Item const &b = m_items[key & 0xFFFFFFFFu];
+
+        bool const close = approaches(a, b);
+
+        if (close != rPair.m_close)
+        {
+            rPair.m_close = close;
+            m_events.push_back({a.m_sat, b.m_sat, close});
+        }
+    }
+}
+
+bool SatConjunctions::overlaps(Index_t a, Index_t b) const noexcept
+{
+    Bounds_t const &boundsA = m_bounds[a];
+    Bounds_t const &boundsB = m_bounds[b];
+
+    for (unsigned axis = 0; axis < 3; axis ++)
+    {
+        if (boundsA[axis][1] < boundsB[axis][0]
+            || boundsB[axis][1] < boundsA[axis][0])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SatConjunctions::approaches(Item const& a, Item const& b) const noexcept
+{
+    // Relative motion is linear, so find the time of closest approach and
+    // limit it to the lookahead
+    Vector3d const pos = Vector3d(b.m_pos - a.m_pos);
+    Vector3d const vel = b.m_velocity - a.m_velocity;
+    double const speedSq = vel.dot();
+
+    double t = 0.0;
+    if (speedSq > 0.0)
+    {
+        t = std::clamp(-Magnum::Math::dot(pos, vel) / speedSq,
+                       0.0, m_lookahead);
+    }
+
+    double const reach = double(a.m_radius + b.m_radius);
+    return (pos + vel * t).dot() <= reach * reach;
+}
+
+void SatConjunctions::pair_add(Index_t a, Index_t b)
+{
+    if (m_pairs.try_emplace(pair_key(a, b)).second)
+    {
+        m_pairCounts[a] ++;
+        m_pairCounts[b] ++;
+    }
+}
+
+void SatConjunctions::pair_remove(Index_t a, Index_t b,
+                                  std::vector<ConjunctionEvent> &rEvents)
+{
+    auto const found = m_pairs.find(pair_key(a, b));
+
+    if (found == m_pairs.end())
+    {
+        return;
+    }
+
+    if (found->second.m_close)
+    {
+        rEvents.push_back({m_items[a].m_sat, m_items[b].m_sat, false});
+    }
+
+    m_pairCounts[a] --;
+    m_pairCounts[b] --;
+    m_pairs.erase(found);
+}
+
+void SatConjunctions::axis_sort(unsigned axis)
+{
+    std::vector<Endpoint> &rList = m_axes[axis];
+
+    for (std::size_t i = 1; i < rList.size(); i ++)
+    {
+        if (!endpoint_before(rList[i], rList[i - 1]))
+        {
+            continue; // already in place, the common case
+        }
+
+        Endpoint const moving = rList[i];
+        Index_t const movingIndex = Index_t(sat_index(moving.m_sat));
+        std::size_t j = i;
+
+        while (j > 0 && endpoint_before(moving, rList[j - 1]))
+        {
+            Endpoint const &passed = rList[j - 1];
+
+            if (moving.m_isMax != passed.m_isMax)
+            {
+                Index_t const passedIndex = Index_t(sat_index(passed.m_sat));
+
+                if (moving.m_isMax)
+                {
+                    // A max moved below a min, so they stopped overlapping.
+                    // Most items aren't in any pairs, skip looking them up
+                    if (m_pairCounts[movingIndex] != 0
+                        && m_pairCounts[passedIndex] != 0)
+                    {
+                        pair_remove(movingIndex, passedIndex, m_events);
+                    }
+                }
+                else if (overlaps(movingIndex, passedIndex))
+                {
+                    // A min moved below a max, and this was the last axis
+                    // they didn't overlap on
+                    pair_add(movingIndex, passedIndex);
+                }
+            }
+
+            rList[j] = passed;
+            j --;
+        }
+
+        rList[j] = moving;
+    }
+}
+
+void SatConjunctions::axes_refresh()
+{
+    for (unsigned axis = 0; axis < 3; axis ++)
+    {
+        for (Endpoint &rEndpoint : m_axes[axis])
+        {
+            rEndpoint.m_value = m_bounds[sat_index(rEndpoint.m_sat)]
+                                        [axis][rEndpoint.m_isMax];
+        }
+    }
+}
+
+void SatConjunctions::axes_compact()
+{
+    // Endpoints of removed items are found by their satellite no longer
+    // being there. Satellites removed then added again are on m_adding and
+    // not in the lists yet, so their old endpoints are dropped too
+    auto const removed = [this] (Endpoint const& endpoint)
+    {
+        Item const &item = m_items[sat_index(endpoint.m_sat)];
+        return item.m_sat != endpoint.m_sat || !item.m_inAxes;
+    };
+
+    for (std::vector<Endpoint> &rList : m_axes)
+    {
+        rList.erase(std::remove_if(rList.begin(), rList.end(), removed),
+                    rList.end());
+    }
+
+    m_removedCount = 0;
+}
+
+void SatConjunctions::axes_rebuild()
+{
+    for (std::vector<Endpoint> &rList : m_axes)
+    {
+        std::sort(rList.begin(), rList.end(), &endpoint_before);
+    }
+
+    // Sweep along X, checking each box against the ones open where it starts.
+    // Pairs that still overlap keep their state
+
+    std::unordered_map<uint64_t, Pair> pairs;
+    pairs.reserve(m_pairs.size());
+
+    std::vector<Index_t> open;
+    std::vector<std::size_t> openSlot(m_items.size());
+
+    for (Endpoint const& endpoint : m_axes[0])
+    {
+        Index_t const index = Index_t(sat_index(endpoint.m_sat));
+
+        if (endpoint.m_isMax)
+        {
+            // Swap with the last open box to remove it
+            std::size_t const slot = openSlot[index];
+            open[slot] = open.back();
+            openSlot[open[slot]] = slot;
+            open.pop_back();
+            continue;
+        }
+
+        for (Index_t const other : open)
+        {
+            if (overlaps(index, other))
+            {
+                uint64_t const key = pair_key(index, other);
+                auto const found = m_pairs.find(key);
+                pairs.emplace(key, (found != m_pairs.end()) ? found->second
+                                                            : Pair{});
+            }
+        }
+
+        openSlot[index] = open.size();
+        open.push_back(index);
+    }
+
+    for (auto const &[key, pair] : m_pairs)
+    {
+        if (pair.m_close && pairs.count(key) == 0)
+        {
+            m_events.push_back({m_items[key >> 32].m_sat,
+                                m_items[key & 0xFFFFFFFFu].m_sat, false});
+        }
+    }
+
+    m_pairs.swap(pairs);
+
+    std::fill(m_pairCounts.begin(), m_pairCounts.end(), 0);
+
+    for (auto const &[key, pair] : m_pairs)
+    {
+        m_pairCounts[key >> 32] ++;
+        m_pairCounts[key & 0xFFFFFFFFu] ++;
+    }
+}
@@ -0,0 +1,283 @@
+/**
+ * Open Space Program
+ * Copyright © 2019-2020 Open Space Program Project
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+
+#include "types.h"
+#include "universetypes.h"
+
+#include <array>
+#include <unordered_map>
+#include <vector>
+
+namespace osp::universe
+{
+
+/**
+ * Pair of satellites that started or stopped being in conjunction
+ */
+struct ConjunctionEvent
+{
+    Satellite m_a;
+    Satellite m_b;
+    bool m_enter; // true if they came close, false if they parted
+};
+
+/**
+ * Finds pairs of satellites that are, or will soon be, within reach of each
+ * other, using sweep and prune.
+ *
+ * Satellites are spheres. Each gets a box around the path its sphere sweeps
+ * over the lookahead time, moving at the velocity seen between the last two
+ * updates. Box bounds are kept sorted along all three axes. Satellites barely
+ * move between updates, so the lists are nearly sorted and insertion sort
+ * fixes them up in close to linear time. A pair of boxes starts or stops
+ * overlapping exactly when two of their bounds swap, so overlapping pairs
+ * are tracked from the swaps alone.
+ *
+ * Overlapping pairs are then checked for their closest approach within the
+ * lookahead time. A pair is in conjunction if the spheres touch at that
+ * point, and events are emitted when that changes.
+ *
+ * All positions are in a single frame. The Universe's detector uses
+ * positions relative to the root.
+ */
+class SatConjunctions
+{
+public:
+
+    static constexpr double smc_lookaheadDefault = 2.0;
+
+    // Above this many satellites added at once, the lists are rebuilt
+    // instead of insertion sorted, as each new satellite may move far
+    static constexpr std::size_t smc_insertMax = 16;
+
+    /**
+     * Add a satellite, or move it if it's already added. Changes take effect
+     * on the next update().
+     *
+     * @param sat [in]
+     * @param pos [in] Position of the satellite's center
+     * @param radius [in] Bounding radius in SpaceInt units
+     */
+    void insert(Satellite sat, Vector3s const& pos, SpaceInt radius);
+
+    /**
+     * Remove a satellite. Exit events for its conjunctions are reported by
+     * the next update(). Does nothing if it isn't added.
+     */
+    void remove(Satellite sat);
+
+    void clear();
+
+    bool contains(Satellite sat) const;
+
+    constexpr std::size_t size() const noexcept { return m_size; }
+
+    /**
+     * Set how far ahead to look for conjunctions, in seconds. 0 only finds
+     * satellites that are touching now.
+     */
+    void set_lookahead(double seconds) noexcept { m_lookahead = seconds; }
+    constexpr double get_lookahead() const noexcept { return m_lookahead; }
+
+    /**
+     * Apply changes since the last update, and find conjunctions that
+     * started or ended
+     *
+     * @param time [in] Current time in seconds, for velocities
+     */
+    void update(double time);
+
+    /**
+     * @return Events found by the last update()
+     */
+    constexpr std::vector<ConjunctionEvent> const& get_events() const noexcept
+    { return m_events; }
+
+    /**
+     * @return true if two satellites are in conjunction as of the last
+     *         update()
+     */
+    bool is_close(Satellite a, Satellite b) const;
+
+    /**
+     * Call a function for each satellite in conjunction with a satellite.
+     * This visits every overlapping pair, so prefer get_events() for
+     * following changes.
+     *
+     * @param sat [in]
+     * @param func [in] Called as func(Satellite other)
+     */
+    template<typename FUNC_T>
+    void for_each_close(Satellite sat, FUNC_T&& func) const;
+
+    /**
+     * @return Number of pairs with overlapping boxes
+     */
+    std::size_t get_overlap_count() const noexcept { return m_pairs.size(); }
+
+private:
+
+    // sat_index of a satellite
+    using Index_t = uint32_t;
+
+    // Box around a swept sphere, [axis][0 = min, 1 = max]
+    using Bounds_t = std::array<std::array<SpaceInt, 2>, 3>;
+
+    struct Endpoint
+    {
+        SpaceInt m_value;
+        Satellite m_sat;
+        bool m_isMax;
+    };
+
+    struct Item
+    {
+        Vector3s m_pos;
+        Vector3s m_posPrev;
+        Vector3d m_velocity; // SpaceInt units per second
+        SpaceInt m_radius{0};
+
+        Satellite m_sat{entt::null};
+
+        bool m_moved{false};  // insert() was called since the last update
+        bool m_inAxes{false}; // Endpoints are in m_axes
+    };
+
+    // Overlap state of a pair, keyed by pair_key()
+    struct Pair
+    {
+        bool m_close{false};
+    };
+
+    static constexpr uint64_t pair_key(Index_t a, Index_t b) noexcept
+    {
+        return (a < b) ? (uint64_t(a) << 32) | b : (uint64_t(b) << 32) | a;
+    }
+
+    /**
+     * Order of endpoints along an axis. At equal values, mins come before
+     * maxes, so a box never closes before it opens, and touching boxes are
+     * open together like overlaps() expects
+     */
+    static constexpr bool endpoint_before(Endpoint const& lhs,
+                                          Endpoint const& rhs) noexcept
+    {
+        return (lhs.m_value != rhs.m_value) ? lhs.m_value < rhs.m_value
+                                            : !lhs.m_isMax && rhs.m_isMax;
+    }
+
+    bool overlaps(Index_t a, Index_t b) const noexcept;
+
+    /**
+     * @return true if two items come within reach in the lookahead time
+     */
+    bool approaches(Item const& a, Item const& b) const noexcept;
+
+    void pair_add(Index_t a, Index_t b);
+
+    /**
+     * Remove a pair if it exists, emitting an exit event if it was close
+     */
+    void pair_remove(Index_t a, Index_t b,
+                     std::vector<ConjunctionEvent> &rEvents);
+
+    /**
+     * Insertion sort an axis, adding and removing overlapping pairs for
+     * bounds that swap
+     */
+    void axis_sort(unsigned axis);
+
+    /**
+     * Drop endpoints of removed items from the axis lists
+     */
+    void axes_compact();
+
+    /**
+     * Copy bounds into the axis lists, which are then sorted by them
+     */
+    void axes_refresh();
+
+    /**
+     * Sort the axis lists from scratch and find overlapping pairs with a
+     * sweep, for when too many items are added to insert one by one
+     */
+    void axes_rebuild();
+
+    // Indexed by sat_index
+    std::vector<Item> m_items;
+    std::vector<Bounds_t> m_bounds;
+
+    // Number of pairs in m_pairs each item is part of. Separate from Item,
+    // as sorting checks these for every bound that passes another
+    std::vector<uint32_t> m_pairCounts;
+
+    std::array<std::vector<Endpoint>, 3> m_axes;
+    std::unordered_map<uint64_t, Pair> m_pairs;
+
+    // Items to add to m_axes on the next update
+    std::vector<Index_t> m_adding;
+
+    // Items removed from m_axes since the last update, so their endpoints
+    // need to be swept out
+    std::size_t m_removedCount{0};
+
+    std::vector<ConjunctionEvent> m_events;
+
+    // Exit events from remove(), reported by the next update
+    std::vector<ConjunctionEvent> m_eventsRemoved;
+
+    double m_lookahead{smc_lookaheadDefault};
+    double m_timePrev{0.0};
+    std::size_t m_size{0};
+};
+
+template<typename FUNC_T>
+void SatConjunctions::for_each_close(Satellite sat, FUNC_T&& func) const
+{
+    Index_t const index = Index_t(sat_index(sat));
+
+    for (auto const &[key, pair] : m_pairs)
+    {
+        if (!pair.m_close)
+        {
+            continue;
+        }
+
+        Index_t const a = Index_t(key >> 32);
+        Index_t const b = Index_t(key & 0xFFFFFFFFu);
+
+        if (a == index)
+        {
+            func(m_items[b].m_sat);
+        }
+        else if (b == index)
+        {
+            func(m_items[a].m_sat);
+        }
+    }
+}
+
+}
@@ -0,0 +1,165 @@
+/**
+ * Open Space Program
+ * Copyright © 2019-2020 Open Space Program Project
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "SatSpatialIndex.h"
+
+using namespace osp::universe;
+using namespace osp;
+
+SatSpatialIndex::SatSpatialIndex(SpaceInt cellSize)
+{
+    for (unsigned level = 0; level < smc_levelCount; level ++)
+    {
+        m_cellSize[level] = cellSize << (level * smc_levelShift);
+    }
+}
+
+std::size_t SatSpatialIndex::CellKeyHash::operator()(
+        CellKey const& key) const noexcept
+{
+    // Multiply by large odd constants and mix, good enough for grid cells
+    std::size_t hash = std::size_t(key.m_x) * 0x9E3779B97F4A7C15ull;
+    hash ^= std::size_t(key.m_y) * 0xC2B2AE3D27D4EB4Full + (hash << 6)
+                                                          + (hash >> 2);
+    hash ^= std::size_t(key.m_z) * 0x165667B19E3779F9ull + (hash << 6)
+                                                          + (hash >> 2);
+    return hash;
+}
+
+SatSpatialIndex::CellKey SatSpatialIndex::cell_of(
+        Vector3s const& pos, unsigned level) const
+{
+    SpaceInt const size = m_cellSize[level];
+    return {floor_div(pos.x(), size), floor_div(pos.y(), size),
+            floor_div(pos.z(), size)};
+}
+
+unsigned SatSpatialIndex::level_of(SpaceInt radius) const
+{
+    for (unsigned level = 0; level < smc_levelCount - 1; level ++)
+    {
+        if (radius <= m_cellSize[level])
+        {
+            return level;
+        }
+    }
+    return smc_levelCount - 1;
+}
+
+void SatSpatialIndex::insert(Satellite sat, Vector3s const& pos,
+                             SpaceInt radius)
+{
+    std::size_t const index = sat_index(sat);
+
+    if (index >= m_entries.size())
+    {
+        m_entries.resize(index + 1);
+    }
+
+    Entry &rEntry = m_entries[index];
+    unsigned const level = level_of(radius);
+    CellKey const cell = cell_of(pos, level);
+
+    if (rEntry.m_sat == sat)
+    {
+        if (rEntry.m_level == level && rEntry.m_cell == cell)
+        {
+            // Still in the same cell, just update in place
+            Item &rItem = (*rEntry.m_pCell)[rEntry.m_slot];
+            rItem.m_pos = pos;
+            rItem.m_radius = radius;
+            return;
+        }
+
+        entry_erase(rEntry);
+    }
+    else if (rEntry.m_sat != entt::null)
+    {
+        // Left behind by a destroyed satellite that had the same index
+        entry_erase(rEntry);
+    }
+    else
+    {
+        m_size ++;
+    }
+
+    Cell_t &rCell = m_levels[level][cell];
+
+    rEntry.m_pCell = &rCell;
+    rEntry.m_cell = cell;
+    rEntry.m_level = level;
+    rEntry.m_slot = rCell.size();
+    rEntry.m_sat = sat;
+
+    rCell.push_back({pos, radius, sat});
+}
+
+void SatSpatialIndex::remove(Satellite sat)
+{
+    if (!contains(sat))
+    {
+        return;
+    }
+
+    entry_erase(m_entries[sat_index(sat)]);
+    m_entries[sat_index(sat)].m_sat = entt::null;
+    m_size --;
+}
+
+void SatSpatialIndex::clear()
+{
+    for (Level_t &rLevel : m_levels)
+    {
+        rLevel.clear();
+    }
+    m_entries.clear();
+    m_size = 0;
+}
+
+bool SatSpatialIndex::contains(Satellite sat) const
+{
+    std::size_t const index = sat_index(sat);
+    return index < m_entries.size() && m_entries[index].m_sat == sat;
+}
+
+void SatSpatialIndex::entry_erase(Entry &rEntry)
+{
+    Cell_t &rCell = *rEntry.m_pCell;
+
+    if (rEntry.m_slot != rCell.size() - 1)
+    {
+        // Move the last item into the erased one's place
+        Item const &moved = rCell[rEntry.m_slot] = rCell.back();
+        m_entries[sat_index(moved.m_sat)].m_slot = rEntry.m_slot;
+    }
+
+    rCell.pop_back();
+
+    if (rCell.empty())
+    {
+        m_levels[rEntry.m_level].erase(rEntry.m_cell);
+    }
+
+    rEntry.m_pCell = nullptr;
+}
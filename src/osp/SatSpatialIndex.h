@@ -0,0 +1,321 @@
+/**
+ * Open Space Program
+ * Copyright © 2019-2020 Open Space Program Project
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+
+#include "types.h"
+#include "universetypes.h"
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+namespace osp::universe
+{
+
+/**
+ * Hashed grid over satellite positions, used to find satellites near a point
+ * or inside a box without visiting every satellite.
+ *
+ * Satellites are treated as spheres. Each is stored in the cell containing
+ * its center, on the first level with cells at least as large as its radius,
+ * so a query only has to look one cell further out. Cells of each level are
+ * 8 times larger than the previous level's, so planets don't need to be
+ * tracked by the same small cells as vehicles.
+ *
+ * All positions are in a single frame. The Universe's index uses positions
+ * relative to the root.
+ */
+class SatSpatialIndex
+{
+public:
+
+    // 4km in SpaceInt units
+    static constexpr SpaceInt smc_cellSizeDefault = 4096 * 1024;
+
+    static constexpr unsigned smc_levelCount = 8;
+
+    // Cells grow by 2^smc_levelShift every level
+    static constexpr unsigned smc_levelShift = 3;
+
+    /**
+     * @param cellSize [in] Size of the smallest cells, in SpaceInt units
+     */
+    explicit SatSpatialIndex(SpaceInt cellSize = smc_cellSizeDefault);
+
+    /**
+     * Add a satellite to the index, or move it if it's already added
+     *
+     * @param sat [in]
+     * @param pos [in] Position of the satellite's center
+     * @param radius [in] Bounding radius in SpaceInt units
+     */
+    void insert(Satellite sat, Vector3s const& pos, SpaceInt radius = 0);
+
+    /**
+     * Remove a satellite from the index. Does nothing if it isn't in it.
+     */
+    void remove(Satellite sat);
+
+    void clear();
+
+    bool contains(Satellite sat) const;
+
+    constexpr std::size_t size() const noexcept { return m_size; }
+
+    /**
+     * Call a function for each satellite with a bounding sphere that overlaps
+     * a box
+     *
+     * @param min [in] Minimum corner of box
+     * @param max [in] Maximum corner of box
+     * @param func [in] Called as func(Satellite, Vector3s const& pos,
+     *                  SpaceInt radius)
+     */
+    template<typename FUNC_T>
+    void query_aabb(Vector3s const& min, Vector3s const& max,
+                    FUNC_T&& func) const;
+
+    /**
+     * Call a function for each satellite with a bounding sphere that overlaps
+     * a sphere
+     *
+     * @param center [in] Center of sphere
+     * @param radius [in] Radius of sphere in SpaceInt units
+     * @param func [in] Called as func(Satellite, Vector3s const& pos,
+     *                  SpaceInt radius)
+     */
+    template<typename FUNC_T>
+    void query_radius(Vector3s const& center, SpaceInt radius,
+                      FUNC_T&& func) const;
+
+private:
+
+    struct CellKey
+    {
+        SpaceInt m_x, m_y, m_z;
+
+        constexpr bool operator==(CellKey const& rhs) const noexcept
+        {
+            return m_x == rhs.m_x && m_y == rhs.m_y && m_z == rhs.m_z;
+        }
+    };
+
+    struct CellKeyHash
+    {
+        std::size_t operator()(CellKey const& key) const noexcept;
+    };
+
+    struct Item
+    {
+        Vector3s m_pos;
+        SpaceInt m_radius;
+        Satellite m_sat;
+    };
+
+    using Cell_t = std::vector<Item>;
+    using Level_t = std::unordered_map<CellKey, Cell_t, CellKeyHash>;
+
+    // Where a satellite is stored, indexed by sat_index
+    struct Entry
+    {
+        // Elements of unordered_map don't move when it rehashes
+        Cell_t *m_pCell{nullptr};
+        CellKey m_cell;
+        unsigned m_level;
+        unsigned m_slot;
+        Satellite m_sat{entt::null};
+    };
+
+    static constexpr SpaceInt floor_div(SpaceInt num, SpaceInt den)
+    {
+        SpaceInt const quot = num / den;
+        return (quot * den != num && (num < 0) != (den < 0)) ? quot - 1 : quot;
+    }
+
+    /**
+     * Component-wise pos + offset and pos - offset, clamped to the range of
+     * SpaceInt instead of overflowing. Components of offset must not be
+     * negative.
+     */
+    static Vector3s add_saturate(Vector3s const& pos,
+                                 Vector3s const& offset)
+    {
+        constexpr SpaceInt c_max = std::numeric_limits<SpaceInt>::max();
+        return {pos.x() > c_max - offset.x() ? c_max : pos.x() + offset.x(),
+                pos.y() > c_max - offset.y() ? c_max : pos.y() + offset.y(),
+                pos.z() > c_max - offset.z() ? c_max : pos.z() + offset.z()};
+    }
+
+    static Vector3s sub_saturate(Vector3s const& pos,
+                                 Vector3s const& offset)
+    {
+        constexpr SpaceInt c_min = std::numeric_limits<SpaceInt>::min();
+        return {pos.x() < c_min + offset.x() ? c_min : pos.x() - offset.x(),
+                pos.y() < c_min + offset.y() ? c_min : pos.y() - offset.y(),
+                pos.z() < c_min + offset.z() ? c_min : pos.z() - offset.z()};
+    }
+
+    CellKey cell_of(Vector3s const& pos, unsigned level) const;
+
+    /**
+     * @return First level with cells large enough to store a radius
+     */
+    unsigned level_of(SpaceInt radius) const;
+
+    /**
+     * Remove an entry's item from its cell
+     */
+    void entry_erase(Entry &rEntry);
+
+    /**
+     * Call func(Item const&) for each item of a level that is stored in a
+     * cell that may overlap a box
+     */
+    template<typename FUNC_T>
+    void query_cells(unsigned level, Vector3s const& min, Vector3s const& max,
+                     FUNC_T&& func) const;
+
+    std::array<SpaceInt, smc_levelCount> m_cellSize;
+    std::array<Level_t, smc_levelCount> m_levels;
+    std::vector<Entry> m_entries;
+    std::size_t m_size{0};
+};
+
+template<typename FUNC_T>
+void SatSpatialIndex::query_cells(
+        unsigned level, Vector3s const& min, Vector3s const& max,
+        FUNC_T&& func) const
+{
+    Level_t const &cells = m_levels[level];
+
+    if (cells.empty())
+    {
+        return;
+    }
+
+    // Items can stick out of their cell by up to one cell size
+    Vector3s const margin{m_cellSize[level]};
+    CellKey const lo = cell_of(sub_saturate(min, margin), level);
+    CellKey const hi = cell_of(add_saturate(max, margin), level);
+
+    double const rangeCount = double(hi.m_x - lo.m_x + 1)
+                            * double(hi.m_y - lo.m_y + 1)
+                            * double(hi.m_z - lo.m_z + 1);
+
+    if (rangeCount > double(cells.size()))
+    {
+        // Fewer cells are occupied than in range, check all of them instead
+        for (auto const &[key, cell] : cells)
+        {
+            if (key.m_x < lo.m_x || key.m_x > hi.m_x
+                || key.m_y < lo.m_y || key.m_y > hi.m_y
+                || key.m_z < lo.m_z || key.m_z > hi.m_z)
+            {
+                continue;
+            }
+
+            for (Item const &item : cell)
+            {
+                func(item);
+            }
+        }
+        return;
+    }
+
+    for (SpaceInt x = lo.m_x; x <= hi.m_x; x ++)
+    {
+        for (SpaceInt y = lo.m_y; y <= hi.m_y; y ++)
+        {
+            for (SpaceInt z = lo.m_z; z <= hi.m_z; z ++)
+            {
+                auto const found = cells.find(CellKey{x, y, z});
+
+                if (found == cells.end())
+                {
+                    continue;
+                }
+
+                for (Item const &item : found->second)
+                {
+                    func(item);
+                }
+            }
+        }
+    }
+}
+
+template<typename FUNC_T>
+void SatSpatialIndex::query_aabb(Vector3s const& min, Vector3s const& max,
+                                 FUNC_T&& func) const
+{
+    for (unsigned level = 0; level < smc_levelCount; level ++)
+    {
+        query_cells(level, min, max, [&min, &max, &func] (Item const& item)
+        {
+            // Distance from the box to the sphere's center. Doubles, as
+            // subtracting or squaring SpaceInts can overflow
+            Vector3d const pos(item.m_pos);
+            Vector3d const lo(min);
+            Vector3d const hi(max);
+            Vector3d const closest{
+                std::max(lo.x() - pos.x(), std::max(0.0, pos.x() - hi.x())),
+                std::max(lo.y() - pos.y(), std::max(0.0, pos.y() - hi.y())),
+                std::max(lo.z() - pos.z(), std::max(0.0, pos.z() - hi.z()))};
+            double const radius = double(item.m_radius);
+
+            if (closest.dot() <= radius * radius)
+            {
+                func(item.m_sat, item.m_pos, item.m_radius);
+            }
+        });
+    }
+}
+
+template<typename FUNC_T>
+void SatSpatialIndex::query_radius(Vector3s const& center, SpaceInt radius,
+                                   FUNC_T&& func) const
+{
+    Vector3s const extent{radius};
+
+    for (unsigned level = 0; level < smc_levelCount; level ++)
+    {
+        query_cells(level, sub_saturate(center, extent),
+                    add_saturate(center, extent),
+                    [&center, radius, &func] (Item const& item)
+        {
+            Vector3d const relative = Vector3d(item.m_pos) - Vector3d(center);
+            double const reach = double(radius) + double(item.m_radius);
+
+            if (relative.dot() <= reach * reach)
+            {
+                func(item.m_sat, item.m_pos, item.m_radius);
+            }
+        });
+    }
+}
+
+}
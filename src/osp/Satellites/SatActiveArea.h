@@ -59,6 +59,14 @@ struct UCompActiveArea
 
     // true when the ActiveArea is moving
     bool m_inMotion;
+
+    // Satellites are activated when they come within this many meters
+    float m_activateRadius{1000.0f};
+
+    // Activated satellites are deactivated when they are further than this
+    // many meters. Larger than m_activateRadius, so satellites near the edge
+    // don't get activated and deactivated every frame
+    float m_deactivateRadius{1200.0f};
 };
 
 
@@ -0,0 +1,70 @@
+/**
+ * Open Space Program
+ * Copyright © 2019-2020 Open Space Program Project
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "StringInterner.h"
+
+#include <algorithm>
+
+using osp::StringInterner;
+using osp::shared_string;
+
+shared_string StringInterner::intern(std::string_view str)
+{
+    if (auto found = m_strings.find(str); found != m_strings.end())
+    {
+        return create_shared_string(found->first, found->second);
+    }
+
+    if (m_strings.size() >= m_pruneAt)
+    {
+        // Pruning at double the live count keeps this amortized constant
+        prune();
+        m_pruneAt = std::max<std::size_t>(64, m_strings.size() * 2);
+    }
+
+    std::shared_ptr<char[]> newBuf(new char[str.size()]);
+    std::copy(str.begin(), str.end(), newBuf.get());
+
+    std::string_view const view{newBuf.get(), str.size()};
+    auto const it = m_strings.emplace(view, std::move(newBuf)).first;
+
+    return create_shared_string(it->first, it->second);
+}
+
+void StringInterner::prune()
+{
+    // Only the interner could copy a pointer it holds alone, so a count of 1
+    // can't go up while this runs
+    for (auto it = m_strings.begin(); it != m_strings.end(); )
+    {
+        if (it->second.use_count() == 1)
+        {
+            it = m_strings.erase(it);
+        }
+        else
+        {
+            ++ it;
+        }
+    }
+}
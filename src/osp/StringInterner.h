@@ -0,0 +1,75 @@
+/**
+ * Open Space Program
+ * Copyright © 2019-2020 Open Space Program Project
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+
+#include "shared_string.h"
+
+#include <map>
+#include <memory>
+#include <string_view>
+
+namespace osp
+{
+
+/**
+ * Deduplicates read-only strings. Interning a string equal to one that's
+ * still alive returns a shared_string sharing the same storage, so many
+ * copies of the same name only take a single allocation.
+ *
+ * Each string is stored once, and entries are keyed by views into it. Strings
+ * no longer used by any shared_string are freed when entries are pruned.
+ */
+class StringInterner
+{
+public:
+
+    /**
+     * @param str [in] String to intern
+     * @return shared_string equal to str
+     */
+    shared_string intern(std::string_view str);
+
+    /**
+     * @return Number of entries, including ones for strings no longer used
+     *         that haven't been pruned yet
+     */
+    std::size_t size() const noexcept { return m_strings.size(); }
+
+private:
+
+    /**
+     * Remove entries of strings only referenced by the interner, freeing them
+     */
+    void prune();
+
+    // Keys view into the storage of their values, so each entry must be
+    // erased before its storage is released
+    std::map<std::string_view, std::shared_ptr<const char[]>> m_strings;
+
+    // Prune when there are this many entries, see intern()
+    std::size_t m_pruneAt{64};
+};
+
+}
@@ -0,0 +1,630 @@
+/**
+ * Open Space Program
+ * Copyright © 2019-2020 Open Space Program Project
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "Ephemeris.h"
+#include "../UniverseSnapshot.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace osp::universe;
+using namespace osp;
+
+namespace
+{
+
+constexpr int c_coeffs = TrajEphemeris::smc_degree + 1;
+
+// Window length when nothing moves. Any length works, as long as it's finite
+constexpr double c_windowStill = 1.0e9;
+
+constexpr double c_pi = 3.14159265358979323846;
+
+// Layout of TrajEphemeris's snapshot data, followed by its satellites and
+// then their paths
+constexpr uint32_t c_snapshotVersion = 1;
+
+struct SnapEphemeris
+{
+    uint32_t m_version;
+    uint32_t m_pathSize; // sizeof(KeplerPath)
+    uint64_t m_count;
+    double m_timePrev;
+};
+
+/**
+ * Table of cos(pi * j * (k + 0.5) / n), used both to place the sample points
+ * (row j = 1) and to turn samples into coefficients
+ */
+struct ChebyshevTable
+{
+    ChebyshevTable()
+    {
+        for (int j = 0; j < c_coeffs; j ++)
+        {
+            for (int k = 0; k < c_coeffs; k ++)
+            {
+                m_cos[j][k] = std::cos(c_pi * j * (k + 0.5) / c_coeffs);
+            }
+        }
+    }
+
+    double m_cos[c_coeffs][c_coeffs];
+};
+
+ChebyshevTable const g_table;
+
+/**
+ * Evaluate a Chebyshev series at x in [-1, 1] with Clenshaw's recurrence
+ */
+inline double chebyshev_eval(double const* coeffs, double x)
+{
+    double b1 = 0.0;
+    double b2 = 0.0;
+    for (int j = c_coeffs - 1; j >= 1; j --)
+    {
+        double const b0 = 2.0 * x * b1 - b2 + coeffs[j];
+        b2 = b1;
+        b1 = b0;
+    }
+    return coeffs[0] + x * b1 - b2;
+}
+
+}
+
+// ---- EphemerisFitter ----
+
+EphemerisFitter::EphemerisFitter()
+{
+    m_worker = std::thread(&EphemerisFitter::worker_loop, this);
+}
+
+EphemerisFitter::~EphemerisFitter()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    m_worker.join();
+}
+
+void EphemerisFitter::request(TrajEphemeris* pTraj)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        // Queued even if it's being fitted right now, as it may have
+        // already checked for more requests
+        if (std::find(m_queue.begin(), m_queue.end(), pTraj) != m_queue.end())
+        {
+            return;
+        }
+        m_queue.push_back(pTraj);
+    }
+    m_wake.notify_one();
+}
+
+void EphemerisFitter::forget(TrajEphemeris* pTraj)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    m_idle.wait(lock, [this, pTraj] { return m_pBusy != pTraj; });
+    m_queue.erase(std::remove(m_queue.begin(), m_queue.end(), pTraj),
+                  m_queue.end());
+}
+
+void EphemerisFitter::worker_loop()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (true)
+    {
+        m_wake.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+
+        if (m_stop)
+        {
+            return;
+        }
+
+        TrajEphemeris *pTraj = m_queue.front();
+        m_queue.pop_front();
+        m_pBusy = pTraj;
+
+        lock.unlock();
+        bool const more = pTraj->fit_next();
+        lock.lock();
+
+        m_pBusy = nullptr;
+
+        // Go to the back of the queue, so other trajectories get a turn
+        if (more && std::find(m_queue.begin(), m_queue.end(), pTraj)
+                        == m_queue.end())
+        {
+            m_queue.push_back(pTraj);
+        }
+
+        m_idle.notify_all();
+    }
+}
+
+// ---- TrajEphemeris ----
+
+TrajEphemeris::TrajEphemeris(Universe& universe, Satellite center,
+                             EphemerisFitter& rFitter, double gravParam) :
+        CommonTrajectory<TrajEphemeris>(universe, center),
+        m_fitter(rFitter),
+        m_gravParam(gravParam),
+        m_timePrev(universe.get_time()),
+        m_pathsPublished(std::make_shared<Paths>())
+{ }
+
+TrajEphemeris::~TrajEphemeris()
+{
+    m_fitter.forget(this);
+}
+
+void TrajEphemeris::update()
+{
+    Universe &uni = get_universe();
+    double const time = uni.get_time();
+    std::vector<Satellite> &sats = get_satellites();
+    std::size_t const count = sats.size();
+
+    PathsPtr_t const pPaths = paths_publish();
+
+    if (count == 0)
+    {
+        m_timePrev = time;
+        return;
+    }
+
+    int64_t const key = window_key(*pPaths, time);
+    WindowPtr_t const pWindow = window_get(pPaths, key);
+
+    auto &reg = uni.get_reg();
+    auto view = reg.view<UCompTransformTraj>();
+    auto const to_units = [] (double meters) -> SpaceInt
+    {
+        double const units = meters * gc_units_per_meter;
+        return static_cast<SpaceInt>(units + std::copysign(0.5, units));
+    };
+
+    for (std::size_t i = 0; i < count; i ++)
+    {
+        // Only evaluate the velocity series if there's somewhere to put it
+        auto *pVel = reg.try_get<UCompVelocity>(sats[i]);
+
+        Vector3d pos;
+        Vector3d vel;
+        window_eval(*pWindow, i, time, &pos,
+                    (pVel != nullptr) ? &vel : nullptr);
+
+        view.get(sats[i]).m_position = Vector3s(to_units(pos.x()),
+                                                to_units(pos.y()),
+                                                to_units(pos.z()));
+
+        if (pVel != nullptr)
+        {
+            pVel->m_velocity = Vector3(vel);
+        }
+    }
+
+    uni.sat_mark_dirty({sats.data(), count});
+
+    // Expect the clock to keep moving at the same rate, and get the windows
+    // it will reach fitted before they're needed
+    double const step = time - m_timePrev;
+    bool requested = window_request(key + 1);
+    for (int i = 1; i <= smc_windowsAhead; i ++)
+    {
+        requested |= window_request(window_key(*pPaths, time + step * i));
+    }
+
+    {
+        // Drop windows far from the current time
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_windows.size() > smc_windowsMax)
+        {
+            int64_t const keep = smc_windowsMax / 2;
+            for (auto it = m_windows.begin(); it != m_windows.end(); )
+            {
+                if (std::abs(it->first - key) > keep)
+                {
+                    it = m_windows.erase(it);
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+        }
+    }
+
+    // Only wake the fitter for new requests, most updates stay in windows
+    // that were already asked for
+    if (requested)
+    {
+        m_fitter.request(this);
+    }
+    m_timePrev = time;
+}
+
+void TrajEphemeris::add(Satellite sat)
+{
+    Universe &uni = get_universe();
+    auto const &traj = uni.get_reg().get<UCompTrajectory>(sat);
+
+    if (traj.m_trajectory)
+    {
+        return; // already part of trajectory
+    }
+
+    Vector3d const r = Vector3d(uni.sat_calc_pos(get_center(), sat))
+                     / double(gc_units_per_meter);
+
+    Vector3d v{0.0, 0.0, 0.0};
+    if (auto const *pVel = uni.get_reg().try_get<UCompVelocity>(sat))
+    {
+        v = Vector3d(pVel->m_velocity);
+    }
+
+    CommonTrajectory<TrajEphemeris>::add(sat);
+    m_paths.push_back(KeplerPath::from_state(r, v, m_gravParam,
+                                             uni.get_time()));
+    m_pathsChanged = true;
+}
+
+void TrajEphemeris::add(Satellite sat, KeplerOrbit const& orbit)
+{
+    auto const &traj = get_universe().get_reg().get<UCompTrajectory>(sat);
+
+    if (traj.m_trajectory)
+    {
+        return; // already part of trajectory
+    }
+
+    CommonTrajectory<TrajEphemeris>::add(sat);
+    m_paths.push_back(KeplerPath::from_orbit(orbit, m_gravParam));
+    m_pathsChanged = true;
+}
+
+Vector3d TrajEphemeris::get_position(Satellite sat, double time)
+{
+    auto const &traj = get_universe().get_reg().get<UCompTrajectory>(sat);
+
+    if (traj.m_trajectory != this)
+    {
+        return {}; // not part of this trajectory
+    }
+
+    PathsPtr_t const pPaths = paths_publish();
+    WindowPtr_t const pWindow = window_get(pPaths,
+                                           window_key(*pPaths, time));
+    Vector3d pos;
+    window_eval(*pWindow, traj.m_index, time, &pos, nullptr);
+    return pos;
+}
+
+Vector3d TrajEphemeris::get_velocity(Satellite sat, double time)
+{
+    auto const &traj = get_universe().get_reg().get<UCompTrajectory>(sat);
+
+    if (traj.m_trajectory != this)
+    {
+        return {}; // not part of this trajectory
+    }
+
+    PathsPtr_t const pPaths = paths_publish();
+    WindowPtr_t const pWindow = window_get(pPaths,
+                                           window_key(*pPaths, time));
+    Vector3d vel;
+    window_eval(*pWindow, traj.m_index, time, nullptr, &vel);
+    return vel;
+}
+
+bool TrajEphemeris::predict_state(Satellite sat, double time,
+                                  Vector3d &rPos, Vector3d &rVel)
+{
+    auto const &traj = get_universe().get_reg().get<UCompTrajectory>(sat);
+
+    if (traj.m_trajectory != this)
+    {
+        return false; // not part of this trajectory
+    }
+
+    m_paths[traj.m_index].state_at(time, rPos, rVel);
+    return true;
+}
+
+void TrajEphemeris::snapshot_save(SnapshotWriter& rWriter)
+{
+    std::vector<Satellite> const &sats = get_satellites();
+
+    SnapEphemeris header{};
+    header.m_version = c_snapshotVersion;
+    header.m_pathSize = sizeof(KeplerPath);
+    header.m_count = sats.size();
+    header.m_timePrev = m_timePrev;
+
+    rWriter.chunk_write(&header, sizeof(header));
+    rWriter.chunk_write(sats.data(), sats.size() * sizeof(Satellite));
+    rWriter.chunk_write(m_paths.data(), m_paths.size() * sizeof(KeplerPath));
+}
+
+int TrajEphemeris::snapshot_load(
+        Corrade::Containers::ArrayView<const unsigned char> data)
+{
+    SnapEphemeris header;
+    if (!snapshot_read(data, &header, sizeof(header))
+        || header.m_version != c_snapshotVersion
+        || header.m_pathSize != sizeof(KeplerPath)
+        || header.m_count != get_satellites().size()
+        || data.size() != header.m_count * (sizeof(Satellite)
+                                            + sizeof(KeplerPath)))
+    {
+        return 1;
+    }
+
+    std::size_t const count = header.m_count;
+
+    std::vector<Satellite> sats(count);
+    snapshot_read(data, sats.data(), count * sizeof(Satellite));
+
+    if (!satellites_reorder({sats.data(), count}))
+    {
+        return 1;
+    }
+
+    snapshot_read(data, m_paths.data(), count * sizeof(KeplerPath));
+    m_pathsChanged = true;
+    m_timePrev = header.m_timePrev;
+
+    return 0;
+}
+
+double TrajEphemeris::get_window_length()
+{
+    PathsPtr_t const pPaths = paths_publish();
+    return pPaths->m_paths.empty() ? 0.0 : pPaths->m_windowLength;
+}
+
+void TrajEphemeris::data_reserve(std::size_t size)
+{
+    m_paths.reserve(size);
+}
+
+void TrajEphemeris::data_move(std::size_t from, std::size_t to)
+{
+    m_paths[to] = m_paths[from];
+    m_pathsChanged = true;
+}
+
+void TrajEphemeris::data_resize(std::size_t size)
+{
+    m_paths.resize(size);
+    m_pathsChanged = true;
+}
+
+TrajEphemeris::PathsPtr_t TrajEphemeris::paths_publish()
+{
+    if (!m_pathsChanged)
+    {
+        // Only this thread replaces the published paths, so no lock needed
+        return m_pathsPublished;
+    }
+
+    auto pPaths = std::make_shared<Paths>();
+    pPaths->m_paths = m_paths;
+
+    // Fit a fixed fraction of the fastest orbit into each window, so every
+    // window has about as much curve to fit
+    double meanMotionMax = 0.0;
+    for (KeplerPath const& path : m_paths)
+    {
+        meanMotionMax = std::max(meanMotionMax, path.m_meanMotion);
+    }
+    pPaths->m_windowLength = (meanMotionMax > 0.0)
+            ? 2.0 * c_pi / meanMotionMax / smc_windowsPerOrbit
+            : c_windowStill;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pathsPublished = pPaths;
+        m_windows.clear();
+        m_requests.clear();
+    }
+
+    m_pathsChanged = false;
+    return pPaths;
+}
+
+TrajEphemeris::WindowPtr_t TrajEphemeris::window_get(
+        PathsPtr_t const& pPaths, int64_t key)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto const found = m_windows.find(key);
+        if (found != m_windows.end())
+        {
+            return found->second;
+        }
+    }
+
+    // Not fitted yet, likely from a jump in time. Fit it here instead of
+    // waiting for the background thread
+    WindowPtr_t pWindow = window_fit(*pPaths, key);
+    m_fitsWaited ++;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (pPaths == m_pathsPublished)
+    {
+        m_windows.try_emplace(key, pWindow);
+    }
+    return pWindow;
+}
+
+bool TrajEphemeris::window_request(int64_t key)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_windows.count(key) != 0
+        || std::find(m_requests.begin(), m_requests.end(), key)
+                != m_requests.end())
+    {
+        return false; // already fitted or queued
+    }
+
+    m_requests.push_back(key);
+
+    // If the clock outruns the background thread, the oldest requests are
+    // already in the past
+    while (m_requests.size() > 2 * (smc_windowsAhead + 1))
+    {
+        m_requests.pop_front();
+    }
+
+    return true;
+}
+
+TrajEphemeris::WindowPtr_t TrajEphemeris::window_fit(Paths const& paths,
+                                                     int64_t key)
+{
+    std::size_t const count = paths.m_paths.size();
+    double const length = paths.m_windowLength;
+
+    auto pWindow = std::make_shared<Window>();
+    pWindow->m_timeStart = double(key) * length;
+    pWindow->m_timeScale = 2.0 / length;
+    pWindow->m_coeffs.resize(count * smc_stride);
+
+    double const timeMid = pWindow->m_timeStart + 0.5 * length;
+
+    Vector3d samples[c_coeffs];
+
+    for (std::size_t i = 0; i < count; i ++)
+    {
+        KeplerPath const &path = paths.m_paths[i];
+        double *pCoeffs = pWindow->m_coeffs.data() + i * smc_stride;
+
+        // Sample at the Chebyshev nodes, which are cos(pi * (k + 0.5) / n)
+        for (int k = 0; k < c_coeffs; k ++)
+        {
+            samples[k] = path.position_at(
+                    timeMid + 0.5 * length * g_table.m_cos[1][k]);
+        }
+
+        for (int axis = 0; axis < 3; axis ++)
+        {
+            double *pPos = pCoeffs + axis * c_coeffs;
+            double *pVel = pCoeffs + (3 + axis) * c_coeffs;
+
+            // Discrete cosine transform of the samples
+            for (int j = 0; j < c_coeffs; j ++)
+            {
+                double sum = 0.0;
+                for (int k = 0; k < c_coeffs; k ++)
+                {
+                    sum += samples[k][axis] * g_table.m_cos[j][k];
+                }
+                pPos[j] = sum * 2.0 / c_coeffs;
+            }
+            pPos[0] *= 0.5;
+
+            // Differentiate the series, then scale from d/dx to d/dt
+            pVel[c_coeffs - 1] = 0.0;
+            pVel[c_coeffs - 2] = 2.0 * (c_coeffs - 1) * pPos[c_coeffs - 1];
+            for (int j = c_coeffs - 2; j >= 1; j --)
+            {
+                pVel[j - 1] = pVel[j + 1] + 2.0 * j * pPos[j];
+            }
+            pVel[0] *= 0.5;
+
+            for (int j = 0; j < c_coeffs; j ++)
+            {
+                pVel[j] *= pWindow->m_timeScale;
+            }
+        }
+    }
+
+    return pWindow;
+}
+
+int64_t TrajEphemeris::window_key(Paths const& paths, double time)
+{
+    return static_cast<int64_t>(std::floor(time / paths.m_windowLength));
+}
+
+void TrajEphemeris::window_eval(Window const& window, std::size_t index,
+                                double time, Vector3d* pPos, Vector3d* pVel)
+{
+    double const *pCoeffs = window.m_coeffs.data() + index * smc_stride;
+    double const x = (time - window.m_timeStart) * window.m_timeScale - 1.0;
+
+    if (pPos != nullptr)
+    {
+        *pPos = {chebyshev_eval(pCoeffs, x),
+                 chebyshev_eval(pCoeffs + c_coeffs, x),
+                 chebyshev_eval(pCoeffs + 2 * c_coeffs, x)};
+    }
+
+    if (pVel != nullptr)
+    {
+        *pVel = {chebyshev_eval(pCoeffs + 3 * c_coeffs, x),
+                 chebyshev_eval(pCoeffs + 4 * c_coeffs, x),
+                 chebyshev_eval(pCoeffs + 5 * c_coeffs, x)};
+    }
+}
+
+bool TrajEphemeris::fit_next()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (!m_requests.empty())
+    {
+        int64_t const key = m_requests.front();
+        m_requests.pop_front();
+
+        PathsPtr_t const pPaths = m_pathsPublished;
+        if (m_windows.count(key) != 0 || pPaths->m_paths.empty())
+        {
+            continue;
+        }
+
+        lock.unlock();
+        WindowPtr_t pWindow = window_fit(*pPaths, key);
+        lock.lock();
+
+        // Paths may have changed while fitting, making this one useless
+        if (pPaths == m_pathsPublished)
+        {
+            m_windows.try_emplace(key, std::move(pWindow));
+        }
+
+        return !m_requests.empty();
+    }
+
+    return false;
+}
@@ -0,0 +1,306 @@
+/**
+ * Open Space Program
+ * Copyright © 2019-2020 Open Space Program Project
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+
+#include "Kepler.h"
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace osp::universe
+{
+
+class TrajEphemeris;
+
+/**
+ * A background thread that fits windows for every TrajEphemeris using it,
+ * so the number of threads doesn't grow with the number of ephemerides.
+ * Trajectories take turns, one window at a time.
+ *
+ * Must outlive the trajectories using it.
+ */
+class EphemerisFitter
+{
+    friend class TrajEphemeris;
+
+public:
+
+    EphemerisFitter();
+    ~EphemerisFitter();
+
+    EphemerisFitter(EphemerisFitter const& copy) = delete;
+    EphemerisFitter(EphemerisFitter&& move) = delete;
+
+private:
+
+    /**
+     * Queue a trajectory that has windows requested
+     */
+    void request(TrajEphemeris* pTraj);
+
+    /**
+     * Stop fitting for a trajectory, waiting if it's being fitted right now
+     */
+    void forget(TrajEphemeris* pTraj);
+
+    void worker_loop();
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake; // notifies the thread of requests
+    std::condition_variable m_idle; // notifies forget() of a finished fit
+
+    // Trajectories with requests, guarded by m_mutex
+    std::deque<TrajEphemeris*> m_queue;
+
+    // Trajectory being fitted, guarded by m_mutex
+    TrajEphemeris *m_pBusy{nullptr};
+
+    bool m_stop{false};
+
+    std::thread m_worker;
+};
+
+/**
+ * On-rails orbits for planets and moons, read from a cache of Chebyshev
+ * polynomials instead of being solved every time.
+ *
+ * Time is split into fixed windows. For each window, the paths of all
+ * satellites are sampled and fitted with a Chebyshev series per axis, along
+ * with the series' derivative for velocity. Any position or velocity in a
+ * cached window is then a short polynomial evaluation, no matter how far
+ * apart the queried times are, which suits time warp and predictions.
+ *
+ * Windows are fitted lazily. Each update asks an EphemerisFitter for the
+ * windows it expects the clock to reach next, and a window that isn't ready
+ * when needed is fitted on the spot. Windows far from the current time are
+ * dropped. Adding or removing satellites throws away the whole cache.
+ *
+ * Window length follows the fastest orbit, so it's a fixed fraction of its
+ * period. This suits a handful of bodies, not swarms; use TrajKepler for
+ * those.
+ */
+class TrajEphemeris : public CommonTrajectory<TrajEphemeris>
+{
+    friend class CommonTrajectory<TrajEphemeris>;
+    friend class EphemerisFitter;
+
+public:
+
+    // Degree of the Chebyshev series fitted to each axis
+    static constexpr int smc_degree = 12;
+
+    // Windows per period of the fastest orbit
+    static constexpr double smc_windowsPerOrbit = 32.0;
+
+    // Updates ahead to fit windows for in the background
+    static constexpr int smc_windowsAhead = 2;
+
+    // Most windows to keep cached
+    static constexpr std::size_t smc_windowsMax = 128;
+
+    /**
+     * @param universe [in]
+     * @param center [in] Satellite to orbit around
+     * @param rFitter [in] Background thread to fit windows on
+     * @param gravParam [in] Standard gravitational parameter of the center,
+     *                       GM in m^3/s^2
+     */
+    TrajEphemeris(Universe& universe, Satellite center,
+                  EphemerisFitter& rFitter, double gravParam);
+    ~TrajEphemeris();
+
+    TrajEphemeris(TrajEphemeris const& copy) = delete;
+    TrajEphemeris(TrajEphemeris&& move) = delete;
+
+    void update() override;
+
+    using CommonTrajectory<TrajEphemeris>::add;
+
+    /**
+     * Add a satellite, calculating its orbit from its current position and
+     * UCompVelocity (if it has one), same as TrajKepler
+     */
+    void add(Satellite sat) override;
+
+    /**
+     * Add a satellite with a known orbit
+     */
+    void add(Satellite sat, KeplerOrbit const& orbit);
+
+    /**
+     * @return Position of a satellite of this trajectory at any time,
+     *         relative to the center in meters
+     */
+    Vector3d get_position(Satellite sat, double time);
+
+    /**
+     * @return Velocity of a satellite of this trajectory at any time,
+     *         relative to the center in m/s
+     */
+    Vector3d get_velocity(Satellite sat, double time);
+
+    /**
+     * Solves the exact orbit rather than the fitted series, so predictions
+     * far ahead don't fill the window cache
+     */
+    bool predict_state(Satellite sat, double time,
+                       Vector3d &rPos, Vector3d &rVel) override;
+
+    /**
+     * Save orbits, same as TrajKepler. Windows are fitted again after loading
+     */
+    void snapshot_save(SnapshotWriter& rWriter) override;
+    int snapshot_load(
+            Corrade::Containers::ArrayView<const unsigned char> data) override;
+
+    constexpr double get_grav_param() const noexcept { return m_gravParam; }
+
+    /**
+     * @return Length of each window in seconds, or 0 if there are no orbits
+     */
+    double get_window_length();
+
+    /**
+     * @return Windows that weren't fitted in the background in time, and
+     *         were fitted on the spot instead
+     */
+    constexpr uint64_t get_fits_waited() const noexcept
+    { return m_fitsWaited; }
+
+private:
+
+    static constexpr int smc_coeffs = smc_degree + 1;
+
+    // Doubles per satellite in a window: position and velocity series for
+    // each axis. The velocity series is one shorter, but is padded
+    static constexpr std::size_t smc_stride = 6 * smc_coeffs;
+
+    /**
+     * Paths of every satellite, parallel to get_satellites() as of when it
+     * was published. Never modified once published, so the background
+     * thread can read it without locking.
+     */
+    struct Paths
+    {
+        std::vector<KeplerPath> m_paths;
+        double m_windowLength{0.0};
+    };
+
+    /**
+     * Fitted series of every satellite for one window of time
+     */
+    struct Window
+    {
+        double m_timeStart;
+        double m_timeScale; // Maps time to [-1, 1], 2 / window length
+        std::vector<double> m_coeffs; // smc_stride per satellite
+    };
+
+    using WindowPtr_t = std::shared_ptr<Window const>;
+    using PathsPtr_t = std::shared_ptr<Paths const>;
+
+    // Keep paths in sync with get_satellites(), see CommonTrajectory
+    void data_reserve(std::size_t size);
+    void data_move(std::size_t from, std::size_t to);
+    void data_resize(std::size_t size);
+
+    /**
+     * Make the current paths visible to window fitting if they changed,
+     * dropping every cached window
+     *
+     * @return Published paths
+     */
+    PathsPtr_t paths_publish();
+
+    /**
+     * Get a window from the cache, or fit it now if it's not there
+     *
+     * @param key [in] Index of the window, time divided by window length
+     */
+    WindowPtr_t window_get(PathsPtr_t const& pPaths, int64_t key);
+
+    /**
+     * Queue a window to be fitted in the background, if not already cached
+     *
+     * @return true if the window was queued
+     */
+    bool window_request(int64_t key);
+
+    /**
+     * Fit the next requested window, called by the EphemerisFitter
+     *
+     * @return true if there are more requests
+     */
+    bool fit_next();
+
+    /**
+     * Sample and fit the paths over a window
+     */
+    static WindowPtr_t window_fit(Paths const& paths, int64_t key);
+
+    /**
+     * @return Window containing a time
+     */
+    static int64_t window_key(Paths const& paths, double time);
+
+    /**
+     * Evaluate the fitted position and velocity of a satellite
+     *
+     * @param index [in] Index of the satellite in get_satellites()
+     */
+    static void window_eval(Window const& window, std::size_t index,
+                            double time, Vector3d* pPos, Vector3d* pVel);
+
+    EphemerisFitter &m_fitter;
+
+    double m_gravParam;
+
+    // Time of the last update, in seconds
+    double m_timePrev;
+
+    // Paths parallel to get_satellites(), only touched by the owning thread
+    std::vector<KeplerPath> m_paths;
+    bool m_pathsChanged{false};
+
+    // Paths the cache was fitted for, guarded by m_mutex
+    PathsPtr_t m_pathsPublished;
+
+    // Cached windows by key, guarded by m_mutex
+    std::unordered_map<int64_t, WindowPtr_t> m_windows;
+
+    // Windows for the background thread to fit, guarded by m_mutex
+    std::deque<int64_t> m_requests;
+
+    std::mutex m_mutex;
+
+    // Only touched by the owning thread
+    uint64_t m_fitsWaited{0};
+};
+
+}
@@ -0,0 +1,878 @@
+/**
+ * Open Space Program
+ * Copyright © 2019-2020 Open Space Program Project
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "Kepler.h"
+#include "../UniverseSnapshot.h"
+#include "../run_kernel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <limits>
+
+using namespace osp::universe;
+using namespace osp;
+
+namespace
+{
+
+// Newton iterations when solving from scratch, enough for e <= 0.95
+constexpr int c_iterationsFull = 8;
+
+// Newton iterations when solving relative to the previous update
+constexpr int c_iterationsStep = 2;
+
+// Largest change in mean anomaly (radians) that a relative step can solve
+constexpr double c_stepMax = 0.002;
+
+// All orbits are re-solved from scratch over this many updates, so rounding
+// errors from relative steps can't accumulate
+constexpr std::size_t c_resolveSlices = 64;
+
+// Layout of TrajKepler's snapshot data, followed by its satellites and then
+// each SoA array
+constexpr uint32_t c_snapshotVersion = 2;
+
+struct SnapKepler
+{
+    uint32_t m_version;
+    uint32_t m_arrays;
+    uint64_t m_count;
+    double m_timePrev;
+    double m_meanMotionMax;
+    uint64_t m_tierEnd[gc_updateTiers - 1];
+};
+
+// 2*pi split into two doubles for more accurate range reduction
+constexpr double c_tauHi = 6.28318530717958623200e+00;
+constexpr double c_tauLo = 2.44929359829470635445e-16;
+
+// Adding then subtracting this rounds a double to an integer, as long as its
+// magnitude is below 2^51. Unlike std::round, this vectorizes everywhere
+constexpr double c_roundMagic = 6755399441055744.0;
+
+/**
+ * Wrap an angle to [-pi, pi]
+ */
+inline double wrap_angle(double x)
+{
+    double const turns = (x * (1.0 / c_tauHi) + c_roundMagic) - c_roundMagic;
+    return (x - turns * c_tauHi) - turns * c_tauLo;
+}
+
+/**
+ * Sine and cosine, accurate to about 1e-15 for |x| < 4.5. Taylor series are
+ * evaluated for x/8, then doubled three times.
+ */
+inline void sin_cos(double x, double &rSin, double &rCos)
+{
+    double const h = x * 0.125;
+    double const h2 = h * h;
+
+    double s = h * (1.0 + h2 * (-1.0 / 6.0 + h2 * (1.0 / 120.0
+             + h2 * (-1.0 / 5040.0 + h2 * (1.0 / 362880.0
+             + h2 * (-1.0 / 39916800.0 + h2 * (1.0 / 6227020800.0)))))));
+    double c = 1.0 + h2 * (-1.0 / 2.0 + h2 * (1.0 / 24.0
+             + h2 * (-1.0 / 720.0 + h2 * (1.0 / 40320.0
+             + h2 * (-1.0 / 3628800.0 + h2 * (1.0 / 479001600.0
+             + h2 * (-1.0 / 87178291200.0)))))));
+
+    // Written out instead of a loop, so the caller's loop has no inner loops
+    double s2 = 2.0 * s * c;
+    double c2 = (c - s) * (c + s);
+    s = 2.0 * s2 * c2;
+    c = (c2 - s2) * (c2 + s2);
+    rSin = 2.0 * s * c;
+    rCos = (c - s) * (c + s);
+}
+
+/**
+ * Sine and cosine for small angles, accurate to about 1e-16 for |x| < 0.05
+ */
+inline void sin_cos_small(double x, double &rSin, double &rCos)
+{
+    double const x2 = x * x;
+    rSin = x * (1.0 + x2 * (-1.0 / 6.0 + x2 * (1.0 / 120.0
+         + x2 * (-1.0 / 5040.0))));
+    rCos = 1.0 + x2 * (-1.0 / 2.0 + x2 * (1.0 / 24.0 + x2 * (-1.0 / 720.0
+         + x2 * (1.0 / 40320.0))));
+}
+
+// The kernels below take every array as a separate __restrict parameter, as
+// compilers give up on vectorizing when there are too many possible aliases
+
+/**
+ * Solve Kepler's equation from scratch, and calculate positions
+ */
+void solve_full_kernel(
+        std::size_t count, double time,
+        double const* __restrict meanMotion,
+        double const* __restrict meanAnomalyEpoch,
+        double const* __restrict eccentricity,
+        double const* __restrict px, double const* __restrict py,
+        double const* __restrict pz, double const* __restrict qx,
+        double const* __restrict qy, double const* __restrict qz,
+        double* __restrict sinEOut, double* __restrict cosEOut,
+        double* __restrict xOut, double* __restrict yOut,
+        double* __restrict zOut)
+{
+    for (std::size_t i = 0; i < count; i ++)
+    {
+        double const e = eccentricity[i];
+        double const M = wrap_angle(meanAnomalyEpoch[i] + meanMotion[i] * time);
+
+        // Danby's starting guess. sign(M) is sign(sin(M)) in [-pi, pi]
+        double E = M + 0.85 * e * std::copysign(1.0, M);
+        double s = 0.0;
+        double c = 1.0;
+        double d = 0.0;
+
+        for (int j = 0; j < c_iterationsFull; j ++)
+        {
+            sin_cos(E, s, c);
+            d = (E - e * s - M) / (1.0 - e * c);
+            E -= d;
+        }
+
+        // Rotate sin and cos by the last correction, which is tiny by now
+        double const sinE = s - d * c - 0.5 * d * d * s;
+        double const cosE = c + d * s - 0.5 * d * d * c;
+
+        sinEOut[i] = sinE;
+        cosEOut[i] = cosE;
+        xOut[i] = px[i] * (cosE - e) + qx[i] * sinE;
+        yOut[i] = py[i] * (cosE - e) + qy[i] * sinE;
+        zOut[i] = pz[i] * (cosE - e) + qz[i] * sinE;
+    }
+}
+
+/**
+ * Step Kepler's equation forward from the previous solution, and calculate
+ * positions. Change in mean anomaly must be under c_stepMax
+ */
+void solve_step_kernel(
+        std::size_t count, double timeDelta,
+        double const* __restrict meanMotion,
+        double const* __restrict eccentricity,
+        double const* __restrict px, double const* __restrict py,
+        double const* __restrict pz, double const* __restrict qx,
+        double const* __restrict qy, double const* __restrict qz,
+        double* __restrict sinEInOut, double* __restrict cosEInOut,
+        double* __restrict xOut, double* __restrict yOut,
+        double* __restrict zOut)
+{
+    for (std::size_t i = 0; i < count; i ++)
+    {
+        double const e = eccentricity[i];
+        double const s0 = sinEInOut[i];
+        double const c0 = cosEInOut[i];
+        double const dM = meanMotion[i] * timeDelta;
+
+        // Solve for the change in eccentric anomaly dE, where
+        // dE - e * (sin(E0 + dE) - sin(E0)) = dM
+        double dE = dM / (1.0 - e * c0);
+        double sd = 0.0;
+        double cd = 1.0;
+
+        for (int j = 0; j < c_iterationsStep; j ++)
+        {
+            sin_cos_small(dE, sd, cd);
+            double const s = s0 * cd + c0 * sd;
+            double const c = c0 * cd - s0 * sd;
+            dE -= (dE - e * (s - s0) - dM) / (1.0 - e * c);
+        }
+
+        sin_cos_small(dE, sd, cd);
+        double const sinE = s0 * cd + c0 * sd;
+        double const cosE = c0 * cd - s0 * sd;
+
+        sinEInOut[i] = sinE;
+        cosEInOut[i] = cosE;
+        xOut[i] = px[i] * (cosE - e) + qx[i] * sinE;
+        yOut[i] = py[i] * (cosE - e) + qy[i] * sinE;
+        zOut[i] = pz[i] * (cosE - e) + qz[i] * sinE;
+    }
+}
+
+/**
+ * Convert meters to space units. Rounding is done by hand, as std::llround
+ * is an out-of-line call on most targets
+ */
+inline SpaceInt to_units(double meters)
+{
+    double const units = meters * gc_units_per_meter;
+    return static_cast<SpaceInt>(units + std::copysign(0.5, units));
+}
+
+}
+
+KeplerPath KeplerPath::from_orbit(KeplerOrbit const& orbit, double gravParam)
+{
+    double const cosLan = std::cos(orbit.m_longAscending);
+    double const sinLan = std::sin(orbit.m_longAscending);
+    double const cosArg = std::cos(orbit.m_argPeriapsis);
+    double const sinArg = std::sin(orbit.m_argPeriapsis);
+    double const cosInc = std::cos(orbit.m_inclination);
+    double const sinInc = std::sin(orbit.m_inclination);
+
+    // Perifocal basis in the center's frame
+    Vector3d const p{cosLan * cosArg - sinLan * sinArg * cosInc,
+                     sinLan * cosArg + cosLan * sinArg * cosInc,
+                     sinArg * sinInc};
+    Vector3d const q{-cosLan * sinArg - sinLan * cosArg * cosInc,
+                     -sinLan * sinArg + cosLan * cosArg * cosInc,
+                     cosArg * sinInc};
+
+    double const a = orbit.m_semiMajorAxis;
+    double const e = orbit.m_eccentricity;
+
+    KeplerPath path;
+    path.m_meanMotion = (a > 0.0) ? std::sqrt(gravParam / (a * a * a)) : 0.0;
+    path.m_meanAnomalyEpoch = orbit.m_meanAnomalyEpoch;
+    path.m_eccentricity = e;
+    path.m_periapsis = p * a;
+    path.m_ahead = q * (a * std::sqrt(1.0 - e * e));
+    return path;
+}
+
+KeplerPath KeplerPath::from_state(Vector3d position, Vector3d velocity,
+                                  double gravParam, double time)
+{
+    Vector3d const r = position;
+    Vector3d const v = velocity;
+    double const rLen = r.length();
+    double const mu = gravParam;
+
+    Vector3d const h = Magnum::Math::cross(r, v);
+    double const hLen = h.length();
+
+    if (rLen > 0.0 && hLen > 0.0)
+    {
+        // Calculate orbit from the state vectors
+        Vector3d const eVec = Magnum::Math::cross(v, h) / mu - r / rLen;
+        double const e = eVec.length();
+        double const a = 1.0 / (2.0 / rLen - v.dot() / mu);
+
+        if (e < 1.0 && a > 0.0)
+        {
+            Vector3d const p = (e > 1e-9) ? eVec / e : r / rLen;
+            Vector3d const q = Magnum::Math::cross(h / hLen, p);
+
+            double const trueAnomaly = std::atan2(Magnum::Math::dot(r, q),
+                                                  Magnum::Math::dot(r, p));
+            double const E = std::atan2(
+                    std::sqrt(1.0 - e * e) * std::sin(trueAnomaly),
+                    e + std::cos(trueAnomaly));
+            double const M = E - e * std::sin(E);
+            double const n = std::sqrt(mu / (a * a * a));
+
+            KeplerPath path;
+            path.m_meanMotion = n;
+            path.m_meanAnomalyEpoch = M - n * time;
+            path.m_eccentricity = e;
+            path.m_periapsis = p * a;
+            path.m_ahead = q * (a * std::sqrt(1.0 - e * e));
+            return path;
+        }
+    }
+
+    // Not on an elliptical orbit, use a circular orbit through the current
+    // position. Orbit around the Z axis, or the Y axis if r is along Z
+    Vector3d p{1.0, 0.0, 0.0};
+    if (rLen > 0.0)
+    {
+        p = r / rLen;
+    }
+
+    Vector3d normal{0.0, 0.0, 1.0};
+    if (std::abs(p.z()) > 0.999)
+    {
+        normal = {0.0, 1.0, 0.0};
+    }
+
+    Vector3d const q = Magnum::Math::cross(normal, p).normalized();
+    double const n = (rLen > 0.0) ? std::sqrt(mu / (rLen * rLen * rLen))
+                                  : 0.0;
+
+    KeplerPath path;
+    path.m_meanMotion = n;
+    path.m_meanAnomalyEpoch = -n * time;
+    path.m_eccentricity = 0.0;
+    path.m_periapsis = p * rLen;
+    path.m_ahead = q * rLen;
+    return path;
+}
+
+double KeplerPath::eccentric_anomaly(double time) const
+{
+    double const e = m_eccentricity;
+    double const M = std::remainder(m_meanAnomalyEpoch + m_meanMotion * time,
+                                    c_tauHi);
+
+    // Newton's method until it stops improving
+    double E = M + 0.85 * e * std::copysign(1.0, M);
+    for (int i = 0; i < 32; i ++)
+    {
+        double const d = (E - e * std::sin(E) - M) / (1.0 - e * std::cos(E));
+        E -= d;
+        if (std::abs(d) < 1e-15)
+        {
+            break;
+        }
+    }
+    return E;
+}
+
+Vector3d KeplerPath::position_at(double time) const
+{
+    double const E = eccentric_anomaly(time);
+    return m_periapsis * (std::cos(E) - m_eccentricity)
+         + m_ahead * std::sin(E);
+}
+
+void KeplerPath::state_at(double time, Vector3d &rPos, Vector3d &rVel) const
+{
+    double const E = eccentric_anomaly(time);
+    double const sinE = std::sin(E);
+    double const cosE = std::cos(E);
+
+    // dE/dt from differentiating Kepler's equation
+    double const rateE = m_meanMotion / (1.0 - m_eccentricity * cosE);
+
+    rPos = m_periapsis * (cosE - m_eccentricity) + m_ahead * sinE;
+    rVel = (m_ahead * cosE - m_periapsis * sinE) * rateE;
+}
+
+TrajKepler::TrajKepler(Universe& universe, Satellite center,
+                       double gravParam) :
+        CommonTrajectory<TrajKepler>(universe, center),
+        m_gravParam(gravParam),
+        m_timePrev(universe.get_time())
+{
+
+}
+
+void TrajKepler::update()
+{
+    Universe &uni = get_universe();
+    double const time = uni.get_time();
+    std::vector<Satellite> &sats = get_satellites();
+    std::size_t const count = sats.size();
+
+    if (count == 0)
+    {
+        m_timePrev = time;
+        return;
+    }
+
+    double const timeDelta = time - m_timePrev;
+
+    // Active areas relative to the center, for picking tiers
+    Vector3s const centerPos = uni.sat_calc_pos(uni.sat_root(), get_center());
+    m_focus.clear();
+    for (Vector3s const focus : uni.get_tier_focus())
+    {
+        m_focus.push_back(Vector3d(focus - centerPos)
+                          / double(gc_units_per_meter));
+    }
+
+    std::size_t const nearEnd = std::min(m_tierEnd[0], count);
+
+    // Ranges of satellites solved by this update, only these moved
+    std::array<std::pair<std::size_t, std::size_t>, gc_updateTiers> solved;
+    std::size_t solvedCount = 0;
+
+    if (std::abs(timeDelta) * m_meanMotionMax > c_stepMax)
+    {
+        // Large time step, likely from time warp. Extrapolating would be way
+        // off, so solve every tier
+        solve_full(0, count, time);
+        tiers_evaluate(0, count);
+        solved[solvedCount ++] = {0, count};
+    }
+    else
+    {
+        run_kernel([this, nearEnd, timeDelta] ()
+        {
+            solve_step_kernel(
+                    nearEnd, timeDelta, m_meanMotion.data(),
+                    m_eccentricity.data(),
+                    m_px.data(), m_py.data(), m_pz.data(),
+                    m_qx.data(), m_qy.data(), m_qz.data(),
+                    m_sinE.data(), m_cosE.data(),
+                    m_outX.data(), m_outY.data(), m_outZ.data());
+        });
+
+        // Re-solve a slice of orbits from scratch
+        std::size_t const sliceSize
+                = (nearEnd + c_resolveSlices - 1) / c_resolveSlices;
+
+        if (m_resolveNext >= nearEnd)
+        {
+            m_resolveNext = 0;
+        }
+
+        std::size_t const sliceEnd = std::min(nearEnd,
+                                              m_resolveNext + sliceSize);
+        solve_full(m_resolveNext, sliceEnd, time);
+        m_resolveNext = sliceEnd;
+
+        tiers_evaluate(0, nearEnd);
+        solved[solvedCount ++] = {0, nearEnd};
+
+        // Solve a slice of each further tier. The rest stay where they were
+
+        UpdateTierConfig const &config = uni.get_tier_config();
+        uint64_t const tick = uni.get_tick();
+        std::size_t tierFirst = nearEnd;
+
+        for (std::size_t tier = 1; tier < gc_updateTiers; tier ++)
+        {
+            std::size_t const tierLast = (tier < gc_updateTiers - 1)
+                    ? std::clamp(m_tierEnd[tier], tierFirst, count) : count;
+            std::size_t const period = std::max(1u, config.m_period[tier]);
+            std::size_t const slice = tick % period;
+            std::size_t const size = tierLast - tierFirst;
+
+            std::size_t const first = tierFirst + size * slice / period;
+            std::size_t const last = tierFirst + size * (slice + 1) / period;
+
+            solve_full(first, last, time);
+            tiers_evaluate(first, last);
+            solved[solvedCount ++] = {first, last};
+
+            tierFirst = tierLast;
+        }
+    }
+
+    m_timePrev = time;
+
+    // Write solved positions to the universe, before tiers_apply() shuffles
+    // the ranges
+    auto view = uni.get_reg().view<UCompTransformTraj>();
+
+    for (std::size_t r = 0; r < solvedCount; r ++)
+    {
+        auto const [first, last] = solved[r];
+
+        for (std::size_t i = first; i < last; i ++)
+        {
+            auto &posTraj = view.get(sats[i]);
+
+            posTraj.m_position = Vector3s(to_units(m_outX[i]),
+                                          to_units(m_outY[i]),
+                                          to_units(m_outZ[i]));
+        }
+
+        uni.sat_mark_dirty({sats.data() + first, last - first});
+    }
+
+    tiers_apply();
+}
+
+void TrajKepler::solve_full(std::size_t first, std::size_t last, double time)
+{
+    run_kernel([this, first, last, time] ()
+    {
+        solve_full_kernel(
+                last - first, time, m_meanMotion.data() + first,
+                m_meanAnomalyEpoch.data() + first,
+                m_eccentricity.data() + first,
+                m_px.data() + first, m_py.data() + first, m_pz.data() + first,
+                m_qx.data() + first, m_qy.data() + first, m_qz.data() + first,
+                m_sinE.data() + first, m_cosE.data() + first,
+                m_outX.data() + first, m_outY.data() + first,
+                m_outZ.data() + first);
+    });
+}
+
+unsigned TrajKepler::tier_of(std::size_t index) const
+{
+    for (unsigned tier = 0; tier < gc_updateTiers - 1; tier ++)
+    {
+        if (index < m_tierEnd[tier])
+        {
+            return tier;
+        }
+    }
+    return gc_updateTiers - 1;
+}
+
+void TrajKepler::tiers_evaluate(std::size_t first, std::size_t last)
+{
+    // Only read through a const registry, as this runs alongside other
+    // trajectories. The priority pool is created by the Universe beforehand
+    Universe const &uni = get_universe();
+    UpdateTierConfig const &config = uni.get_tier_config();
+    std::vector<Satellite> const &sats = get_satellites();
+
+    std::array<double, gc_updateTiers - 1> distanceSq;
+    for (std::size_t t = 0; t < distanceSq.size(); t ++)
+    {
+        distanceSq[t] = config.m_distance[t] * config.m_distance[t];
+    }
+
+    auto const viewPriority = uni.get_reg().view<const UCompUpdatePriority>();
+
+    for (std::size_t i = first; i < last; i ++)
+    {
+        double nearestSq = std::numeric_limits<double>::infinity();
+        for (Vector3d const& focus : m_focus)
+        {
+            double const dx = m_outX[i] - focus.x();
+            double const dy = m_outY[i] - focus.y();
+            double const dz = m_outZ[i] - focus.z();
+            nearestSq = std::min(nearestSq, dx * dx + dy * dy + dz * dz);
+        }
+
+        unsigned tier = 0;
+        while (tier < gc_updateTiers - 1 && nearestSq > distanceSq[tier])
+        {
+            tier ++;
+        }
+
+        if (tier != 0 && viewPriority.contains(sats[i]))
+        {
+            tier = std::min<unsigned>(tier,
+                                      viewPriority.get(sats[i]).m_tierMax);
+        }
+
+        if (tier != tier_of(i))
+        {
+            m_tierChanges.emplace_back(sats[i], tier);
+        }
+    }
+}
+
+void TrajKepler::tiers_apply()
+{
+    auto const view = get_universe().get_reg().view<const UCompTrajectory>();
+
+    for (auto const &[sat, tier] : m_tierChanges)
+    {
+        std::size_t const index = tier_move(view.get(sat).m_index, tier);
+
+        if (tier == 0)
+        {
+            // Tier 0 steps relative to the previous update, so start it
+            // from a fresh solution
+            solve_full(index, index + 1, m_timePrev);
+        }
+    }
+
+    m_tierChanges.clear();
+}
+
+std::size_t TrajKepler::tier_move(std::size_t index, unsigned tier)
+{
+    unsigned current = tier_of(index);
+
+    // Swap with the last satellite of each tier on the way up, or the first
+    // on the way down, then move the boundary past it
+    while (current < tier)
+    {
+        std::size_t const boundary = m_tierEnd[current] - 1;
+        data_swap(index, boundary);
+        index = boundary;
+        m_tierEnd[current] --;
+        current ++;
+    }
+
+    while (current > tier)
+    {
+        std::size_t const boundary = m_tierEnd[current - 1];
+        data_swap(index, boundary);
+        index = boundary;
+        m_tierEnd[current - 1] ++;
+        current --;
+    }
+
+    return index;
+}
+
+void TrajKepler::add(Satellite sat)
+{
+    Universe &uni = get_universe();
+    auto const &traj = uni.get_reg().get<UCompTrajectory>(sat);
+
+    if (traj.m_trajectory)
+    {
+        return; // already part of trajectory
+    }
+
+    Vector3s const posRelative = uni.sat_calc_pos(get_center(), sat);
+    Vector3d const r = Vector3d(posRelative) / double(gc_units_per_meter);
+
+    Vector3d v{0.0, 0.0, 0.0};
+    if (auto const *pVel = uni.get_reg().try_get<UCompVelocity>(sat))
+    {
+        v = Vector3d(pVel->m_velocity);
+    }
+
+    // Adding reparents to the center and marks the satellite dirty. Rebase
+    // its position too, as further tiers may not write it for a while
+    CommonTrajectory<TrajKepler>::add(sat);
+    uni.get_reg().get<UCompTransformTraj>(sat).m_position = posRelative;
+    orbit_push(KeplerPath::from_state(r, v, m_gravParam, uni.get_time()));
+}
+
+void TrajKepler::add(Satellite sat, KeplerOrbit const& orbit)
+{
+    auto const &traj = get_universe().get_reg().get<UCompTrajectory>(sat);
+
+    if (traj.m_trajectory)
+    {
+        return; // already part of trajectory
+    }
+
+    // Adding reparents to the center and marks the satellite dirty. Place it
+    // on its orbit right away, as further tiers may not write it for a while
+    CommonTrajectory<TrajKepler>::add(sat);
+    std::size_t const index = orbit_push(
+            KeplerPath::from_orbit(orbit, m_gravParam));
+
+    get_universe().get_reg().get<UCompTransformTraj>(sat).m_position
+            = Vector3s(to_units(m_outX[index]), to_units(m_outY[index]),
+                       to_units(m_outZ[index]));
+}
+
+void TrajKepler::remove(Satellite sat)
+{
+    auto const &traj = get_universe().get_reg().get<UCompTrajectory>(sat);
+
+    if (traj.m_trajectory != this)
+    {
+        return; // not part of this trajectory
+    }
+
+    // Removing swaps in the last satellite, which is in the last tier.
+    // Anything else would leave it in the wrong tier, and a satellite moved
+    // into tier 0 would step from a stale solution
+    tier_move(traj.m_index, gc_updateTiers - 1);
+    CommonTrajectory<TrajKepler>::remove(sat);
+}
+
+void TrajKepler::remove(Corrade::Containers::ArrayView<const Satellite> sats)
+{
+    auto const view = get_universe().get_reg().view<const UCompTrajectory>();
+
+    // Removing shifts down every satellite after the first one removed. With
+    // all of them in the last tier, nothing shifts across tiers
+    for (Satellite sat : sats)
+    {
+        auto const &traj = view.get(sat);
+
+        if (traj.m_trajectory == this)
+        {
+            tier_move(traj.m_index, gc_updateTiers - 1);
+        }
+    }
+
+    CommonTrajectory<TrajKepler>::remove(sats);
+}
+
+bool TrajKepler::predict_state(Satellite sat, double time,
+                               Vector3d &rPos, Vector3d &rVel)
+{
+    auto const &traj = get_universe().get_reg().get<UCompTrajectory>(sat);
+
+    if (traj.m_trajectory != this)
+    {
+        return false; // not part of this trajectory
+    }
+
+    std::size_t const i = traj.m_index;
+
+    KeplerPath path;
+    path.m_meanMotion = m_meanMotion[i];
+    path.m_meanAnomalyEpoch = m_meanAnomalyEpoch[i];
+    path.m_eccentricity = m_eccentricity[i];
+    path.m_periapsis = {m_px[i], m_py[i], m_pz[i]};
+    path.m_ahead = {m_qx[i], m_qy[i], m_qz[i]};
+    path.state_at(time, rPos, rVel);
+    return true;
+}
+
+void TrajKepler::snapshot_save(SnapshotWriter& rWriter)
+{
+    std::vector<Satellite> const &sats = get_satellites();
+    std::array<std::vector<double>*, 14> const arrays = soa_arrays();
+
+    SnapKepler header{};
+    header.m_version = c_snapshotVersion;
+    header.m_arrays = arrays.size();
+    header.m_count = sats.size();
+    header.m_timePrev = m_timePrev;
+    header.m_meanMotionMax = m_meanMotionMax;
+    std::copy(m_tierEnd.begin(), m_tierEnd.end(), header.m_tierEnd);
+
+    rWriter.chunk_write(&header, sizeof(header));
+    rWriter.chunk_write(sats.data(), sats.size() * sizeof(Satellite));
+    for (std::vector<double> const *pArray : arrays)
+    {
+        rWriter.chunk_write(pArray->data(), pArray->size() * sizeof(double));
+    }
+}
+
+int TrajKepler::snapshot_load(
+        Corrade::Containers::ArrayView<const unsigned char> data)
+{
+    std::array<std::vector<double>*, 14> const arrays = soa_arrays();
+
+    SnapKepler header;
+    if (!snapshot_read(data, &header, sizeof(header))
+        || header.m_version != c_snapshotVersion
+        || header.m_arrays != arrays.size()
+        || header.m_count != get_satellites().size()
+        || data.size() != header.m_count * (sizeof(Satellite)
+                                            + arrays.size() * sizeof(double)))
+    {
+        return 1;
+    }
+
+    std::size_t const count = header.m_count;
+
+    // Tiers must be in order and within the satellites
+    std::size_t prevEnd = 0;
+    for (uint64_t end : header.m_tierEnd)
+    {
+        if (end < prevEnd || end > count)
+        {
+            return 1;
+        }
+        prevEnd = end;
+    }
+
+    // The data is saved in tier order, which adding satellites didn't keep
+    std::vector<Satellite> sats(count);
+    snapshot_read(data, sats.data(), count * sizeof(Satellite));
+
+    if (!satellites_reorder({sats.data(), count}))
+    {
+        return 1;
+    }
+
+    for (std::vector<double> *pArray : arrays)
+    {
+        snapshot_read(data, pArray->data(), count * sizeof(double));
+    }
+
+    m_timePrev = header.m_timePrev;
+    m_meanMotionMax = header.m_meanMotionMax;
+    std::copy(std::begin(header.m_tierEnd), std::end(header.m_tierEnd),
+              m_tierEnd.begin());
+    m_resolveNext = 0;
+    m_tierChanges.clear();
+
+    return 0;
+}
+
+std::array<std::vector<double>*, 14> TrajKepler::soa_arrays()
+{
+    return {&m_meanMotion, &m_meanAnomalyEpoch, &m_eccentricity,
+            &m_px, &m_py, &m_pz, &m_qx, &m_qy, &m_qz,
+            &m_sinE, &m_cosE, &m_outX, &m_outY, &m_outZ};
+}
+
+void TrajKepler::data_reserve(std::size_t size)
+{
+    for (std::vector<double> *pArray : soa_arrays())
+    {
+        pArray->reserve(size);
+    }
+}
+
+void TrajKepler::data_move(std::size_t from, std::size_t to)
+{
+    for (std::vector<double> *pArray : soa_arrays())
+    {
+        (*pArray)[to] = (*pArray)[from];
+    }
+}
+
+void TrajKepler::data_resize(std::size_t size)
+{
+    for (std::vector<double> *pArray : soa_arrays())
+    {
+        pArray->resize(size);
+    }
+
+    // Removed satellites were moved to the last tier, see remove(), so this
+    // only trims tiers that ran up to the end
+    for (std::size_t &rEnd : m_tierEnd)
+    {
+        rEnd = std::min(rEnd, size);
+    }
+}
+
+void TrajKepler::data_swap(std::size_t a, std::size_t b)
+{
+    if (a == b)
+    {
+        return;
+    }
+
+    for (std::vector<double> *pArray : soa_arrays())
+    {
+        std::swap((*pArray)[a], (*pArray)[b]);
+    }
+
+    std::vector<Satellite> &sats = get_satellites();
+    std::swap(sats[a], sats[b]);
+
+    auto view = get_universe().get_reg().view<UCompTrajectory>();
+    view.get(sats[a]).m_index = a;
+    view.get(sats[b]).m_index = b;
+}
+
+std::size_t TrajKepler::orbit_push(KeplerPath const& path)
+{
+    Vector3d const p = path.m_periapsis;
+    Vector3d const q = path.m_ahead;
+
+    m_meanMotion.push_back(path.m_meanMotion);
+    m_meanAnomalyEpoch.push_back(path.m_meanAnomalyEpoch);
+    m_eccentricity.push_back(path.m_eccentricity);
+    m_px.push_back(p.x());
+    m_py.push_back(p.y());
+    m_pz.push_back(p.z());
+    m_qx.push_back(q.x());
+    m_qy.push_back(q.y());
+    m_qz.push_back(q.z());
+    m_sinE.push_back(0.0);
+    m_cosE.push_back(1.0);
+    m_outX.push_back(0.0);
+    m_outY.push_back(0.0);
+    m_outZ.push_back(0.0);
+
+    m_meanMotionMax = std::max(m_meanMotionMax, path.m_meanMotion);
+
+    // Solve for the time of the last update, so the next relative step
+    // starts from the right place
+    std::size_t const index = m_meanMotion.size() - 1;
+    solve_full(index, index + 1, m_timePrev);
+
+    // Start in tier 0, so it gets a proper tier on the next update
+    return tier_move(index, 0);
+}
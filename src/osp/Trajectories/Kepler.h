@@ -0,0 +1,276 @@
+/**
+ * Open Space Program
+ * Copyright © 2019-2020 Open Space Program Project
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+
+#include "../Universe.h"
+
+#include <array>
+
+namespace osp::universe
+{
+
+/**
+ * Classical orbital elements of an elliptical orbit. The reference plane is
+ * the XY plane of the trajectory's center, with the reference direction
+ * along +X.
+ */
+struct KeplerOrbit
+{
+    double m_semiMajorAxis{0.0};    // meters
+    double m_eccentricity{0.0};     // 0 <= e < 1
+    double m_inclination{0.0};      // radians
+    double m_longAscending{0.0};    // radians, longitude of ascending node
+    double m_argPeriapsis{0.0};     // radians, argument of periapsis
+    double m_meanAnomalyEpoch{0.0}; // radians, mean anomaly at time 0
+};
+
+/**
+ * An elliptical orbit in the form it's propagated in, with the orientation
+ * and size folded into two vectors
+ */
+struct KeplerPath
+{
+    double m_meanMotion{0.0};       // radians per second
+    double m_meanAnomalyEpoch{0.0}; // radians, mean anomaly at time 0
+    double m_eccentricity{0.0};
+
+    Vector3d m_periapsis;   // Towards periapsis, scaled by semi-major axis
+    Vector3d m_ahead;       // 90 degrees ahead, scaled by semi-minor axis
+
+    /**
+     * @param orbit [in] Orbital elements
+     * @param gravParam [in] GM of the center in m^3/s^2
+     */
+    static KeplerPath from_orbit(KeplerOrbit const& orbit, double gravParam);
+
+    /**
+     * Calculate the orbit through a position and velocity. If it's not an
+     * ellipse, a circular orbit through the position is used instead.
+     *
+     * @param position [in] Relative to the center, in meters
+     * @param velocity [in] Relative to the center, in m/s
+     * @param gravParam [in] GM of the center in m^3/s^2
+     * @param time [in] Time of the state vectors, in seconds
+     */
+    static KeplerPath from_state(Vector3d position, Vector3d velocity,
+                                 double gravParam, double time);
+
+    /**
+     * Solve for a position with the standard library's trig functions. This
+     * is slow but exact, for when only a few positions are needed.
+     *
+     * @return Position relative to the center at a time, in meters
+     */
+    Vector3d position_at(double time) const;
+
+    /**
+     * Solve for a position and velocity, same as position_at()
+     *
+     * @param time [in] Time in seconds
+     * @param rPos [out] Position relative to the center, in meters
+     * @param rVel [out] Velocity relative to the center, in m/s
+     */
+    void state_at(double time, Vector3d &rPos, Vector3d &rVel) const;
+
+private:
+
+    /**
+     * Solve Kepler's equation with Newton's method
+     *
+     * @return Eccentric anomaly at a time, in radians
+     */
+    double eccentric_anomaly(double time) const;
+};
+
+/**
+ * On-rails elliptical orbits around the center satellite.
+ *
+ * Orbits are stored as SoA arrays parallel to get_satellites(), and are all
+ * propagated to the universe's current time in a single pass by update().
+ * Kepler's equation is solved with a fixed number of Newton iterations and a
+ * branch-free polynomial sin/cos, so the pass vectorizes.
+ *
+ * Small time steps are solved relative to the previous update, which only
+ * needs 2 iterations. Large steps (time warp) fall back to a full solve.
+ * Orbits are accurate for eccentricities up to about 0.95.
+ *
+ * Satellites are sorted into update tiers by distance from active areas, see
+ * UpdateTierConfig. The SoA arrays are partitioned by tier, nearest first.
+ * Tier 0 is solved every tick. Other tiers are solved from scratch a slice
+ * at a time, so each satellite is solved once per period, and stays in place
+ * in between. Only solved satellites are written to the universe and marked
+ * dirty. Tiers are re-picked for the satellites solved each update. Time
+ * warp solves every tier every update.
+ */
+class TrajKepler : public CommonTrajectory<TrajKepler>
+{
+    friend class CommonTrajectory<TrajKepler>;
+
+public:
+
+    /**
+     * @param universe [in]
+     * @param center [in] Satellite to orbit around
+     * @param gravParam [in] Standard gravitational parameter of the center,
+     *                       GM in m^3/s^2
+     */
+    TrajKepler(Universe& universe, Satellite center, double gravParam);
+    ~TrajKepler() = default;
+
+    void update() override;
+
+    using CommonTrajectory<TrajKepler>::add;
+
+    /**
+     * Add a satellite, calculating its orbit from its current position and
+     * UCompVelocity (if it has one). Satellites that are not on an elliptical
+     * orbit are given a circular orbit through their current position.
+     */
+    void add(Satellite sat) override;
+
+    /**
+     * Add a satellite with a known orbit
+     */
+    void add(Satellite sat, KeplerOrbit const& orbit);
+
+    /**
+     * Remove a satellite. It's moved to the last tier first, so satellites
+     * moved into its place stay in their own tiers.
+     */
+    void remove(Satellite sat) override;
+
+    /**
+     * Remove many satellites. They're moved to the last tier first, so the
+     * remaining satellites only shift within the last tier.
+     */
+    void remove(Corrade::Containers::ArrayView<const Satellite> sats) override;
+
+    bool predict_state(Satellite sat, double time,
+                       Vector3d &rPos, Vector3d &rVel) override;
+
+    /**
+     * Save orbits and tiers. Re-adding satellites would recalculate orbits
+     * from their positions and velocities, which are rounded and may be
+     * missing
+     */
+    void snapshot_save(SnapshotWriter& rWriter) override;
+    int snapshot_load(
+            Corrade::Containers::ArrayView<const unsigned char> data) override;
+
+    constexpr double get_grav_param() const { return m_gravParam; }
+
+private:
+
+    // Keep SoA arrays in sync with get_satellites(), see CommonTrajectory
+    void data_reserve(std::size_t size);
+    void data_move(std::size_t from, std::size_t to);
+    void data_resize(std::size_t size);
+
+    /**
+     * Swap two satellites along with their data
+     */
+    void data_swap(std::size_t a, std::size_t b);
+
+    /**
+     * @return Pointers to all SoA arrays
+     */
+    std::array<std::vector<double>*, 14> soa_arrays();
+
+    /**
+     * Push an orbit to the SoA arrays, and solve it for the time of the last
+     * update
+     *
+     * @return Index of the orbit after moving it into tier 0
+     */
+    std::size_t orbit_push(KeplerPath const& path);
+
+    /**
+     * Solve Kepler's equation from scratch for a range of orbits
+     */
+    void solve_full(std::size_t first, std::size_t last, double time);
+
+    /**
+     * @return Update tier of the satellite at an index
+     */
+    unsigned tier_of(std::size_t index) const;
+
+    /**
+     * Pick tiers for a range of satellites from their solved positions, and
+     * queue the ones that need to change tier
+     */
+    void tiers_evaluate(std::size_t first, std::size_t last);
+
+    /**
+     * Move queued satellites to their new tiers
+     */
+    void tiers_apply();
+
+    /**
+     * Move a satellite to another tier by swapping it across tier boundaries
+     *
+     * @return New index of the satellite
+     */
+    std::size_t tier_move(std::size_t index, unsigned tier);
+
+    double m_gravParam;
+
+    // Time of the last update, in seconds
+    double m_timePrev;
+
+    // Largest mean motion added so far, used to limit relative steps
+    double m_meanMotionMax{0.0};
+
+    // Next orbit to re-solve from scratch, see update()
+    std::size_t m_resolveNext{0};
+
+    // SoA orbits, parallel to get_satellites()
+
+    std::vector<double> m_meanMotion;       // radians per second
+    std::vector<double> m_meanAnomalyEpoch; // radians
+    std::vector<double> m_eccentricity;
+
+    // Periapsis direction scaled by the semi-major axis
+    std::vector<double> m_px, m_py, m_pz;
+
+    // Direction 90 degrees ahead of periapsis scaled by semi-minor axis
+    std::vector<double> m_qx, m_qy, m_qz;
+
+    // Sine and cosine of the eccentric anomaly at m_timePrev
+    std::vector<double> m_sinE, m_cosE;
+
+    // Propagated positions in meters, scattered into UCompTransformTraj
+    std::vector<double> m_outX, m_outY, m_outZ;
+
+    // End of each tier except the last, which ends at the last satellite
+    std::array<std::size_t, gc_updateTiers - 1> m_tierEnd{};
+
+    // Satellites to move to another tier, see tiers_apply()
+    std::vector<std::pair<Satellite, unsigned>> m_tierChanges;
+
+    // Active areas relative to the center in meters, for the current update
+    std::vector<Vector3d> m_focus;
+};
+
+}
@@ -0,0 +1,585 @@
+/**
+ * Open Space Program
+ * Copyright © 2019-2020 Open Space Program Project
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "NBody.h"
+#include "../UniverseSnapshot.h"
+#include "../WorkerPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace osp::universe;
+using namespace osp;
+
+namespace
+{
+
+// Bodies per task when evaluating forces on the worker pool
+constexpr std::size_t c_bodiesPerTask = 512;
+
+// Deepest possible octree is one level per bit of SpaceInt, and walking it
+// depth-first keeps at most 7 siblings per level on the stack
+constexpr std::size_t c_stackSize = 8 * 64 + 8;
+
+// Layout of TrajNBody's snapshot data, followed by its satellites and then
+// each SoA array
+constexpr uint32_t c_snapshotVersion = 1;
+
+struct SnapNBody
+{
+    uint32_t m_version;
+    uint32_t m_arrays;
+    uint64_t m_count;
+    double m_timePrev;
+    uint32_t m_accValid;
+    uint32_t m_padding;
+};
+
+}
+
+TrajNBody::TrajNBody(Universe& universe, Satellite center,
+                     WorkerPool& rWorkers, double centerGravParam) :
+        CommonTrajectory<TrajNBody>(universe, center),
+        m_workers(rWorkers),
+        m_centerGravParam(centerGravParam),
+        m_timePrev(universe.get_time())
+{
+
+}
+
+void TrajNBody::update()
+{
+    double const time = get_universe().get_time();
+    std::size_t const count = get_satellites().size();
+    double const timeDelta = time - m_timePrev;
+
+    m_timePrev = time;
+
+    if (count == 0 || timeDelta == 0.0)
+    {
+        return;
+    }
+
+    // Split into substeps no longer than m_maxStep. Time warp beyond
+    // smc_substepsMax substeps per update takes longer steps instead, which
+    // costs accuracy but keeps the frame time bounded
+    int const substeps = std::clamp(
+            int(std::ceil(std::abs(timeDelta) / m_maxStep)), 1, smc_substepsMax);
+    double const h = timeDelta / substeps;
+    double const halfH = 0.5 * h;
+
+    if (!m_accValid)
+    {
+        calc_accelerations();
+    }
+
+    for (int step = 0; step < substeps; step ++)
+    {
+        // Kick-drift-kick leapfrog
+        for (std::size_t i = 0; i < count; i ++)
+        {
+            m_vx[i] += m_ax[i] * halfH;
+            m_vy[i] += m_ay[i] * halfH;
+            m_vz[i] += m_az[i] * halfH;
+            m_x[i] += m_vx[i] * h;
+            m_y[i] += m_vy[i] * h;
+            m_z[i] += m_vz[i] * h;
+        }
+
+        calc_accelerations();
+
+        for (std::size_t i = 0; i < count; i ++)
+        {
+            m_vx[i] += m_ax[i] * halfH;
+            m_vy[i] += m_ay[i] * halfH;
+            m_vz[i] += m_az[i] * halfH;
+        }
+    }
+
+    scatter();
+}
+
+void TrajNBody::add(Satellite sat)
+{
+    add(sat, 0.0);
+}
+
+void TrajNBody::add(Satellite sat, double mass)
+{
+    auto const &traj = get_universe().get_reg().get<UCompTrajectory>(sat);
+
+    if (traj.m_trajectory)
+    {
+        return; // already part of trajectory
+    }
+
+    // Read the state before adding, as adding changes the parent
+    body_push(sat, mass);
+    CommonTrajectory<TrajNBody>::add(sat);
+}
+
+void TrajNBody::body_push(Satellite sat, double mass)
+{
+    Universe &uni = get_universe();
+
+    Vector3d const r = Vector3d(uni.sat_calc_pos(get_center(), sat))
+                     / double(gc_units_per_meter);
+
+    Vector3d v{0.0, 0.0, 0.0};
+    if (auto const *pVel = uni.get_reg().try_get<UCompVelocity>(sat))
+    {
+        v = Vector3d(pVel->m_velocity);
+    }
+
+    m_mass.push_back(mass);
+    m_x.push_back(r.x());
+    m_y.push_back(r.y());
+    m_z.push_back(r.z());
+    m_vx.push_back(v.x());
+    m_vy.push_back(v.y());
+    m_vz.push_back(v.z());
+    m_ax.push_back(0.0);
+    m_ay.push_back(0.0);
+    m_az.push_back(0.0);
+
+    m_accValid = false;
+}
+
+void TrajNBody::snapshot_save(SnapshotWriter& rWriter)
+{
+    std::vector<Satellite> const &sats = get_satellites();
+    std::array<std::vector<double>*, 10> const arrays = soa_arrays();
+
+    SnapNBody header{};
+    header.m_version = c_snapshotVersion;
+    header.m_arrays = arrays.size();
+    header.m_count = sats.size();
+    header.m_timePrev = m_timePrev;
+    header.m_accValid = m_accValid;
+
+    rWriter.chunk_write(&header, sizeof(header));
+    rWriter.chunk_write(sats.data(), sats.size() * sizeof(Satellite));
+    for (std::vector<double> const *pArray : arrays)
+    {
+        rWriter.chunk_write(pArray->data(), pArray->size() * sizeof(double));
+    }
+}
+
+int TrajNBody::snapshot_load(
+        Corrade::Containers::ArrayView<const unsigned char> data)
+{
+    std::array<std::vector<double>*, 10> const arrays = soa_arrays();
+
+    SnapNBody header;
+    if (!snapshot_read(data, &header, sizeof(header))
+        || header.m_version != c_snapshotVersion
+        || header.m_arrays != arrays.size()
+        || header.m_count != get_satellites().size()
+        || data.size() != header.m_count * (sizeof(Satellite)
+                                            + arrays.size() * sizeof(double)))
+    {
+        return 1;
+    }
+
+    std::size_t const count = header.m_count;
+
+    std::vector<Satellite> sats(count);
+    snapshot_read(data, sats.data(), count * sizeof(Satellite));
+
+    if (!satellites_reorder({sats.data(), count}))
+    {
+        return 1;
+    }
+
+    for (std::vector<double> *pArray : arrays)
+    {
+        snapshot_read(data, pArray->data(), count * sizeof(double));
+    }
+
+    m_timePrev = header.m_timePrev;
+    m_accValid = (header.m_accValid != 0);
+
+    return 0;
+}
+
+void TrajNBody::calc_accelerations()
+{
+    std::size_t const count = get_satellites().size();
+
+    tree_build();
+
+    std::size_t const tasks
+            = (count + c_bodiesPerTask - 1) / c_bodiesPerTask;
+
+    m_workers.for_each(tasks, [this, count] (std::size_t task)
+    {
+        std::size_t const first = task * c_bodiesPerTask;
+        tree_accelerate(first, std::min(count, first + c_bodiesPerTask));
+    });
+
+    m_accValid = true;
+}
+
+void TrajNBody::tree_build()
+{
+    std::size_t const count = get_satellites().size();
+
+    m_nodes.clear();
+    m_order.clear();
+    m_unitPos.resize(count);
+    m_treeSlot.assign(count, smc_notInTree);
+
+    // Only bodies with mass pull, so only they go in the tree
+    Vector3s lower{std::numeric_limits<SpaceInt>::max()};
+    Vector3s upper{std::numeric_limits<SpaceInt>::min()};
+
+    for (std::size_t i = 0; i < count; i ++)
+    {
+        if (m_mass[i] <= 0.0)
+        {
+            continue;
+        }
+
+        Vector3s const pos(SpaceInt(std::floor(m_x[i] * gc_units_per_meter)),
+                           SpaceInt(std::floor(m_y[i] * gc_units_per_meter)),
+                           SpaceInt(std::floor(m_z[i] * gc_units_per_meter)));
+        m_unitPos[i] = pos;
+        lower = Magnum::Math::min(lower, pos);
+        upper = Magnum::Math::max(upper, pos);
+        m_order.push_back(uint32_t(i));
+    }
+
+    if (m_order.empty())
+    {
+        return;
+    }
+
+    // Root is a cube with a power of two edge length, so a body's octant at
+    // any depth is just a bit of its offset from the root's corner
+    using USpaceInt = std::make_unsigned_t<SpaceInt>;
+    Vector3s const extent = upper - lower;
+    USpaceInt const extentMax = USpaceInt(std::max({extent.x(), extent.y(),
+                                                    extent.z()}));
+    int shift = 0;
+    while (shift < 62 && (USpaceInt(1) << shift) <= extentMax)
+    {
+        shift ++;
+    }
+
+    m_treeOrigin = lower;
+    m_orderTemp.resize(m_order.size());
+
+    m_nodes.push_back({});
+    tree_build_node(0, 0, uint32_t(m_order.size()), shift);
+
+    // Copy bodies into tree order, so leaves are contiguous in memory
+    std::size_t const bodies = m_order.size();
+    m_treeX.resize(bodies);
+    m_treeY.resize(bodies);
+    m_treeZ.resize(bodies);
+    m_treeMass.resize(bodies);
+
+    for (std::size_t j = 0; j < bodies; j ++)
+    {
+        uint32_t const i = m_order[j];
+        m_treeSlot[i] = uint32_t(j);
+        m_treeX[j] = m_x[i];
+        m_treeY[j] = m_y[i];
+        m_treeZ[j] = m_z[i];
+        m_treeMass[j] = m_mass[i];
+    }
+}
+
+void TrajNBody::tree_build_node(uint32_t nodeIndex, uint32_t first,
+                                uint32_t last, int shift)
+{
+    double const size = double(SpaceInt(1) << shift) / gc_units_per_meter;
+
+    if (last - first <= smc_leafBodies || shift == 0)
+    {
+        double mass = 0.0;
+        double comX = 0.0, comY = 0.0, comZ = 0.0;
+
+        for (uint32_t j = first; j < last; j ++)
+        {
+            uint32_t const i = m_order[j];
+            mass += m_mass[i];
+            comX += m_mass[i] * m_x[i];
+            comY += m_mass[i] * m_y[i];
+            comZ += m_mass[i] * m_z[i];
+        }
+
+        OctreeNode &rNode = m_nodes[nodeIndex];
+        rNode.m_mass = mass;
+        rNode.m_comX = comX / mass;
+        rNode.m_comY = comY / mass;
+        rNode.m_comZ = comZ / mass;
+        rNode.m_sizeSq = size * size;
+        rNode.m_first = first;
+        rNode.m_count = last - first;
+        rNode.m_bodyFirst = first;
+        rNode.m_bodyEnd = last;
+        rNode.m_leaf = true;
+        return;
+    }
+
+    // Counting sort the node's bodies by octant
+    int const bit = shift - 1;
+    auto const octant = [this, bit] (uint32_t i) -> unsigned
+    {
+        Vector3s const offset = m_unitPos[i] - m_treeOrigin;
+        return unsigned((offset.x() >> bit) & 1)
+             | unsigned(((offset.y() >> bit) & 1) << 1)
+             | unsigned(((offset.z() >> bit) & 1) << 2);
+    };
+
+    std::array<uint32_t, 8> octantCount{};
+    for (uint32_t j = first; j < last; j ++)
+    {
+        octantCount[octant(m_order[j])] ++;
+    }
+
+    std::array<uint32_t, 9> octantStart{};
+    octantStart[0] = first;
+    for (unsigned o = 0; o < 8; o ++)
+    {
+        octantStart[o + 1] = octantStart[o] + octantCount[o];
+    }
+
+    std::array<uint32_t, 8> octantNext;
+    std::copy_n(octantStart.begin(), 8, octantNext.begin());
+    for (uint32_t j = first; j < last; j ++)
+    {
+        uint32_t const i = m_order[j];
+        m_orderTemp[octantNext[octant(i)] ++] = i;
+    }
+    std::copy(m_orderTemp.begin() + first, m_orderTemp.begin() + last,
+              m_order.begin() + first);
+
+    // Children are contiguous. m_nodes may reallocate from here on, so nodes
+    // are only referred to by index
+    uint32_t const childFirst = uint32_t(m_nodes.size());
+    uint32_t childCount = 0;
+    for (unsigned o = 0; o < 8; o ++)
+    {
+        if (octantCount[o] != 0)
+        {
+            childCount ++;
+        }
+    }
+    m_nodes.resize(m_nodes.size() + childCount);
+
+    double mass = 0.0;
+    double comX = 0.0, comY = 0.0, comZ = 0.0;
+    uint32_t child = childFirst;
+
+    for (unsigned o = 0; o < 8; o ++)
+    {
+        if (octantCount[o] == 0)
+        {
+            continue;
+        }
+
+        tree_build_node(child, octantStart[o], octantStart[o + 1], shift - 1);
+
+        OctreeNode const &childNode = m_nodes[child];
+        mass += childNode.m_mass;
+        comX += childNode.m_mass * childNode.m_comX;
+        comY += childNode.m_mass * childNode.m_comY;
+        comZ += childNode.m_mass * childNode.m_comZ;
+        child ++;
+    }
+
+    OctreeNode &rNode = m_nodes[nodeIndex];
+    rNode.m_mass = mass;
+    rNode.m_comX = comX / mass;
+    rNode.m_comY = comY / mass;
+    rNode.m_comZ = comZ / mass;
+    rNode.m_sizeSq = size * size;
+    rNode.m_first = childFirst;
+    rNode.m_count = childCount;
+    rNode.m_bodyFirst = first;
+    rNode.m_bodyEnd = last;
+    rNode.m_leaf = false;
+}
+
+void TrajNBody::tree_accelerate(std::size_t first, std::size_t last)
+{
+    double const thetaSq = m_theta * m_theta;
+    double const softSq = m_softening * m_softening;
+    double const G = smc_gravConstant;
+    double const mu = m_centerGravParam;
+
+    std::array<uint32_t, c_stackSize> stack;
+
+    for (std::size_t i = first; i < last; i ++)
+    {
+        double const x = m_x[i];
+        double const y = m_y[i];
+        double const z = m_z[i];
+        uint32_t const slot = m_treeSlot[i];
+
+        double ax = 0.0, ay = 0.0, az = 0.0;
+
+        // Pull from the center
+        if (mu != 0.0)
+        {
+            double const rSq = x * x + y * y + z * z + softSq;
+            double const invR = 1.0 / std::sqrt(rSq);
+            double const f = -mu * invR * invR * invR;
+            ax += f * x;
+            ay += f * y;
+            az += f * z;
+        }
+
+        std::size_t top = 0;
+        if (!m_nodes.empty())
+        {
+            stack[top ++] = 0;
+        }
+
+        while (top != 0)
+        {
+            OctreeNode const &node = m_nodes[stack[-- top]];
+
+            double const dx = node.m_comX - x;
+            double const dy = node.m_comY - y;
+            double const dz = node.m_comZ - z;
+            double const distSq = dx * dx + dy * dy + dz * dz;
+
+            // A node containing the body includes its own mass, so it's
+            // always opened, even if it looks far enough at large angles
+            bool const containsSelf = slot >= node.m_bodyFirst
+                                   && slot < node.m_bodyEnd;
+
+            if (!containsSelf && node.m_sizeSq < thetaSq * distSq)
+            {
+                // Far enough away to treat as a single mass
+                double const rSq = distSq + softSq;
+                double const invR = 1.0 / std::sqrt(rSq);
+                double const f = G * node.m_mass * invR * invR * invR;
+                ax += f * dx;
+                ay += f * dy;
+                az += f * dz;
+            }
+            else if (node.m_leaf)
+            {
+                uint32_t const end = node.m_first + node.m_count;
+                for (uint32_t j = node.m_first; j < end; j ++)
+                {
+                    if (j == slot)
+                    {
+                        continue; // don't pull on itself
+                    }
+
+                    double const bx = m_treeX[j] - x;
+                    double const by = m_treeY[j] - y;
+                    double const bz = m_treeZ[j] - z;
+                    double const rSq = bx * bx + by * by + bz * bz + softSq;
+                    double const invR = 1.0 / std::sqrt(rSq);
+                    double const f = G * m_treeMass[j] * invR * invR * invR;
+                    ax += f * bx;
+                    ay += f * by;
+                    az += f * bz;
+                }
+            }
+            else
+            {
+                for (uint32_t c = 0; c < node.m_count; c ++)
+                {
+                    stack[top ++] = node.m_first + c;
+                }
+            }
+        }
+
+        m_ax[i] = ax;
+        m_ay[i] = ay;
+        m_az[i] = az;
+    }
+}
+
+void TrajNBody::scatter()
+{
+    std::vector<Satellite> &sats = get_satellites();
+    std::size_t const count = sats.size();
+
+    auto &reg = get_universe().get_reg();
+    auto view = reg.view<UCompTransformTraj>();
+    auto const to_units = [] (double meters) -> SpaceInt
+    {
+        double const units = meters * gc_units_per_meter;
+        return static_cast<SpaceInt>(units + std::copysign(0.5, units));
+    };
+
+    for (std::size_t i = 0; i < count; i ++)
+    {
+        auto &posTraj = view.get(sats[i]);
+
+        posTraj.m_position = Vector3s(to_units(m_x[i]),
+                                      to_units(m_y[i]),
+                                      to_units(m_z[i]));
+
+        if (auto *pVel = reg.try_get<UCompVelocity>(sats[i]))
+        {
+            pVel->m_velocity = Vector3(float(m_vx[i]), float(m_vy[i]),
+                                       float(m_vz[i]));
+        }
+    }
+
+    get_universe().sat_mark_dirty({sats.data(), count});
+}
+
+std::array<std::vector<double>*, 10> TrajNBody::soa_arrays()
+{
+    return {&m_mass, &m_x, &m_y, &m_z, &m_vx, &m_vy, &m_vz,
+            &m_ax, &m_ay, &m_az};
+}
+
+void TrajNBody::data_reserve(std::size_t size)
+{
+    for (std::vector<double> *pArray : soa_arrays())
+    {
+        pArray->reserve(size);
+    }
+}
+
+void TrajNBody::data_move(std::size_t from, std::size_t to)
+{
+    for (std::vector<double> *pArray : soa_arrays())
+    {
+        (*pArray)[to] = (*pArray)[from];
+    }
+}
+
+void TrajNBody::data_resize(std::size_t size)
+{
+    for (std::vector<double> *pArray : soa_arrays())
+    {
+        pArray->resize(size);
+    }
+
+    // Removed bodies may have been pulling on the others
+    m_accValid = false;
+}
@@ -0,0 +1,251 @@
+/**
+ * Open Space Program
+ * Copyright © 2019-2020 Open Space Program Project
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+
+#include "../Universe.h"
+
+#include <array>
+
+namespace osp
+{
+class WorkerPool;
+}
+
+namespace osp::universe
+{
+
+/**
+ * Newtonian gravity between satellites, for things that aren't on rails such
+ * as asteroid swarms and debris. Satellites can also be pulled by the center.
+ *
+ * Each step, a Barnes-Hut octree is built over the satellites' integer
+ * positions. Accelerations are then found by walking the tree for each
+ * satellite, treating nodes that are small enough from where they're seen
+ * as a single mass. This is O(N log N) instead of O(N^2). Force evaluation is
+ * split across a WorkerPool.
+ *
+ * Bodies are integrated with kick-drift-kick leapfrog. Large time steps are
+ * split into substeps no longer than the max step, up to a limit per update.
+ *
+ * States are stored as SoA arrays parallel to get_satellites().
+ */
+class TrajNBody : public CommonTrajectory<TrajNBody>
+{
+    friend class CommonTrajectory<TrajNBody>;
+
+public:
+
+    static constexpr double smc_gravConstant = 6.6743e-11;
+
+    // Most substeps taken by a single update, see set_max_step()
+    static constexpr int smc_substepsMax = 16;
+
+    // Most bodies in a leaf of the octree
+    static constexpr std::size_t smc_leafBodies = 8;
+
+    /**
+     * @param universe [in]
+     * @param center [in] Satellite positions are relative to
+     * @param rWorkers [in] Pool to evaluate forces on
+     * @param centerGravParam [in] GM of the center in m^3/s^2, or 0 for none
+     */
+    TrajNBody(Universe& universe, Satellite center, WorkerPool& rWorkers,
+              double centerGravParam = 0.0);
+    ~TrajNBody() = default;
+
+    void update() override;
+
+    // Force evaluation is split across the WorkerPool
+    bool is_update_parallel() const override { return true; }
+
+    using CommonTrajectory<TrajNBody>::add;
+
+    /**
+     * Add a massless satellite, starting at its current position and
+     * UCompVelocity (if it has one). It's pulled by others, but doesn't pull.
+     */
+    void add(Satellite sat) override;
+
+    /**
+     * Add a satellite with mass, starting at its current position and
+     * UCompVelocity (if it has one)
+     *
+     * @param mass [in] kg
+     */
+    void add(Satellite sat, double mass);
+
+    /**
+     * Save masses and full precision positions and velocities, which aren't
+     * in the satellites' components
+     */
+    void snapshot_save(SnapshotWriter& rWriter) override;
+    int snapshot_load(
+            Corrade::Containers::ArrayView<const unsigned char> data) override;
+
+    /**
+     * Set the Barnes-Hut opening angle. A node of the octree is treated as a
+     * single mass if its size divided by its distance is less than this.
+     * 0 is exact but O(N^2), around 0.5 is typical, larger is faster and less
+     * accurate.
+     */
+    void set_opening_angle(double theta) noexcept { m_theta = theta; }
+    constexpr double get_opening_angle() const noexcept { return m_theta; }
+
+    /**
+     * Set the softening length in meters, which limits how hard bodies pull
+     * each other when they get close
+     */
+    void set_softening(double length) noexcept { m_softening = length; }
+    constexpr double get_softening() const noexcept { return m_softening; }
+
+    /**
+     * Set the longest step to integrate in one go, in seconds
+     */
+    void set_max_step(double step) noexcept { m_maxStep = step; }
+    constexpr double get_max_step() const noexcept { return m_maxStep; }
+
+    /**
+     * @return Acceleration of each satellite in m/s^2, as of the last update,
+     *         parallel to get_satellites()
+     */
+    Vector3d get_acceleration(std::size_t index) const
+    { return {m_ax[index], m_ay[index], m_az[index]}; }
+
+    /**
+     * Calculate accelerations of all satellites at their current positions
+     */
+    void calc_accelerations();
+
+private:
+
+    struct OctreeNode
+    {
+        // Center of mass, in meters relative to the center
+        double m_comX, m_comY, m_comZ;
+        double m_mass;
+
+        // Edge length squared, in meters^2
+        double m_sizeSq;
+
+        // First child node, or first body in m_tree* arrays for leaves
+        uint32_t m_first;
+
+        // Number of children, or bodies for leaves
+        uint32_t m_count;
+
+        // Bodies of the node and all of its descendants, as a range of
+        // m_order
+        uint32_t m_bodyFirst;
+        uint32_t m_bodyEnd;
+
+        bool m_leaf;
+    };
+
+    // Keep SoA arrays in sync with get_satellites(), see CommonTrajectory
+    void data_reserve(std::size_t size);
+    void data_move(std::size_t from, std::size_t to);
+    void data_resize(std::size_t size);
+
+    /**
+     * @return Pointers to all SoA arrays
+     */
+    std::array<std::vector<double>*, 10> soa_arrays();
+
+    /**
+     * Push a body to the SoA arrays, using the satellite's current state
+     */
+    void body_push(Satellite sat, double mass);
+
+    /**
+     * Build the octree over the current positions
+     */
+    void tree_build();
+
+    /**
+     * Recursively subdivide a node of the octree
+     *
+     * @param nodeIndex [in] Node to build, already in m_nodes
+     * @param first [in] First body of the node in m_order
+     * @param last [in] One past the last body of the node in m_order
+     * @param shift [in] log2 of the node's edge length in units
+     */
+    void tree_build_node(uint32_t nodeIndex, uint32_t first, uint32_t last,
+                         int shift);
+
+    /**
+     * Calculate accelerations for a range of bodies by walking the octree
+     */
+    void tree_accelerate(std::size_t first, std::size_t last);
+
+    /**
+     * Scatter positions and velocities into the registry
+     */
+    void scatter();
+
+    WorkerPool &m_workers;
+
+    double m_centerGravParam;
+    double m_theta{0.5};
+    double m_softening{1.0};
+    double m_maxStep{1.0 / 60.0};
+
+    // Time of the last update, in seconds
+    double m_timePrev;
+
+    // False if m_ax/y/z are outdated, such as after adding satellites
+    bool m_accValid{false};
+
+    // SoA bodies, parallel to get_satellites()
+
+    std::vector<double> m_mass;         // kg
+    std::vector<double> m_x, m_y, m_z;  // meters, relative to center
+    std::vector<double> m_vx, m_vy, m_vz; // m/s
+    std::vector<double> m_ax, m_ay, m_az; // m/s^2
+
+    // Octree, rebuilt every step
+
+    std::vector<OctreeNode> m_nodes;
+
+    // Integer positions of bodies, in units relative to center
+    std::vector<Vector3s> m_unitPos;
+
+    // Body indices sorted so each leaf is a contiguous range
+    std::vector<uint32_t> m_order;
+    std::vector<uint32_t> m_orderTemp;
+
+    // Index of each body in m_order, parallel to get_satellites(). Bodies
+    // without mass aren't in the tree, and are set to smc_notInTree
+    std::vector<uint32_t> m_treeSlot;
+    static constexpr uint32_t smc_notInTree = ~uint32_t(0);
+
+    // Positions in meters and masses of bodies with mass, in m_order, so
+    // leaves read contiguous memory
+    std::vector<double> m_treeX, m_treeY, m_treeZ, m_treeMass;
+
+    // Integer corner of the root node
+    Vector3s m_treeOrigin;
+};
+
+}
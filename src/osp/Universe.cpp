@@ -23,50 +23,286 @@
  * SOFTWARE.
  */
 #include "Universe.h"
+#include "WorkerPool.h"
+#include "run_kernel.h"
 
 #include "Satellites/SatActiveArea.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstring>
 #include <iostream>
 #include <iterator>
 
 using namespace osp::universe;
 using namespace osp;
 
+namespace
+{
+
+// Adding these bits to an integer below 2^51 in magnitude, then subtracting
+// c_doubleMagic from the bits read as a double, converts it to double.
+// Unlike a plain conversion, this vectorizes without AVX-512
+constexpr int64_t c_doubleMagicBits = 0x4338000000000000;
+constexpr double c_doubleMagic = 6755399441055744.0; // 2^52 + 2^51
+constexpr int64_t c_doubleMagicLimit = int64_t(1) << 51;
+
+/**
+ * Convert an integer below 2^51 in magnitude to double
+ */
+inline double int_to_double_fast(int64_t value) noexcept
+{
+    int64_t const bits = value + c_doubleMagicBits;
+    double biased;
+    std::memcpy(&biased, &bits, sizeof(biased));
+    return biased - c_doubleMagic;
+}
+
+/**
+ * Gather positions from SoA arrays, subtract a frame, and convert them to
+ * meters. Kept free of function calls and branches so it vectorizes
+ *
+ * @return false if any relative position is out of range of
+ *         int_to_double_fast(), so the output is wrong
+ */
+bool pos_meters_kernel(
+        std::size_t count, std::size_t const* __restrict indices,
+        SpaceInt const* __restrict x, SpaceInt const* __restrict y,
+        SpaceInt const* __restrict z, Vector3s const framePos,
+        float* __restrict out)
+{
+    SpaceInt const frameX = framePos.x();
+    SpaceInt const frameY = framePos.y();
+    SpaceInt const frameZ = framePos.z();
+    double const metersPerUnit = 1.0 / gc_units_per_meter;
+
+    // Any bit above the range ends up set if a value is out of it
+    uint64_t outside = 0;
+
+    for (std::size_t i = 0; i < count; i ++)
+    {
+        std::size_t const index = indices[i];
+        SpaceInt const dx = x[index] - frameX;
+        SpaceInt const dy = y[index] - frameY;
+        SpaceInt const dz = z[index] - frameZ;
+
+        outside |= uint64_t(dx + c_doubleMagicLimit)
+                 | uint64_t(dy + c_doubleMagicLimit)
+                 | uint64_t(dz + c_doubleMagicLimit);
+
+        out[i * 3 + 0] = float(int_to_double_fast(dx) * metersPerUnit);
+        out[i * 3 + 1] = float(int_to_double_fast(dy) * metersPerUnit);
+        out[i * 3 + 2] = float(int_to_double_fast(dz) * metersPerUnit);
+    }
+
+    return (outside >> 52) == 0;
+}
+
+}
+
+SatTypeIndex_t osp::universe::sat_type_index_next() noexcept
+{
+    static std::atomic<SatTypeIndex_t> s_count{0};
+    return s_count.fetch_add(1);
+}
+
 Universe::Universe()
 {
     m_root = sat_create();
+
+    reg_connect();
+}
+
+void Universe::reg_connect()
+{
+    m_registry.on_destroy<UCompTransformTraj>()
+            .connect<&Universe::on_sat_destroy>(*this);
+
+    // Create pools that trajectories view while updating in parallel, as
+    // creating them there would race
+    m_registry.view<UCompUpdatePriority>();
 }
 
 Satellite Universe::sat_create()
 {
     Satellite sat = m_registry.create();
     m_registry.emplace<UCompTransformTraj>(sat);
+    m_registry.emplace<UCompTrajectory>(sat);
     m_registry.emplace<UCompType>(sat);
+    sat_mark_dirty(sat);
     return sat;
 }
 
+std::vector<Satellite> Universe::sat_create_many(std::size_t count,
+                                                 ITypeSatellite *pType)
+{
+    std::vector<Satellite> sats(count);
+
+    m_registry.reserve(m_registry.size() + count);
+    m_registry.reserve<UCompTransformTraj, UCompTrajectory, UCompType>(
+            m_registry.size<UCompTransformTraj>() + count);
+
+    m_registry.create(sats.begin(), sats.end());
+    m_registry.insert<UCompTransformTraj>(sats.begin(), sats.end());
+    m_registry.insert<UCompTrajectory>(sats.begin(), sats.end());
+    m_registry.insert<UCompType>(sats.begin(), sats.end());
+
+    Corrade::Containers::ArrayView<const Satellite> const view(sats.data(),
+                                                               count);
+    sat_mark_dirty(view);
+
+    if (pType != nullptr)
+    {
+        pType->add(view);
+    }
+
+    return sats;
+}
+
+void Universe::sat_mark_dirty(Satellite sat)
+{
+    std::lock_guard<std::mutex> lock(m_satsDirtyMutex);
+
+    m_registry.get<UCompTransformTraj>(sat).m_dirty = true;
+
+    if (!m_satsDirty.contains(sat))
+    {
+        m_satsDirty.emplace(sat);
+    }
+}
+
+void Universe::sat_mark_dirty(
+        Corrade::Containers::ArrayView<const Satellite> sats)
+{
+    std::lock_guard<std::mutex> lock(m_satsDirtyMutex);
+
+    auto view = m_registry.view<UCompTransformTraj>();
+
+    for (Satellite sat : sats)
+    {
+        view.get(sat).m_dirty = true;
+
+        if (!m_satsDirty.contains(sat))
+        {
+            m_satsDirty.emplace(sat);
+        }
+    }
+}
+
 void Universe::sat_remove(Satellite sat)
 {
     m_registry.destroy(sat);
 }
 
+void Universe::sat_set_name(Satellite sat, std::string_view name)
+{
+    m_registry.emplace_or_replace<UCompName>(sat, m_names.intern(name));
+}
 
-Vector3s Universe::sat_calc_pos(Satellite referenceFrame, Satellite target) const
+std::string_view Universe::sat_get_name(Satellite sat) const
+{
+    UCompName const *pName = m_registry.try_get<UCompName>(sat);
+    return (pName != nullptr) ? std::string_view(pName->m_name)
+                              : std::string_view{};
+}
+
+
+Vector3s Universe::sat_calc_root_pos(Satellite sat) const
 {
     auto const view = m_registry.view<const UCompTransformTraj>();
 
-    // TODO: maybe do some checks to make sure they have the components
-    auto const &framePosTraj = view.get<const UCompTransformTraj>(referenceFrame);
-    auto const &targetPosTraj = view.get<const UCompTransformTraj>(target);
+    // Cached positions include the positions of ancestors, so they can only
+    // be used above the highest dirty satellite on the way to the root
+    Satellite dirtyTop = entt::null;
+    for (Satellite curr = sat; curr != m_root; )
+    {
+        auto const &posTraj = view.get<const UCompTransformTraj>(curr);
+
+        if (posTraj.m_dirty)
+        {
+            dirtyTop = curr;
+        }
+
+        Satellite const parent = posTraj.m_parent;
+        if (parent == curr || !m_registry.valid(parent))
+        {
+            break;
+        }
+        curr = parent;
+    }
+
+    bool cacheUsable = (dirtyTop == entt::null);
+
+    Vector3s pos{0, 0, 0};
+    Satellite curr = sat;
+
+    while (curr != m_root)
+    {
+        auto const &posTraj = view.get<const UCompTransformTraj>(curr);
+
+        if (cacheUsable)
+        {
+            // Use the cached position if there is one
+            std::size_t const index = sat_index(curr);
+            if (index < m_frames.size() && m_frames[index].m_sat == curr)
+            {
+                return pos + frame_root_pos(index);
+            }
+        }
 
-    if (framePosTraj.m_parent == targetPosTraj.m_parent)
+        pos += posTraj.m_position;
+
+        if (curr == dirtyTop)
+        {
+            cacheUsable = true;
+        }
+
+        Satellite const parent = posTraj.m_parent;
+
+        if (parent == curr || !m_registry.valid(parent))
+        {
+            // No parent, treat as a child of the root
+            break;
+        }
+
+        curr = parent;
+    }
+
+    return pos;
+}
+
+Vector3s Universe::sat_root_pos_gather(Satellite sat, bool allClean) const
+{
+    std::size_t const index = sat_index(sat);
+
+    if (allClean && index < m_frames.size() && m_frames[index].m_sat == sat)
     {
-        // Same parent, easy calculation
-        return targetPosTraj.m_position - framePosTraj.m_position;
+        return frame_root_pos(index);
     }
-    // TODO: calculation for different parents
 
-    return {0, 0, 0};
+    return sat_calc_root_pos(sat);
+}
+
+Vector3s Universe::sat_calc_pos(Satellite referenceFrame, Satellite target) const
+{
+    return sat_calc_root_pos(target) - sat_calc_root_pos(referenceFrame);
+}
+
+void Universe::sat_calc_pos(
+        Satellite referenceFrame,
+        Corrade::Containers::ArrayView<const Satellite> targets,
+        Corrade::Containers::ArrayView<Vector3s> posOut) const
+{
+    assert(targets.size() == posOut.size());
+
+    Vector3s const framePos = sat_calc_root_pos(referenceFrame);
+    bool const allClean = m_satsDirty.empty();
+
+    for (std::size_t i = 0; i < targets.size(); i ++)
+    {
+        posOut[i] = sat_root_pos_gather(targets[i], allClean) - framePos;
+    }
 }
 
 Vector3 Universe::sat_calc_pos_meters(Satellite referenceFrame, Satellite target) const
@@ -75,4 +311,321 @@ Vector3 Universe::sat_calc_pos_meters(Satellite referenceFrame, Satellite target
     return Vector3(sat_calc_pos(referenceFrame, target)) / 1024.0f;
 }
 
+void Universe::sat_calc_pos_meters(
+        Satellite referenceFrame,
+        Corrade::Containers::ArrayView<const Satellite> targets,
+        Corrade::Containers::ArrayView<Vector3> posOut) const
+{
+    assert(targets.size() == posOut.size());
 
+    if (targets.empty())
+    {
+        return;
+    }
+
+    Vector3s const framePos = sat_calc_root_pos(referenceFrame);
+
+    // Slow path for targets that aren't cached, or out of the kernel's range
+    auto const convert_one = [this, &framePos, &targets, &posOut]
+            (std::size_t i)
+    {
+        posOut[i] = Vector3(sat_calc_root_pos(targets[i]) - framePos)
+                  / gc_units_per_meter;
+    };
+
+    if (!m_satsDirty.empty() || m_frames.empty())
+    {
+        for (std::size_t i = 0; i < targets.size(); i ++)
+        {
+            convert_one(i);
+        }
+        return;
+    }
+
+    // Number of satellites converted per chunk, sized to stay in L1 cache
+    constexpr std::size_t c_chunkSize = 256;
+
+    std::size_t indices[c_chunkSize];
+    std::size_t uncached[c_chunkSize];
+    float* pOut = posOut.data()->data();
+
+    for (std::size_t start = 0; start < targets.size(); start += c_chunkSize)
+    {
+        std::size_t const count = std::min(c_chunkSize,
+                                           targets.size() - start);
+        std::size_t uncachedCount = 0;
+
+        // Targets without a cache entry read entry 0 in the kernel, and are
+        // overwritten afterwards
+        for (std::size_t i = 0; i < count; i ++)
+        {
+            Satellite const sat = targets[start + i];
+            std::size_t const index = sat_index(sat);
+
+            if (index < m_frames.size() && m_frames[index].m_sat == sat)
+            {
+                indices[i] = index;
+            }
+            else
+            {
+                indices[i] = 0;
+                uncached[uncachedCount ++] = i;
+            }
+        }
+
+        bool inRange = false;
+        float* pChunkOut = pOut + start * 3;
+
+        run_kernel([&] ()
+        {
+            inRange = pos_meters_kernel(
+                    count, indices, m_framesX.data(), m_framesY.data(),
+                    m_framesZ.data(), framePos, pChunkOut);
+        });
+
+        if (!inRange)
+        {
+            // Rare, only for positions over 2^51 units (2 billion km) away
+            for (std::size_t i = 0; i < count; i ++)
+            {
+                convert_one(start + i);
+            }
+            continue;
+        }
+
+        for (std::size_t u = 0; u < uncachedCount; u ++)
+        {
+            convert_one(start + uncached[u]);
+        }
+    }
+}
+
+
+void Universe::sat_frames_update()
+{
+    // Any entity index created so far can be in the queue
+    m_frames.resize(m_registry.size());
+    m_framesX.resize(m_registry.size());
+    m_framesY.resize(m_registry.size());
+    m_framesZ.resize(m_registry.size());
+
+    // 0 is reserved for entries that were never visited
+    if (++m_framesPass == 0)
+    {
+        m_framesPass = 1;
+    }
+
+    m_framesChanged.clear();
+    m_framesRemoved.swap(m_satsRemoved);
+    m_satsRemoved.clear();
+
+    // Satellites of a trajectory move along with its center, so they're
+    // queued too if the center is. Repeat until no more trajectories are
+    // added, as a trajectory's satellite can be the center of another
+    m_trajExpanded.clear();
+    bool expanded = true;
+    while (expanded)
+    {
+        expanded = false;
+
+        for (std::unique_ptr<ISystemTrajectory> const &pTraj : m_trajectories)
+        {
+            if (!m_satsDirty.contains(pTraj->get_center())
+                || std::find(m_trajExpanded.begin(), m_trajExpanded.end(),
+                             pTraj.get()) != m_trajExpanded.end())
+            {
+                continue;
+            }
+
+            for (Satellite sat : pTraj->get_satellites())
+            {
+                if (!m_satsDirty.contains(sat))
+                {
+                    m_satsDirty.emplace(sat);
+                }
+            }
+
+            m_trajExpanded.push_back(pTraj.get());
+            expanded = true;
+        }
+    }
+
+    auto view = m_registry.view<UCompTransformTraj>();
+    auto const viewAct = m_registry.view<const UCompActivatable>();
+    auto const viewArea = m_registry.view<const UCompActiveArea>();
+
+    for (Satellite sat : m_satsDirty)
+    {
+        if (!sat_frame_resolve(sat))
+        {
+            continue;
+        }
+
+        m_framesChanged.push_back(sat);
+
+        Vector3s const rootPos = frame_root_pos(sat_index(sat));
+
+        SpaceInt radius = 0;
+        if (viewAct.contains(sat))
+        {
+            radius = SpaceInt(viewAct.get(sat).m_radius * gc_units_per_meter);
+            m_conjunctions.insert(sat, rootPos, radius);
+        }
+        else if (viewArea.contains(sat))
+        {
+            m_conjunctions.insert(sat, rootPos, SpaceInt(
+                    viewArea.get(sat).m_activateRadius * gc_units_per_meter));
+        }
+        else
+        {
+            m_conjunctions.remove(sat);
+        }
+
+        m_spatialIndex.insert(sat, rootPos, radius);
+    }
+
+    m_conjunctions.update(m_time);
+
+    for (Satellite sat : m_satsDirty)
+    {
+        view.get(sat).m_dirty = false;
+    }
+
+    m_satsDirty.clear();
+}
+
+bool Universe::sat_frame_resolve(Satellite sat)
+{
+    if (sat == m_root)
+    {
+        return false;
+    }
+
+    std::size_t const index = sat_index(sat);
+    SatFrame &frame = m_frames[index];
+
+    if (frame.m_sat == sat && frame.m_pass == m_framesPass)
+    {
+        return frame.m_changed; // already resolved this pass
+    }
+
+    auto const &posTraj = m_registry.get<UCompTransformTraj>(sat);
+    Satellite const parent = posTraj.m_parent;
+
+    bool const hasParent = (parent != sat) && (parent != m_root)
+                        && m_registry.valid(parent);
+
+    // Resolve ancestors first. m_frames is already sized, so frame stays valid
+    bool const parentChanged = hasParent && sat_frame_resolve(parent);
+
+    bool const changed = posTraj.m_dirty || parentChanged
+                      || (frame.m_sat != sat);
+
+    if (changed)
+    {
+        Vector3s rootPos = posTraj.m_position;
+
+        if (hasParent)
+        {
+            rootPos += frame_root_pos(sat_index(parent));
+        }
+
+        m_framesX[index] = rootPos.x();
+        m_framesY[index] = rootPos.y();
+        m_framesZ[index] = rootPos.z();
+        frame.m_sat = sat;
+    }
+
+    frame.m_pass = m_framesPass;
+    frame.m_changed = changed;
+
+    return changed;
+}
+
+void Universe::update(double time, WorkerPool& rWorkers)
+{
+    m_time = time;
+    m_tick ++;
+
+    m_tierFocus.clear();
+    for (Satellite sat : m_registry.view<const UCompActiveArea>())
+    {
+        m_tierFocus.push_back(sat_calc_pos(m_root, sat));
+    }
+
+    for (std::vector<ISystemTrajectory*> &level : m_trajLevels)
+    {
+        level.clear();
+    }
+
+    auto const view = m_registry.view<const UCompTransformTraj>();
+    auto const viewTraj = m_registry.view<const UCompTrajectory>();
+
+    for (std::unique_ptr<ISystemTrajectory> const &pTraj : m_trajectories)
+    {
+        // Count satellites moved by trajectories, from the center up to root
+        std::size_t levelIndex = 0;
+        Satellite sat = pTraj->get_center();
+
+        while (m_registry.valid(sat) && sat != m_root)
+        {
+            auto const &posTraj = view.get(sat);
+
+            if (viewTraj.get(sat).m_trajectory != nullptr)
+            {
+                levelIndex ++;
+            }
+
+            if (posTraj.m_parent == sat)
+            {
+                break;
+            }
+            sat = posTraj.m_parent;
+        }
+
+        if (levelIndex >= m_trajLevels.size())
+        {
+            m_trajLevels.resize(levelIndex + 1);
+        }
+        m_trajLevels[levelIndex].push_back(pTraj.get());
+    }
+
+    for (std::vector<ISystemTrajectory*> &level : m_trajLevels)
+    {
+        // Trajectories that use the pool themselves would only get a single
+        // thread inside a pool task, so they're updated one at a time after
+        // the others
+        auto const parallelFirst = std::partition(
+                level.begin(), level.end(), [] (ISystemTrajectory *pTraj)
+        {
+            return !pTraj->is_update_parallel();
+        });
+        std::size_t const serialCount = std::size_t(parallelFirst
+                                                    - level.begin());
+
+        rWorkers.for_each(serialCount, [&level] (std::size_t i)
+        {
+            level[i]->update();
+        });
+
+        for (auto it = parallelFirst; it != level.end(); ++ it)
+        {
+            (*it)->update();
+        }
+    }
+
+    sat_frames_update();
+}
+
+void Universe::on_sat_destroy(entt::basic_registry<Satellite>& reg,
+                              Satellite sat)
+{
+    m_spatialIndex.remove(sat);
+    m_conjunctions.remove(sat);
+    m_satsRemoved.push_back(sat);
+
+    if (m_satsDirty.contains(sat))
+    {
+        m_satsDirty.remove(sat);
+    }
+}
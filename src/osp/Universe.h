@@ -26,24 +26,50 @@
 
 //#include "Satellite.h"
 #include "types.h"
+#include "universetypes.h"
+#include "SatConjunctions.h"
+#include "SatSpatialIndex.h"
+#include "StringInterner.h"
+#include "UniverseState.h"
 
 #include <entt/entity/registry.hpp>
 
+#include <Corrade/Containers/ArrayView.h>
+
+#include <array>
+#include <mutex>
 #include <vector>
 #include <cstdint>
 
+namespace osp
+{
+class WorkerPool;
+}
+
 namespace osp::universe
 {
 
-class ISystemTrajectory;
-class ITypeSatellite;
+class SnapshotReader;
+class SnapshotWriter;
 
-//using Satellite = entt::entity;
-//ENTT_OPAQUE_TYPE(Satellite, uint32_t);
-enum class Satellite: entt::id_type {};
+using MapSatType = std::map<std::string, std::unique_ptr<ITypeSatellite>>;
 
+constexpr std::size_t gc_updateTiers = 3;
 
-using MapSatType = std::map<std::string, std::unique_ptr<ITypeSatellite>>;
+/**
+ * How often satellites are updated, depending on how far they are from the
+ * nearest active area. Trajectories that support tiers update satellites in
+ * tier t every m_period[t] ticks, and leave them in place in between.
+ */
+struct UpdateTierConfig
+{
+    // Satellites further than m_distance[t] meters from every active area
+    // are in a tier above t
+    std::array<double, gc_updateTiers - 1> m_distance{1.0e5, 1.0e7};
+
+    // Ticks between updates of each tier
+    std::array<unsigned, gc_updateTiers> m_period{1, 4, 16};
+};
 
 //typedef uint64_t Coordinate[3];
 //typedef Math::Vector3<int64_t> Coordinate;
@@ -71,6 +97,10 @@ using MapSatType = std::map<std::string, std::unique_ptr<ITypeSatellite>>;
  */
 class Universe
 {
+    // Snapshots read and rebuild internals in bulk, see UniverseSnapshot.h
+    friend bool snapshot_save(Universe const& uni, SnapshotWriter& rWriter);
+    friend int snapshot_load(Universe& rUni, SnapshotReader const& reader);
+
 public:
     Universe();
     Universe(Universe const &copy) = delete;
@@ -89,10 +119,34 @@ public:
      */
     Satellite sat_create();
 
+    /**
+     * Create many Satellites at once. Component pools are reserved up front,
+     * and components are inserted in bulk instead of one at a time.
+     *
+     * @param count [in] Number of Satellites to create
+     * @param pType [in] Type to add all of them to, or nullptr for none
+     * @return The new Satellites, in the order they were created
+     */
+    std::vector<Satellite> sat_create_many(std::size_t count,
+                                           ITypeSatellite *pType = nullptr);
+
     /**
      * @return Root Satellite of the universe. This will never change.
      */
-    constexpr Satellite sat_root() { return m_root; };
+    constexpr Satellite sat_root() const { return m_root; };
+
+    /**
+     * @return Current universe time in seconds, used by trajectories
+     */
+    constexpr double get_time() const noexcept { return m_time; }
+
+    /**
+     * Set the current universe time. Trajectories move their satellites to
+     * this time on their next update.
+     *
+     * @param time [in] Time in seconds
+     */
+    constexpr void set_time(double time) noexcept { m_time = time; }
 
     /**
      * Remove a satellite
@@ -100,13 +154,48 @@ public:
     void sat_remove(Satellite sat);
 
     /**
-     * Calculate position between two satellites.
+     * Set the name of a satellite. Names are interned, so satellites with
+     * the same name share a single copy of it.
+     *
+     * @param sat [in] Satellite to name
+     * @param name [in] New name
+     */
+    void sat_set_name(Satellite sat, std::string_view name);
+
+    /**
+     * @return Name of a satellite, empty if it has none
+     */
+    std::string_view sat_get_name(Satellite sat) const;
+
+    /**
+     * Calculate position between two satellites. Satellites can be in any
+     * reference frame of the trajectory tree.
+     *
+     * Root-relative positions are cached, see sat_frames_update(). The cache
+     * is only used above the highest dirty satellite among the target and
+     * its ancestors, so positions are never stale, even between calls to
+     * sat_frames_update().
+     *
      * @param referenceFrame [in]
      * @param target [in]
      * @return relative position of target in SpaceInt vector
      */
     Vector3s sat_calc_pos(Satellite referenceFrame, Satellite target) const;
 
+    /**
+     * Calculate positions of many satellites relative to a single reference
+     * frame. The reference frame is only resolved once, and targets are read
+     * straight from the cache of sat_frames_update() while no satellites are
+     * dirty.
+     *
+     * @param referenceFrame [in]
+     * @param targets [in] Satellites to calculate positions of
+     * @param posOut [out] Relative positions, same size as targets
+     */
+    void sat_calc_pos(Satellite referenceFrame,
+                      Corrade::Containers::ArrayView<const Satellite> targets,
+                      Corrade::Containers::ArrayView<Vector3s> posOut) const;
+
     /**
      * Calculate position between two satellites.
      * @param referenceFrame [in]
@@ -115,6 +204,151 @@ public:
      */
     Vector3 sat_calc_pos_meters(Satellite referenceFrame, Satellite target) const;
 
+    /**
+     * Calculate positions of many satellites relative to a single reference
+     * frame, in meters. No allocations are made.
+     *
+     * While no satellites are dirty, positions are gathered straight from the
+     * SoA cache of sat_frames_update(), then subtracted and converted in a
+     * vectorized kernel. Satellites that aren't cached, and every satellite
+     * while some are dirty, walk up their ancestors like sat_calc_pos() does.
+     *
+     * @param referenceFrame [in]
+     * @param targets [in] Satellites to calculate positions of
+     * @param posOut [out] Relative positions in meters, same size as targets
+     */
+    void sat_calc_pos_meters(
+            Satellite referenceFrame,
+            Corrade::Containers::ArrayView<const Satellite> targets,
+            Corrade::Containers::ArrayView<Vector3> posOut) const;
+
+    /**
+     * Mark a satellite as modified, after changing its UCompTransformTraj or
+     * UCompActivatable. This sets m_dirty and adds it to the queue consumed
+     * by the next sat_frames_update(). Safe to call from trajectories that
+     * are updating in parallel, but locks on every call, so prefer the
+     * overload below when marking many satellites.
+     *
+     * @param sat [in] Satellite that was modified
+     */
+    void sat_mark_dirty(Satellite sat);
+
+    /**
+     * Mark many satellites as modified, locking only once
+     *
+     * @param sats [in] Satellites that were modified
+     */
+    void sat_mark_dirty(Corrade::Containers::ArrayView<const Satellite> sats);
+
+    /**
+     * @return Satellites marked dirty since the last sat_frames_update()
+     */
+    constexpr entt::sparse_set<Satellite> const& get_sats_dirty() const noexcept
+    { return m_satsDirty; }
+
+    /**
+     * Recalculate the cached root-relative positions of satellites marked
+     * dirty, and of satellites moved by trajectories centered on them. m_dirty
+     * is cleared and the queue is emptied afterwards. Work done scales with
+     * the number of changed satellites, not the number of satellites. Call
+     * this once after trajectories update.
+     */
+    void sat_frames_update();
+
+    /**
+     * @return Number of times sat_frames_update() was called, skipping 0 when
+     *         it wraps around
+     */
+    constexpr unsigned get_frames_pass() const noexcept { return m_framesPass; }
+
+    /**
+     * @return Satellites with root-relative positions changed by the last
+     *         sat_frames_update(), including newly created satellites
+     */
+    constexpr std::vector<Satellite> const& get_frames_changed() const noexcept
+    { return m_framesChanged; }
+
+    /**
+     * @return Satellites destroyed between the last two calls to
+     *         sat_frames_update()
+     */
+    constexpr std::vector<Satellite> const& get_frames_removed() const noexcept
+    { return m_framesRemoved; }
+
+    /**
+     * Move the universe to a new time, and update all trajectories on a
+     * worker pool, followed by sat_frames_update().
+     *
+     * Trajectories are grouped into levels by how many satellites between
+     * their center and the root are moved by trajectories. Levels run one
+     * after another, so a trajectory always updates after the ones moving
+     * its center's ancestors. Trajectories within a level run in parallel,
+     * and must only modify components of their own satellites. Trajectories
+     * that are parallel themselves, see
+     * ISystemTrajectory::is_update_parallel(), run one at a time after the
+     * rest of their level.
+     *
+     * @param time [in] New universe time in seconds
+     * @param rWorkers [in] Pool to run trajectory updates on
+     */
+    void update(double time, WorkerPool& rWorkers);
+
+    /**
+     * @return Number of times update() was called
+     */
+    constexpr uint64_t get_tick() const noexcept { return m_tick; }
+
+    constexpr UpdateTierConfig const& get_tier_config() const noexcept
+    { return m_tierConfig; }
+
+    void set_tier_config(UpdateTierConfig const& config) noexcept
+    { m_tierConfig = config; }
+
+    /**
+     * @return Root-relative positions of active areas, taken at the start of
+     *         the current update(). Trajectories pick update tiers by
+     *         distance to these.
+     */
+    constexpr std::vector<Vector3s> const& get_tier_focus() const noexcept
+    { return m_tierFocus; }
+
+    /**
+     * Spatial index of all satellites, positioned relative to the root. Kept
+     * up to date by sat_frames_update(), using the bounding radius from
+     * UCompActivatable if there is one.
+     */
+    constexpr SatSpatialIndex const& get_spatial_index() const noexcept
+    { return m_spatialIndex; }
+
+    /**
+     * Conjunction detector over satellites with a UCompActivatable, and
+     * active areas using their activate radius. Kept up to date by
+     * sat_frames_update(), so get_events() are for the last pass.
+     */
+    constexpr SatConjunctions const& get_conjunctions() const noexcept
+    { return m_conjunctions; }
+
+    /**
+     * Set how many seconds ahead to look for conjunctions, see
+     * SatConjunctions::set_lookahead
+     */
+    void set_conjunction_lookahead(double seconds) noexcept
+    { m_conjunctions.set_lookahead(seconds); }
+
+    /**
+     * Publish a copy of all satellites for other threads to read, see
+     * UniverseStateBuffer. Call after a frame of simulation is complete.
+     *
+     * @return false if skipped because readers hold every free slot
+     */
+    bool state_publish() { return m_stateBuffer.publish(*this); }
+
+    /**
+     * @return Published satellite states, safe to acquire() from any thread
+     */
+    constexpr UniverseStateBuffer const& get_state_buffer() const noexcept
+    { return m_stateBuffer; }
+
     /**
      * Register an ITypeSatellite so the universe can recognize that this type
      * of Satellite can exist.
@@ -127,6 +361,9 @@ public:
 
     /**
      * Tries to locate an element in the map of registered Satellites by name.
+     * Only meant for names from config files and such, prefer the typed
+     * sat_type_find() otherwise.
+     *
      * @param name [in] Name of ITypeSatellite
      * @return Map iterator directly from std::map::find()
      */
@@ -136,8 +373,9 @@ public:
     }
 
     /**
-     * Tries to locate an element in the map of registered Satellite by type,
-     * and casts it to SATTYPE_T
+     * Locate a registered Satellite type by its sat_type_index(), without any
+     * string lookups. SATTYPE_T must be registered.
+     *
      * @tparam SATTYPE_T Type of ITypeSatellite to find
      * @return Reference to satellite type found
      */
@@ -158,6 +396,66 @@ public:
 
 private:
 
+    /**
+     * Cache entry of a satellite, indexed by entity index. Written by
+     * sat_frames_update(). Its position relative to the root is kept apart in
+     * m_framesX/Y/Z, and read by sat_calc_pos().
+     */
+    struct SatFrame
+    {
+        // Satellite this entry was calculated for, detects recycled indices
+        Satellite m_sat{entt::null};
+
+        // Last sat_frames_update pass that visited this entry
+        unsigned m_pass{0};
+
+        // true if m_rootPos was recalculated during m_pass
+        bool m_changed{false};
+    };
+
+    /**
+     * Walk up the ancestors of a satellite to calculate its position relative
+     * to the root. Cached positions are used once every satellite further up
+     * is clean.
+     */
+    Vector3s sat_calc_root_pos(Satellite sat) const;
+
+    /**
+     * Position of a satellite relative to the root for batch calculations.
+     * Read from m_frames if allClean is set and the satellite was resolved,
+     * otherwise calculated with sat_calc_root_pos().
+     *
+     * @param sat [in] Satellite to find the position of
+     * @param allClean [in] True if no satellites are marked dirty
+     */
+    Vector3s sat_root_pos_gather(Satellite sat, bool allClean) const;
+
+    /**
+     * Resolve a satellite's cached position for the current pass of
+     * sat_frames_update(), resolving its ancestors first.
+     * @return true if the cached position changed
+     */
+    bool sat_frame_resolve(Satellite sat);
+
+    /**
+     * @return Cached position relative to the root of an entry in m_frames
+     */
+    Vector3s frame_root_pos(std::size_t index) const noexcept
+    {
+        return {m_framesX[index], m_framesY[index], m_framesZ[index]};
+    }
+
+    /**
+     * Connect registry signals and create pools viewed by parallel
+     * trajectory updates, needed again if the registry is replaced
+     */
+    void reg_connect();
+
+    /**
+     * Remove destroyed satellites from the spatial index and conjunctions
+     */
+    void on_sat_destroy(entt::basic_registry<Satellite>& reg, Satellite sat);
+
     //std::vector<Package> m_packages;
 
     //std::vector<Satellite> m_satellites;
@@ -165,12 +463,55 @@ private:
 
     Satellite m_root;
 
+    double m_time{0.0};
+    uint64_t m_tick{0};
+
+    UpdateTierConfig m_tierConfig;
+    std::vector<Vector3s> m_tierFocus;
+
     std::vector<std::unique_ptr<ISystemTrajectory>> m_trajectories;
 
+    // Trajectories grouped by level, see update(). Kept to reuse memory
+    std::vector<std::vector<ISystemTrajectory*>> m_trajLevels;
+
+    // Owns types, keyed by name
     MapSatType m_satTypes;
 
+    // Same types indexed by sat_type_index(), nullptr if not registered
+    std::vector<ITypeSatellite*> m_satTypesIndexed;
+
+    // Storage for UCompName
+    StringInterner m_names;
+
     entt::basic_registry<Satellite> m_registry;
 
+    std::vector<SatFrame> m_frames;
+
+    // Cached positions relative to the root, parallel to m_frames. Kept as
+    // SoA so batches convert them without reshuffling
+    std::vector<SpaceInt> m_framesX;
+    std::vector<SpaceInt> m_framesY;
+    std::vector<SpaceInt> m_framesZ;
+
+    unsigned m_framesPass{0};
+    std::vector<Satellite> m_framesChanged;
+    std::vector<Satellite> m_framesRemoved;
+
+    // Satellites destroyed since the last sat_frames_update()
+    std::vector<Satellite> m_satsRemoved;
+
+    // Satellites with m_dirty set, see sat_mark_dirty()
+    entt::sparse_set<Satellite> m_satsDirty;
+    std::mutex m_satsDirtyMutex;
+
+    // Trajectories already added to m_satsDirty by sat_frames_update()
+    std::vector<ISystemTrajectory const*> m_trajExpanded;
+
+    SatSpatialIndex m_spatialIndex;
+    SatConjunctions m_conjunctions;
+
+    UniverseStateBuffer m_stateBuffer;
+
 };
 
 
@@ -180,6 +521,14 @@ TYPESAT_T& Universe::type_register(ARGS_T&& ... args)
     std::unique_ptr<TYPESAT_T> newType
             = std::make_unique<TYPESAT_T>(std::forward<ARGS_T>(args)...);
     TYPESAT_T& toReturn = *newType;
+
+    SatTypeIndex_t const index = sat_type_index<TYPESAT_T>();
+    if (m_satTypesIndexed.size() <= index)
+    {
+        m_satTypesIndexed.resize(index + 1, nullptr);
+    }
+    m_satTypesIndexed[index] = newType.get();
+
     m_satTypes[newType->get_name()] = std::move(newType);
     return toReturn;
 }
@@ -187,9 +536,10 @@ TYPESAT_T& Universe::type_register(ARGS_T&& ... args)
 template<typename SATTYPE_T>
 SATTYPE_T& Universe::sat_type_find()
 {
-    MapSatType::iterator it = sat_type_find(SATTYPE_T::smc_name);
-    assert(it != m_satTypes.end());
-    return static_cast<SATTYPE_T&>(*it->second);
+    SatTypeIndex_t const index = sat_type_index<SATTYPE_T>();
+    assert(index < m_satTypesIndexed.size()
+           && m_satTypesIndexed[index] != nullptr);
+    return static_cast<SATTYPE_T&>(*m_satTypesIndexed[index]);
 }
 
 template<typename TRAJECTORY_T, typename ... ARGS_T>
@@ -214,14 +564,26 @@ struct UCompTransformTraj
 
     Satellite m_parent; // Set only by trajectory
 
-    ISystemTrajectory *m_trajectory{nullptr}; // get rid of this some day
-    unsigned m_index; // index in trajectory's vector
-
-    // set this to true when you modify something the trajectory might use
+    // Set by Universe::sat_mark_dirty, don't set this directly
     bool m_dirty{true};
+};
+
+/**
+ * Trajectory moving a satellite. Kept apart from UCompTransformTraj so
+ * position sweeps don't have to stream it.
+ */
+struct UCompTrajectory
+{
+    ISystemTrajectory *m_trajectory{nullptr}; // get rid of this some day
+    unsigned m_index{0}; // index in trajectory's vector
+};
 
-    // move this somewhere else eventually
-    std::string m_name;
+/**
+ * Name of a satellite, see Universe::sat_set_name
+ */
+struct UCompName
+{
+    shared_string m_name;
 };
 
 //struct ACompActivated
@@ -241,10 +603,33 @@ struct UCompType
     ITypeSatellite* m_type{nullptr};
 };
 
+/**
+ * Hint for trajectories that update far away satellites less often, see
+ * UpdateTierConfig
+ */
+struct UCompUpdatePriority
+{
+    // Highest tier the satellite can be put in. 0 updates it every tick
+    uint8_t m_tierMax{0};
+};
+
 struct UCompActivatable
 {
-    // put something here some day
-    int m_dummy;
+    // Load radius in meters. The satellite is activated when an active
+    // area's activate radius reaches this sphere, and deactivated when it
+    // leaves the deactivate radius. Call Universe::sat_mark_dirty after
+    // changing this
+    float m_radius{0.0f};
+};
+
+struct UCompGravity
+{
+    // Standard gravitational parameter GM in m^3/s^2
+    double m_gravParam{0.0};
+
+    // Sphere of influence radius in meters. Within it, orbits are patched
+    // conics around this satellite, see TrajectoryPredictor
+    double m_soiRadius{0.0};
 };
 
 
@@ -259,6 +644,18 @@ public:
 
     virtual void add(Satellite sat) = 0;
     virtual void remove(Satellite sat) = 0;
+
+    /**
+     * Add many satellites. Types that can do better than adding one at a
+     * time should override this.
+     */
+    virtual void add(Corrade::Containers::ArrayView<const Satellite> sats)
+    {
+        for (Satellite sat : sats)
+        {
+            add(sat);
+        }
+    }
 };
 
 
@@ -277,6 +674,12 @@ public:
     ~CommonTypeSat() = default;
 
     virtual void add(Satellite sat) { add_get_ucomp(sat); };
+
+    /**
+     * Add many satellites, inserting each component type in bulk
+     */
+    void add(Corrade::Containers::ArrayView<const Satellite> sats) override;
+
     virtual void remove(Satellite sat) override;
 
     std::tuple<UCOMP_T& ...> add_get_ucomp_all(Satellite sat);
@@ -317,6 +720,23 @@ auto& CommonTypeSat<TYPESAT_T, UCOMP_T ...>::add_get_ucomp(Satellite sat)
     return std::get<0>(std::forward_as_tuple((m_universe.get_reg().emplace<UCOMP_T>(sat)) ...));
 }
 
+template<typename TYPESAT_T, typename ... UCOMP_T>
+void CommonTypeSat<TYPESAT_T, UCOMP_T ...>::add(
+        Corrade::Containers::ArrayView<const Satellite> sats)
+{
+    auto &reg = m_universe.get_reg();
+    auto view = reg.template view<UCompType>();
+
+    for (Satellite sat : sats)
+    {
+        view.get(sat).m_type = this;
+    }
+
+    (reg.template reserve<UCOMP_T>(reg.template size<UCOMP_T>() + sats.size()),
+     ...);
+    (reg.template insert<UCOMP_T>(sats.begin(), sats.end()), ...);
+}
+
 template<typename TYPESAT_T, typename ... UCOMP_T>
 void CommonTypeSat<TYPESAT_T, UCOMP_T ...>::remove(Satellite sat)
 {
@@ -343,9 +763,57 @@ public:
     virtual ~ISystemTrajectory() = default;
     virtual void update() = 0;
     virtual void add(Satellite sat) = 0;
+    virtual void add(Corrade::Containers::ArrayView<const Satellite> sats) = 0;
     virtual void remove(Satellite sat) = 0;
+    virtual void remove(Corrade::Containers::ArrayView<const Satellite> sats) = 0;
     virtual Satellite get_center() const = 0;
 
+    /**
+     * @return Satellites moved by this trajectory
+     */
+    virtual std::vector<Satellite> const& get_satellites() const = 0;
+
+    /**
+     * Predict the state of a satellite of this trajectory at any time, for
+     * trajectories that know where their satellites will be
+     *
+     * @param sat [in] Satellite of this trajectory
+     * @param time [in] Universe time in seconds
+     * @param rPos [out] Position relative to the center in meters
+     * @param rVel [out] Velocity relative to the center in m/s
+     *
+     * @return true if predicted, false if this trajectory can't predict
+     */
+    virtual bool predict_state(Satellite sat, double time,
+                               Vector3d &rPos, Vector3d &rVel)
+    { return false; }
+
+    /**
+     * @return true if update() splits its own work across a WorkerPool. These
+     *         are updated one at a time on the thread calling
+     *         Universe::update(), as a pool runs nested work serially
+     */
+    virtual bool is_update_parallel() const { return false; }
+
+    /**
+     * Write state that can't be recalculated from the satellites' transforms
+     * and velocities, such as orbits or masses. Called between
+     * SnapshotWriter::chunk_begin and chunk_end, see snapshot_save.
+     */
+    virtual void snapshot_save(SnapshotWriter& rWriter) { }
+
+    /**
+     * Restore state written by snapshot_save. Called after the saved
+     * satellites are re-added to this trajectory.
+     *
+     * @param data [in] Payload written by snapshot_save
+     *
+     * @return 0 on success, 1 if the payload doesn't match
+     */
+    virtual int snapshot_load(
+            Corrade::Containers::ArrayView<const unsigned char> data)
+    { return 0; }
+
     virtual TrajectoryType get_type() = 0;
     virtual std::string const& get_type_name() = 0;
 
@@ -367,8 +835,24 @@ public:
     ~CommonTrajectory() = default;
 
     virtual void add(Satellite sat) override;
+
+    /**
+     * Add many satellites, reserving space once
+     */
+    virtual void add(Corrade::Containers::ArrayView<const Satellite> sats) override;
+
+    /**
+     * Remove a satellite in constant time. The last satellite is moved into
+     * its place, so the order of get_satellites() changes.
+     */
     virtual void remove(Satellite sat) override;
 
+    /**
+     * Remove many satellites in a single sweep over get_satellites(). The
+     * order of the remaining satellites is kept.
+     */
+    virtual void remove(Corrade::Containers::ArrayView<const Satellite> sats) override;
+
     TrajectoryType get_type() override
     {
         static auto id = entt::type_info<TRAJECTORY_T>::id();
@@ -385,45 +869,229 @@ public:
 
     constexpr Universe& get_universe() const { return m_universe; }
     constexpr std::vector<Satellite>& get_satellites() { return m_satellites; }
+    std::vector<Satellite> const& get_satellites() const override
+    { return m_satellites; }
+
+protected:
+
+    /**
+     * Put get_satellites() in a saved order, for snapshot_load. Data parallel
+     * to get_satellites() isn't moved, and must be loaded afterwards.
+     *
+     * @param sats [in] Every satellite of this trajectory, in the new order
+     *
+     * @return false if sats aren't exactly the satellites of this trajectory
+     */
+    bool satellites_reorder(
+            Corrade::Containers::ArrayView<const Satellite> sats);
+
+    // Trajectories that store data parallel to get_satellites() hide these
+    // to keep their data in sync when satellites are added or removed
+
+    /**
+     * Reserve space for a number of satellites
+     */
+    void data_reserve(std::size_t /* size */) { }
+
+    /**
+     * Move data of the satellite at index 'from' to index 'to'
+     */
+    void data_move(std::size_t /* from */, std::size_t /* to */) { }
+
+    /**
+     * Shrink data after removing satellites
+     */
+    void data_resize(std::size_t /* size */) { }
 
 private:
 
+    constexpr TRAJECTORY_T& derived()
+    { return static_cast<TRAJECTORY_T&>(*this); }
+
     Universe& m_universe;
     Satellite m_center;
     std::vector<Satellite> m_satellites;
+
+    // Satellites added by add(span) or removed by remove(span), to mark
+    // dirty in a single call. Kept to reuse memory
+    std::vector<Satellite> m_batch;
+
+    // Set while add(span) is running
+    bool m_batching{false};
 };
 
 template<typename TRAJECTORY_T>
 void CommonTrajectory<TRAJECTORY_T>::add(Satellite sat)
 {
-    auto &posTraj = m_universe.get_reg().get<UCompTransformTraj>(sat);
+    auto &reg = m_universe.get_reg();
+    auto &traj = reg.get<UCompTrajectory>(sat);
 
-    if (posTraj.m_trajectory)
+    if (traj.m_trajectory)
     {
         return; // already part of trajectory
     }
 
-    posTraj.m_trajectory = this;
-    posTraj.m_index = m_satellites.size();
-    posTraj.m_parent = m_center;
+    traj.m_trajectory = this;
+    traj.m_index = m_satellites.size();
+    reg.get<UCompTransformTraj>(sat).m_parent = m_center;
     m_satellites.push_back(sat);
+
+    if (m_batching)
+    {
+        m_batch.push_back(sat); // marked all at once by add(span)
+    }
+    else
+    {
+        m_universe.sat_mark_dirty(sat);
+    }
+}
+
+template<typename TRAJECTORY_T>
+void CommonTrajectory<TRAJECTORY_T>::add(
+        Corrade::Containers::ArrayView<const Satellite> sats)
+{
+    std::size_t const size = m_satellites.size() + sats.size();
+    m_satellites.reserve(size);
+    derived().data_reserve(size);
+
+    // add(sat) may be overridden, so call it for each satellite, but collect
+    // them to mark dirty while locking only once
+    m_batch.clear();
+    m_batching = true;
+    for (Satellite sat : sats)
+    {
+        add(sat);
+    }
+    m_batching = false;
+
+    m_universe.sat_mark_dirty({m_batch.data(), m_batch.size()});
+}
+
+template<typename TRAJECTORY_T>
+bool CommonTrajectory<TRAJECTORY_T>::satellites_reorder(
+        Corrade::Containers::ArrayView<const Satellite> sats)
+{
+    if (sats.size() != m_satellites.size())
+    {
+        return false;
+    }
+
+    auto &reg = m_universe.get_reg();
+    auto view = reg.view<UCompTrajectory>();
+
+    // Each satellite must be part of this trajectory, and appear only once
+    std::vector<bool> seen(sats.size(), false);
+    for (Satellite sat : sats)
+    {
+        if (!reg.valid(sat) || !view.contains(sat))
+        {
+            return false;
+        }
+
+        auto const &traj = view.get(sat);
+
+        if (traj.m_trajectory != this || seen[traj.m_index])
+        {
+            return false;
+        }
+        seen[traj.m_index] = true;
+    }
+
+    for (std::size_t i = 0; i < sats.size(); i ++)
+    {
+        m_satellites[i] = sats[i];
+        view.get(sats[i]).m_index = i;
+    }
+
+    return true;
 }
 
 template<typename TRAJECTORY_T>
 void CommonTrajectory<TRAJECTORY_T>::remove(Satellite sat)
 {
-    auto &posTraj = m_universe.get_reg().get<UCompTransformTraj>(sat);
+    auto &reg = m_universe.get_reg();
+    auto view = reg.view<UCompTrajectory>();
+    auto &traj = view.get(sat);
 
-    if (posTraj.m_trajectory != this)
+    if (traj.m_trajectory != this)
     {
         return; // not associated with this satellite
     }
 
-    m_satellites.erase(m_satellites.begin() + posTraj.m_index);
+    std::size_t const index = traj.m_index;
+    std::size_t const last = m_satellites.size() - 1;
+
+    if (index != last)
+    {
+        // move the last satellite into the removed one's place
+        Satellite const moved = m_satellites[last];
+        m_satellites[index] = moved;
+        view.get(moved).m_index = index;
+        derived().data_move(last, index);
+    }
+
+    m_satellites.pop_back();
+    derived().data_resize(last);
 
     // disassociate with this satellite
-    posTraj.m_parent = entt::null;
-    posTraj.m_trajectory = nullptr;
+    reg.get<UCompTransformTraj>(sat).m_parent = entt::null;
+    traj.m_trajectory = nullptr;
+    m_universe.sat_mark_dirty(sat);
+}
+
+template<typename TRAJECTORY_T>
+void CommonTrajectory<TRAJECTORY_T>::remove(
+        Corrade::Containers::ArrayView<const Satellite> sats)
+{
+    auto &reg = m_universe.get_reg();
+    auto view = reg.view<UCompTrajectory>();
+    auto viewTransform = reg.view<UCompTransformTraj>();
+
+    // disassociate first, so the sweep below can tell which ones to drop
+    m_batch.clear();
+    for (Satellite sat : sats)
+    {
+        auto &traj = view.get(sat);
+
+        if (traj.m_trajectory == this)
+        {
+            viewTransform.get(sat).m_parent = entt::null;
+            traj.m_trajectory = nullptr;
+            m_batch.push_back(sat);
+        }
+    }
+
+    if (m_batch.empty())
+    {
+        return;
+    }
+
+    // only mark the satellites that were actually part of this trajectory
+    m_universe.sat_mark_dirty({m_batch.data(), m_batch.size()});
+
+    // shift remaining satellites down over the removed ones
+    std::size_t to = 0;
+    for (std::size_t from = 0; from < m_satellites.size(); from ++)
+    {
+        Satellite const sat = m_satellites[from];
+        auto &traj = view.get(sat);
+
+        if (traj.m_trajectory != this)
+        {
+            continue;
+        }
+
+        if (from != to)
+        {
+            m_satellites[to] = sat;
+            traj.m_index = to;
+            derived().data_move(from, to);
+        }
+        to ++;
+    }
+
+    m_satellites.resize(to);
+    derived().data_resize(to);
 }
 
 }
@@ -0,0 +1,760 @@
+/**
+ * Open Space Program
+ * Copyright © 2019-2020 Open Space Program Project
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "UniversePrediction.h"
+#include "Universe.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace osp::universe;
+using namespace osp;
+
+namespace
+{
+
+constexpr double c_tau = 6.28318530717958647692;
+
+// Shortest step when marching towards a crossing, in seconds
+constexpr double c_stepMin = 1.0;
+
+// Most steps to march through a single segment
+constexpr int c_stepsMax = 4096;
+
+// How precisely to find the time of a crossing, in seconds
+constexpr double c_crossingPrecision = 1.0e-3;
+
+std::vector<ConicSegment> const g_noSegments;
+
+/**
+ * Stumpff functions C(z) and S(z), used by the universal Kepler equation
+ */
+void stumpff(double z, double &rC, double &rS)
+{
+    if (z > 1.0e-3)
+    {
+        double const s = std::sqrt(z);
+        rC = (1.0 - std::cos(s)) / z;
+        rS = (s - std::sin(s)) / (s * z);
+    }
+    else if (z < -1.0e-3)
+    {
+        double const s = std::sqrt(-z);
+        rC = (std::cosh(s) - 1.0) / -z;
+        rS = (std::sinh(s) - s) / (s * -z);
+    }
+    else
+    {
+        // Series, as the above lose precision near 0
+        rC = 1.0 / 2.0 - z / 24.0 + z * z / 720.0;
+        rS = 1.0 / 6.0 - z / 120.0 + z * z / 5040.0;
+    }
+}
+
+/**
+ * @return Fastest speed along a conic, which is at periapsis
+ */
+double conic_speed_max(Vector3d r, Vector3d v, double gravParam)
+{
+    double const speed = v.length();
+    double const rLen = r.length();
+    Vector3d const hVec = Magnum::Math::cross(r, v);
+    double const h = hVec.length();
+
+    if (speed == 0.0 || rLen == 0.0)
+    {
+        return speed;
+    }
+
+    if (h <= 1.0e-9 * rLen * speed)
+    {
+        // Falling straight in or out, no periapsis. Use the speed it would
+        // have fallen from infinity with, which is at least as fast
+        return std::sqrt(speed * speed + 2.0 * gravParam / rLen);
+    }
+
+    double const e = (Magnum::Math::cross(v, hVec) / gravParam
+                      - r / rLen).length();
+    return std::max(speed, gravParam * (1.0 + e) / h);
+}
+
+/**
+ * @return true if a conic is an ellipse that never leaves a sphere around
+ *         its center
+ */
+bool conic_within(Vector3d r, Vector3d v, double gravParam, double radius)
+{
+    double const rLen = r.length();
+    double const alpha = 2.0 / rLen - v.dot() / gravParam;
+
+    if (rLen == 0.0 || alpha <= 0.0)
+    {
+        return false;
+    }
+
+    double const a = 1.0 / alpha;
+    double const h = Magnum::Math::cross(r, v).length();
+    double const e = std::sqrt(std::max(0.0, 1.0 - h * h / (gravParam * a)));
+    return a * (1.0 + e) < radius;
+}
+
+}
+
+void ConicSegment::state_at(double time, Vector3d &rPos, Vector3d &rVel) const
+{
+    Vector3d const r0 = m_position;
+    Vector3d const v0 = m_velocity;
+    double const r0Len = r0.length();
+    double const mu = m_gravParam;
+    double dt = time - m_timeStart;
+
+    if (mu <= 0.0 || r0Len == 0.0)
+    {
+        // Nothing to orbit, move in a straight line
+        rPos = r0 + v0 * dt;
+        rVel = v0;
+        return;
+    }
+
+    double const sqrtMu = std::sqrt(mu);
+    double const rv0 = Magnum::Math::dot(r0, v0) / sqrtMu;
+    double const alpha = 2.0 / r0Len - v0.dot() / mu; // 1 / semi-major axis
+
+    if (alpha > 0.0)
+    {
+        // Ellipses repeat, stay within one period so Newton starts close
+        double const period = c_tau / std::sqrt(mu * alpha * alpha * alpha);
+        dt = std::remainder(dt, period);
+    }
+
+    // Initial guess for the universal anomaly
+    double chi = sqrtMu * dt / r0Len;
+    if (alpha > 1.0e-12 / r0Len)
+    {
+        chi = sqrtMu * alpha * dt;
+    }
+    else if (alpha < -1.0e-12 / r0Len)
+    {
+        double const a = 1.0 / alpha;
+        double const sign = std::copysign(1.0, dt);
+        double const arg = -2.0 * mu * alpha * dt
+                / (Magnum::Math::dot(r0, v0)
+                   + sign * std::sqrt(-mu * a) * (1.0 - r0Len * alpha));
+        if (arg > 0.0)
+        {
+            chi = sign * std::sqrt(-a) * std::log(arg);
+        }
+    }
+
+    // Newton's method on the universal Kepler equation. Its derivative is
+    // the distance, so it's always increasing
+    double c = 0.5;
+    double s = 1.0 / 6.0;
+    for (int i = 0; i < 64; i ++)
+    {
+        double const chi2 = chi * chi;
+        stumpff(alpha * chi2, c, s);
+
+        double const f = rv0 * chi2 * c + (1.0 - alpha * r0Len) * chi2 * chi * s
+                       + r0Len * chi - sqrtMu * dt;
+        double const df = rv0 * chi * (1.0 - alpha * chi2 * s)
+                        + (1.0 - alpha * r0Len) * chi2 * c + r0Len;
+        double const step = f / df;
+        chi -= step;
+
+        if (std::abs(step) <= 1.0e-13 * std::max(1.0, std::abs(chi)))
+        {
+            break;
+        }
+    }
+
+    double const chi2 = chi * chi;
+    double const z = alpha * chi2;
+    stumpff(z, c, s);
+
+    // Lagrange coefficients
+    double const f = 1.0 - chi2 / r0Len * c;
+    double const g = dt - chi2 * chi / sqrtMu * s;
+    rPos = r0 * f + v0 * g;
+
+    double const rLen = rPos.length();
+    double const fDot = sqrtMu / (rLen * r0Len) * (z * s - 1.0) * chi;
+    double const gDot = 1.0 - chi2 / rLen * c;
+    rVel = r0 * fDot + v0 * gDot;
+}
+
+TrajectoryPredictor::TrajectoryPredictor(Universe& rUniverse)
+ : m_universe(rUniverse)
+ , m_bodiesTime(rUniverse.get_time())
+{ }
+
+std::vector<ConicSegment> const& TrajectoryPredictor::predict(Satellite sat)
+{
+    if (!m_universe.get_reg().valid(sat))
+    {
+        m_predictions.erase(sat);
+        return g_noSegments;
+    }
+
+    bodies_refresh();
+
+    double const now = m_universe.get_time();
+    std::vector<ConicSegment> &rSegs = m_predictions[sat];
+
+    if (!rSegs.empty())
+    {
+        // Drop segments that already ended, but keep the last one to
+        // extend from
+        auto itFirst = std::find_if(
+                rSegs.begin(), rSegs.end(), [now] (ConicSegment const& seg)
+        {
+            return seg.m_timeEnd >= now;
+        });
+
+        if (itFirst == rSegs.end())
+        {
+            if (rSegs.back().m_bodyNext != entt::null)
+            {
+                itFirst = rSegs.end(); // cut off by smc_segmentsMax, restart
+            }
+            else
+            {
+                itFirst = std::prev(rSegs.end());
+            }
+        }
+        rSegs.erase(rSegs.begin(), itFirst);
+
+        bool const bodiesGone = std::any_of(
+                rSegs.begin(), rSegs.end(), [this] (ConicSegment const& seg)
+        {
+            return m_bodies.find(seg.m_body) == m_bodies.end();
+        });
+
+        if (bodiesGone)
+        {
+            rSegs.clear();
+        }
+    }
+
+    if (!rSegs.empty())
+    {
+        // Check if the satellite is still where it's predicted to be
+        ConicSegment const &seg = rSegs.front();
+        Vector3d predPos, predVel, pos, vel;
+        seg.state_at(now, predPos, predVel);
+        state_relative(sat, seg.m_body, now, pos, vel);
+
+        bool const strayed
+                = (pos - predPos).length()
+                        > m_tolerancePos + 1.0e-6 * predPos.length()
+               || (vel - predVel).length()
+                        > m_toleranceVel + 1.0e-6 * predVel.length();
+
+        if (strayed)
+        {
+            rSegs.clear();
+        }
+    }
+
+    if (rSegs.empty() && !prediction_start(sat, rSegs))
+    {
+        m_predictions.erase(sat);
+        return g_noSegments;
+    }
+
+    if (rSegs.back().m_timeEnd < now + 0.5 * m_horizon)
+    {
+        prediction_extend(rSegs, now + m_horizon);
+    }
+
+    return rSegs;
+}
+
+void TrajectoryPredictor::invalidate(Satellite sat)
+{
+    m_predictions.erase(sat);
+}
+
+void TrajectoryPredictor::invalidate_body(Satellite body)
+{
+    for (auto &[sat, rSegs] : m_predictions)
+    {
+        prediction_truncate(rSegs, body, m_bodies);
+    }
+}
+
+void TrajectoryPredictor::forget(Satellite sat)
+{
+    m_predictions.erase(sat);
+}
+
+void TrajectoryPredictor::clear()
+{
+    m_predictions.clear();
+    m_bodies.clear();
+    m_bodiesBuilt = false;
+}
+
+void TrajectoryPredictor::bodies_refresh()
+{
+    double const now = m_universe.get_time();
+
+    if (m_bodiesBuilt && m_bodiesTime == now)
+    {
+        return;
+    }
+
+    auto &reg = m_universe.get_reg();
+
+    Bodies_t bodies;
+    auto view = reg.view<UCompGravity>();
+    for (Satellite sat : view)
+    {
+        auto const &gravity = view.get(sat);
+        Body &rBody = bodies[sat];
+        rBody.m_gravParam = gravity.m_gravParam;
+        rBody.m_soiRadius = gravity.m_soiRadius;
+    }
+
+    for (auto &[sat, rBody] : bodies)
+    {
+        rBody.m_parent = body_find(sat, bodies);
+        if (rBody.m_parent != entt::null)
+        {
+            bodies[rBody.m_parent].m_children.push_back(sat);
+        }
+    }
+
+    if (m_bodiesBuilt)
+    {
+        // Cut predictions at bodies that were added, removed, or changed
+        auto const changed = [] (Body const& a, Body const& b)
+        {
+            return a.m_parent != b.m_parent
+                || a.m_gravParam != b.m_gravParam
+                || a.m_soiRadius != b.m_soiRadius;
+        };
+
+        for (auto const &[sat, body] : m_bodies)
+        {
+            auto const itNew = bodies.find(sat);
+            if (itNew == bodies.end() || changed(body, itNew->second))
+            {
+                invalidate_body(sat);
+            }
+        }
+
+        for (auto const &[sat, body] : bodies)
+        {
+            auto const itOld = m_bodies.find(sat);
+            if (itOld == m_bodies.end() || changed(body, itOld->second))
+            {
+                for (auto &[predSat, rSegs] : m_predictions)
+                {
+                    prediction_truncate(rSegs, sat, bodies);
+                }
+            }
+        }
+    }
+
+    m_bodies = std::move(bodies);
+    m_bodiesTime = now;
+    m_bodiesBuilt = true;
+}
+
+Satellite TrajectoryPredictor::body_find(
+        Satellite sat, Bodies_t const& bodies) const
+{
+    auto const &reg = m_universe.get_reg();
+    Satellite const root = m_universe.sat_root();
+
+    if (sat == root)
+    {
+        return entt::null;
+    }
+
+    Satellite curr = reg.get<UCompTransformTraj>(sat).m_parent;
+    while (curr != entt::null)
+    {
+        if (bodies.find(curr) != bodies.end())
+        {
+            return curr;
+        }
+
+        if (curr == root)
+        {
+            break;
+        }
+        curr = reg.get<UCompTransformTraj>(curr).m_parent;
+    }
+    return entt::null;
+}
+
+void TrajectoryPredictor::state_relative(
+        Satellite sat, Satellite frame, double time,
+        Vector3d &rPos, Vector3d &rVel)
+{
+    auto &reg = m_universe.get_reg();
+    Satellite const root = m_universe.sat_root();
+    double const now = m_universe.get_time();
+
+    rPos = {0.0, 0.0, 0.0};
+    rVel = {0.0, 0.0, 0.0};
+
+    Satellite curr = sat;
+    while (curr != frame && curr != root && curr != entt::null)
+    {
+        auto const &posTraj = reg.get<UCompTransformTraj>(curr);
+        auto const *pTraj = reg.try_get<UCompTrajectory>(curr);
+
+        Vector3d pos, vel;
+        bool const predicted
+                = pTraj != nullptr && pTraj->m_trajectory != nullptr
+               && pTraj->m_trajectory->predict_state(curr, time, pos, vel);
+
+        if (!predicted)
+        {
+            // Extrapolate along the current velocity
+            vel = {0.0, 0.0, 0.0};
+            if (auto const *pVel = reg.try_get<UCompVelocity>(curr))
+            {
+                vel = Vector3d(pVel->m_velocity);
+            }
+            pos = Vector3d(posTraj.m_position) / double(gc_units_per_meter)
+                + vel * (time - now);
+        }
+
+        rPos += pos;
+        rVel += vel;
+        curr = posTraj.m_parent;
+    }
+
+    if (curr != frame && frame != root && frame != entt::null)
+    {
+        // Frame isn't an ancestor, go through the root
+        Vector3d framePos, frameVel;
+        state_relative(frame, entt::null, time, framePos, frameVel);
+        rPos -= framePos;
+        rVel -= frameVel;
+    }
+}
+
+bool TrajectoryPredictor::prediction_start(
+        Satellite sat, std::vector<ConicSegment> &rSegs)
+{
+    double const now = m_universe.get_time();
+
+    Satellite body = body_find(sat, m_bodies);
+    if (body == entt::null)
+    {
+        return false;
+    }
+
+    Vector3d r, v;
+    state_relative(sat, body, now, r, v);
+
+    // Climb out of spheres of influence the satellite is outside of
+    while (true)
+    {
+        Body const &current = m_bodies.at(body);
+        if (current.m_parent == entt::null
+            || r.length() <= current.m_soiRadius)
+        {
+            break;
+        }
+
+        Vector3d bodyPos, bodyVel;
+        state_relative(body, current.m_parent, now, bodyPos, bodyVel);
+        r += bodyPos;
+        v += bodyVel;
+        body = current.m_parent;
+    }
+
+    // Descend into spheres of influence the satellite is inside of
+    bool descended = true;
+    while (descended)
+    {
+        descended = false;
+        for (Satellite child : m_bodies.at(body).m_children)
+        {
+            if (child == sat)
+            {
+                continue;
+            }
+
+            Vector3d childPos, childVel;
+            state_relative(child, body, now, childPos, childVel);
+            if ((r - childPos).length() < m_bodies.at(child).m_soiRadius)
+            {
+                r -= childPos;
+                v -= childVel;
+                body = child;
+                descended = true;
+                break;
+            }
+        }
+    }
+
+    ConicSegment seg;
+    seg.m_body = body;
+    seg.m_gravParam = m_bodies.at(body).m_gravParam;
+    seg.m_timeStart = now;
+    seg.m_timeEnd = now;
+    seg.m_position = r;
+    seg.m_velocity = v;
+
+    rSegs.assign(1, seg);
+    m_segmentsComputed ++;
+    return true;
+}
+
+void TrajectoryPredictor::prediction_extend(
+        std::vector<ConicSegment> &rSegs, double timeEnd)
+{
+    while (!rSegs.empty())
+    {
+        ConicSegment &rSeg = rSegs.back();
+
+        if (rSeg.m_bodyNext != entt::null || rSeg.m_timeEnd >= timeEnd)
+        {
+            return; // cut off by smc_segmentsMax, or long enough
+        }
+
+        Satellite next;
+        double const time = segment_march(rSeg, rSeg.m_timeEnd, timeEnd,
+                                          next);
+        rSeg.m_timeEnd = time;
+
+        if (next == entt::null)
+        {
+            return;
+        }
+
+        rSeg.m_bodyNext = next;
+
+        if (rSegs.size() >= smc_segmentsMax)
+        {
+            return;
+        }
+
+        // Switch the state over to the next body
+        Vector3d r, v;
+        rSeg.state_at(time, r, v);
+
+        Vector3d bodyPos, bodyVel;
+        if (next == m_bodies.at(rSeg.m_body).m_parent)
+        {
+            state_relative(rSeg.m_body, next, time, bodyPos, bodyVel);
+            r += bodyPos;
+            v += bodyVel;
+        }
+        else
+        {
+            state_relative(next, rSeg.m_body, time, bodyPos, bodyVel);
+            r -= bodyPos;
+            v -= bodyVel;
+        }
+
+        ConicSegment seg;
+        seg.m_body = next;
+        seg.m_gravParam = m_bodies.at(next).m_gravParam;
+        seg.m_timeStart = time;
+        seg.m_timeEnd = time;
+        seg.m_position = r;
+        seg.m_velocity = v;
+
+        rSegs.push_back(seg); // invalidates rSeg
+        m_segmentsComputed ++;
+    }
+}
+
+void TrajectoryPredictor::prediction_truncate(
+        std::vector<ConicSegment> &rSegs, Satellite body,
+        Bodies_t const& bodies)
+{
+    auto const itBody = bodies.find(body);
+
+    auto const depends = [&] (ConicSegment const& seg)
+    {
+        if (seg.m_body == body)
+        {
+            return true;
+        }
+
+        // Segments check crossings with the parent and children of the
+        // body they orbit
+        auto const itSegBody = bodies.find(seg.m_body);
+        return (itSegBody != bodies.end()
+                && itSegBody->second.m_parent == body)
+            || (itBody != bodies.end()
+                && itBody->second.m_parent == seg.m_body);
+    };
+
+    auto const itFirst = std::find_if(rSegs.begin(), rSegs.end(), depends);
+
+    if (itFirst == rSegs.end())
+    {
+        return;
+    }
+
+    rSegs.erase(std::next(itFirst), rSegs.end());
+    rSegs.back().m_timeEnd = rSegs.back().m_timeStart;
+    rSegs.back().m_bodyNext = entt::null;
+}
+
+double TrajectoryPredictor::segment_march(
+        ConicSegment const& seg, double time, double timeEnd,
+        Satellite &rNext)
+{
+    rNext = entt::null;
+
+    Body const &body = m_bodies.at(seg.m_body);
+    double const mu = seg.m_gravParam;
+
+    struct Crossing
+    {
+        Satellite m_next;
+        double m_radius;
+        double m_speedMax; // Fastest the sphere itself moves
+        bool m_exit;
+        bool m_armed;
+    };
+
+    std::vector<Crossing> crossings;
+
+    // Leaving the sphere of influence, unless the orbit stays inside
+    if (body.m_parent != entt::null
+        && !conic_within(seg.m_position, seg.m_velocity, mu,
+                         body.m_soiRadius))
+    {
+        crossings.push_back({body.m_parent, body.m_soiRadius, 0.0,
+                             true, true});
+    }
+
+    // Entering the sphere of influence of a child
+    for (Satellite child : body.m_children)
+    {
+        Vector3d childPos, childVel;
+        state_relative(child, seg.m_body, time, childPos, childVel);
+        crossings.push_back({child, m_bodies.at(child).m_soiRadius,
+                             conic_speed_max(childPos, childVel, mu),
+                             false, true});
+    }
+
+    if (crossings.empty())
+    {
+        return timeEnd;
+    }
+
+    double const speedMax = conic_speed_max(seg.m_position, seg.m_velocity,
+                                            mu);
+
+    // Distance to a sphere's surface, negative once crossed
+    auto const margin = [this, &seg] (Crossing const& crossing, double t)
+    {
+        Vector3d r, v;
+        seg.state_at(t, r, v);
+
+        if (crossing.m_exit)
+        {
+            return crossing.m_radius - r.length();
+        }
+
+        Vector3d childPos, childVel;
+        state_relative(crossing.m_next, seg.m_body, t, childPos, childVel);
+        return (r - childPos).length() - crossing.m_radius;
+    };
+
+    // Spheres already crossed at the start don't count until they're left,
+    // such as the sphere that was just entered
+    for (Crossing &rCrossing : crossings)
+    {
+        rCrossing.m_armed = margin(rCrossing, time) >= 0.0;
+    }
+
+    // March forward by the time it takes to close the smallest margin at
+    // the fastest speeds possible, so no crossing is stepped over
+    double timePrev = time;
+    double t = time;
+    for (int step = 0; step < c_stepsMax; step ++)
+    {
+        double dt = std::numeric_limits<double>::max();
+        double crossedTime = std::numeric_limits<double>::max();
+
+        for (Crossing &rCrossing : crossings)
+        {
+            double const m = margin(rCrossing, t);
+
+            if (!rCrossing.m_armed)
+            {
+                rCrossing.m_armed = m >= 0.0;
+                continue;
+            }
+
+            if (m >= 0.0)
+            {
+                dt = std::min(dt, m / (speedMax + rCrossing.m_speedMax));
+                continue;
+            }
+
+            // Crossed since the last step, bisect for when
+            double lo = timePrev;
+            double hi = t;
+            while (hi - lo > c_crossingPrecision)
+            {
+                double const mid = 0.5 * (lo + hi);
+                if (margin(rCrossing, mid) >= 0.0)
+                {
+                    lo = mid;
+                }
+                else
+                {
+                    hi = mid;
+                }
+            }
+
+            if (hi < crossedTime)
+            {
+                crossedTime = hi;
+                rNext = rCrossing.m_next;
+            }
+        }
+
+        if (rNext != entt::null)
+        {
+            return crossedTime;
+        }
+
+        if (t >= timeEnd)
+        {
+            return timeEnd;
+        }
+
+        timePrev = t;
+        t = std::min(timeEnd, t + std::max(dt, c_stepMin));
+    }
+
+    return t;
+}
@@ -0,0 +1,239 @@
+/**
+ * Open Space Program
+ * Copyright © 2019-2020 Open Space Program Project
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+
+#include "types.h"
+#include "universetypes.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace osp::universe
+{
+
+class Universe;
+
+/**
+ * One conic of a patched-conic prediction. Any conic works, including
+ * hyperbolic escapes, as it's propagated with universal variables.
+ */
+struct ConicSegment
+{
+    // Body orbited, which has a UCompGravity
+    Satellite m_body{entt::null};
+    double m_gravParam{0.0};
+
+    // Time the segment starts and ends, in seconds
+    double m_timeStart{0.0};
+    double m_timeEnd{0.0};
+
+    // State relative to m_body at m_timeStart, in meters and m/s
+    Vector3d m_position;
+    Vector3d m_velocity;
+
+    // Body orbited by the next segment, or null if the prediction ends here
+    Satellite m_bodyNext{entt::null};
+
+    /**
+     * Propagate along the conic
+     *
+     * @param time [in] Time in seconds, not limited to the segment
+     * @param rPos [out] Position relative to m_body in meters
+     * @param rVel [out] Velocity relative to m_body in m/s
+     */
+    void state_at(double time, Vector3d &rPos, Vector3d &rVel) const;
+};
+
+/**
+ * Predicts the paths of satellites as patched conics, switching between
+ * bodies with a UCompGravity as they cross spheres of influence.
+ *
+ * Bodies form a tree: a body's parent is its nearest ancestor (through
+ * UCompTransformTraj::m_parent) that also has a UCompGravity. Where bodies
+ * will be is asked from their trajectories through
+ * ISystemTrajectory::predict_state(), or extrapolated along their
+ * UCompVelocity for trajectories that can't predict.
+ *
+ * Predictions are cached per satellite. Each predict() only checks that the
+ * satellite is still where its prediction says, and extends the prediction
+ * once half of the horizon has passed, so calling it every frame for dozens
+ * of satellites is cheap. Predictions are recomputed from:
+ * - the start, if the satellite strayed from its prediction, such as from
+ *   thrust or being moved to another trajectory
+ * - the first segment depending on a body, if the body's UCompGravity or
+ *   parent changed, or invalidate_body() is called for it
+ */
+class TrajectoryPredictor
+{
+public:
+
+    // Most segments in one prediction
+    static constexpr std::size_t smc_segmentsMax = 16;
+
+    // Default time to predict ahead, in seconds
+    static constexpr double smc_horizonDefault = 86400.0;
+
+    TrajectoryPredictor(Universe& rUniverse);
+
+    /**
+     * Predict a satellite from the current time up to the horizon, using
+     * the cached prediction if it still holds.
+     *
+     * @param sat [in] Satellite to predict
+     *
+     * @return Segments in order of time, with the first containing the
+     *         current time. Empty if the satellite isn't within any body's
+     *         sphere of influence. Valid until the next call to this class.
+     */
+    std::vector<ConicSegment> const& predict(Satellite sat);
+
+    /**
+     * Recompute a satellite's prediction from the current time on its next
+     * predict(), such as after thrusting too little to be noticed
+     */
+    void invalidate(Satellite sat);
+
+    /**
+     * Recompute every prediction from the first segment depending on a body,
+     * for changes that can't be noticed such as a body being moved
+     */
+    void invalidate_body(Satellite body);
+
+    /**
+     * Drop the cached prediction of a satellite
+     */
+    void forget(Satellite sat);
+
+    void clear();
+
+    /**
+     * Set how long predictions cover, in seconds
+     */
+    void set_horizon(double horizon) noexcept { m_horizon = horizon; }
+    constexpr double get_horizon() const noexcept { return m_horizon; }
+
+    /**
+     * Set how far a satellite can stray from its prediction before it's
+     * recomputed. Both are added to a millionth of the predicted distance
+     * and speed relative to the body.
+     *
+     * @param position [in] Meters
+     * @param velocity [in] Meters per second
+     */
+    void set_tolerance(double position, double velocity) noexcept
+    {
+        m_tolerancePos = position;
+        m_toleranceVel = velocity;
+    }
+
+    /**
+     * @return Segments computed since construction, to tell how often
+     *         predictions are recomputed
+     */
+    constexpr uint64_t get_segments_computed() const noexcept
+    { return m_segmentsComputed; }
+
+private:
+
+    struct Body
+    {
+        Satellite m_parent{entt::null};
+        double m_gravParam{0.0};
+        double m_soiRadius{0.0};
+        std::vector<Satellite> m_children;
+    };
+
+    using Bodies_t = std::unordered_map<Satellite, Body>;
+
+    /**
+     * Rebuild the body tree if time moved on since it was last built, and
+     * truncate predictions depending on bodies that changed
+     */
+    void bodies_refresh();
+
+    /**
+     * @return Nearest ancestor of a satellite that is a body, or null
+     */
+    Satellite body_find(Satellite sat, Bodies_t const& bodies) const;
+
+    /**
+     * Calculate the state of a satellite relative to another at any time.
+     * The frame doesn't need to be an ancestor of the satellite.
+     *
+     * @param sat [in] Satellite to get the state of
+     * @param frame [in] Satellite to get the state relative to, or null for
+     *                   the root
+     */
+    void state_relative(Satellite sat, Satellite frame, double time,
+                        Vector3d &rPos, Vector3d &rVel);
+
+    /**
+     * Start a new prediction from a satellite's current state
+     *
+     * @return false if the satellite isn't in any sphere of influence
+     */
+    bool prediction_start(Satellite sat, std::vector<ConicSegment> &rSegs);
+
+    /**
+     * Continue a prediction past the end of its last segment, switching
+     * bodies at each sphere of influence crossing
+     */
+    void prediction_extend(std::vector<ConicSegment> &rSegs, double timeEnd);
+
+    /**
+     * Cut a prediction at the first segment that depends on a body, so the
+     * next prediction_extend() continues from there
+     */
+    static void prediction_truncate(std::vector<ConicSegment> &rSegs,
+                                    Satellite body, Bodies_t const& bodies);
+
+    /**
+     * Follow a segment from a time until it crosses a sphere of influence,
+     * stepping no further than the distance to the nearest crossing allows
+     *
+     * @param rNext [out] Body to switch to, or null if nothing was crossed
+     *
+     * @return Time of the crossing, or timeEnd
+     */
+    double segment_march(ConicSegment const& seg, double time,
+                         double timeEnd, Satellite &rNext);
+
+    Universe &m_universe;
+
+    Bodies_t m_bodies;
+    double m_bodiesTime;
+    bool m_bodiesBuilt{false};
+
+    std::unordered_map<Satellite, std::vector<ConicSegment>> m_predictions;
+
+    double m_horizon{smc_horizonDefault};
+    double m_tolerancePos{1.0};
+    double m_toleranceVel{0.01};
+
+    uint64_t m_segmentsComputed{0};
+};
+
+}
@@ -0,0 +1,613 @@
+/**
+ * Open Space Program
+ * Copyright © 2019-2020 Open Space Program Project
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "UniverseReplication.h"
+#include "Universe.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <ostream>
+#include <type_traits>
+
+using namespace osp::universe;
+using namespace osp;
+
+namespace
+{
+
+// Size of the uint32 in front of each message
+constexpr std::size_t c_sizePrefix = sizeof(uint32_t);
+
+void put_varint(std::vector<char> &rOut, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        rOut.push_back(char(uint8_t(value) | 0x80));
+        value >>= 7;
+    }
+    rOut.push_back(char(uint8_t(value)));
+}
+
+void put_zigzag(std::vector<char> &rOut, int64_t value)
+{
+    put_varint(rOut, (uint64_t(value) << 1) ^ uint64_t(value >> 63));
+}
+
+template<typename T>
+void put_raw(std::vector<char> &rOut, T const& value)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+    char const *pBytes = reinterpret_cast<char const*>(&value);
+    rOut.insert(rOut.end(), pBytes, pBytes + sizeof(T));
+}
+
+void put_sat(std::vector<char> &rOut, Satellite sat)
+{
+    put_varint(rOut, entt::to_integral(sat));
+}
+
+void put_parent(std::vector<char> &rOut, Satellite parent)
+{
+    put_varint(rOut, (parent == entt::null)
+                     ? 0 : uint64_t(entt::to_integral(parent)) + 1);
+}
+
+/**
+ * Reads values written by the put_* functions above. Reading past the end
+ * sets m_fail and returns zeros instead
+ */
+struct MessageReader
+{
+    char const *m_pos;
+    char const *m_end;
+    bool m_fail{false};
+
+    uint64_t varint()
+    {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            if (m_pos == m_end)
+            {
+                m_fail = true;
+                return 0;
+            }
+
+            uint8_t const byte = uint8_t(*m_pos ++);
+            value |= uint64_t(byte & 0x7f) << shift;
+
+            if ((byte & 0x80) == 0)
+            {
+                return value;
+            }
+        }
+        m_fail = true;
+        return 0;
+    }
+
+    int64_t zigzag()
+    {
+        uint64_t const value = varint();
+        return int64_t(value >> 1) ^ -int64_t(value & 1);
+    }
+
+    template<typename T>
+    T raw()
+    {
+        T value{};
+        if (std::size_t(m_end - m_pos) < sizeof(T))
+        {
+            m_fail = true;
+            return value;
+        }
+        std::memcpy(&value, m_pos, sizeof(T));
+        m_pos += sizeof(T);
+        return value;
+    }
+
+    Satellite sat()
+    {
+        return Satellite(entt::id_type(varint()));
+    }
+
+    Satellite parent()
+    {
+        uint64_t const value = varint();
+        return (value == 0) ? Satellite(entt::null)
+                            : Satellite(entt::id_type(value - 1));
+    }
+};
+
+/**
+ * @return Index of a satellite's state in an array, resizing it if needed
+ */
+std::size_t state_index(std::vector<ReplSatState> &rStates, Satellite sat)
+{
+    std::size_t const index = sat_index(sat);
+    if (index >= rStates.size())
+    {
+        rStates.resize(index + 1);
+    }
+    return index;
+}
+
+}
+
+bool ReplicationStreamSink::write(
+        Corrade::Containers::ArrayView<const char> data)
+{
+    m_rStream.write(data.data(), std::streamsize(data.size()));
+    m_rStream.flush();
+    return m_rStream.good();
+}
+
+ReplicationEncoder::ReplicationEncoder(Universe const& uni,
+                                       IReplicationSink& rSink) :
+        m_universe(uni),
+        m_rSink(rSink),
+        m_framesPass(uni.get_frames_pass())
+{
+
+}
+
+bool ReplicationEncoder::encode()
+{
+    // Changes are only known for the last sat_frames_update(), so any
+    // passes missed since the last frame need a keyframe to catch up
+    unsigned const pass = m_universe.get_frames_pass();
+    unsigned const passNext = (m_framesPass + 1 == 0) ? 1 : m_framesPass + 1;
+    if (pass != m_framesPass && pass != passNext)
+    {
+        m_keyframeNext = true;
+    }
+    m_framesPass = pass;
+
+    if (m_keyframeInterval != 0 && m_sinceKeyframe >= m_keyframeInterval)
+    {
+        m_keyframeNext = true;
+    }
+
+    m_frame ++;
+    m_message.clear();
+    m_message.resize(c_sizePrefix);
+
+    if (m_keyframeNext)
+    {
+        encode_keyframe();
+    }
+    else
+    {
+        encode_delta();
+    }
+
+    uint32_t const size = uint32_t(m_message.size() - c_sizePrefix);
+    std::memcpy(m_message.data(), &size, c_sizePrefix);
+
+    if (!m_rSink.write({m_message.data(), m_message.size()}))
+    {
+        // The baseline now has changes the receiver never got
+        m_keyframeNext = true;
+        return false;
+    }
+
+    m_bytesWritten += m_message.size();
+    return true;
+}
+
+void ReplicationEncoder::encode_keyframe()
+{
+    auto const &reg = m_universe.get_reg();
+    auto const view = reg.view<const UCompTransformTraj>();
+
+    m_posShift = m_posShiftNext;
+    m_keyframeNext = false;
+    m_sinceKeyframe = 0;
+
+    m_baseline.assign(reg.size(), ReplSatState{});
+
+    put_raw(m_message, gc_replKeyframe);
+    put_varint(m_message, m_frame);
+    put_raw(m_message, m_universe.get_time());
+    put_raw(m_message, m_posShift);
+    put_varint(m_message, view.size());
+
+    for (Satellite sat : view)
+    {
+        ReplSatState const state = quantize(sat);
+
+        put_sat(m_message, sat);
+        put_parent(m_message, state.m_parent);
+        for (int i = 0; i < 3; i ++)
+        {
+            put_zigzag(m_message, state.m_position[i]);
+        }
+        for (int32_t value : state.m_rotation)
+        {
+            put_zigzag(m_message, value);
+        }
+        for (int32_t value : state.m_velocity)
+        {
+            put_zigzag(m_message, value);
+        }
+
+        m_baseline[state_index(m_baseline, sat)] = state;
+    }
+}
+
+void ReplicationEncoder::encode_delta()
+{
+    auto const &reg = m_universe.get_reg();
+
+    m_sinceKeyframe ++;
+
+    put_raw(m_message, gc_replDelta);
+    put_varint(m_message, m_frame);
+    put_varint(m_message, m_frame - 1);
+    put_raw(m_message, m_universe.get_time());
+
+    // Records are counted as they're written, so they go in a separate
+    // buffer to be appended after their count
+    m_records.clear();
+    std::size_t count = 0;
+
+    for (Satellite sat : m_universe.get_frames_changed())
+    {
+        if (!reg.valid(sat))
+        {
+            continue;
+        }
+
+        ReplSatState const state = quantize(sat);
+        ReplSatState &rBase = m_baseline[state_index(m_baseline, sat)];
+
+        bool const known = (rBase.m_sat == sat);
+        if (!known)
+        {
+            // New satellite, or a recycled index. Send it all
+            rBase = ReplSatState{};
+        }
+
+        uint8_t mask = 0;
+        if (state.m_position != rBase.m_position)
+        {
+            mask |= gc_replFieldPosition;
+        }
+        if (state.m_rotation != rBase.m_rotation)
+        {
+            mask |= gc_replFieldRotation;
+        }
+        if (state.m_velocity != rBase.m_velocity)
+        {
+            mask |= gc_replFieldVelocity;
+        }
+        if (state.m_parent != rBase.m_parent)
+        {
+            mask |= gc_replFieldParent;
+        }
+
+        if (known && mask == 0)
+        {
+            continue; // didn't move enough to notice
+        }
+
+        put_sat(m_records, sat);
+        put_raw(m_records, mask);
+
+        if (mask & gc_replFieldPosition)
+        {
+            Vector3s const delta = state.m_position - rBase.m_position;
+            for (int i = 0; i < 3; i ++)
+            {
+                put_zigzag(m_records, delta[i]);
+            }
+        }
+        if (mask & gc_replFieldRotation)
+        {
+            for (int i = 0; i < 4; i ++)
+            {
+                put_zigzag(m_records,
+                           int64_t(state.m_rotation[i]) - rBase.m_rotation[i]);
+            }
+        }
+        if (mask & gc_replFieldVelocity)
+        {
+            for (int i = 0; i < 3; i ++)
+            {
+                put_zigzag(m_records,
+                           int64_t(state.m_velocity[i]) - rBase.m_velocity[i]);
+            }
+        }
+        if (mask & gc_replFieldParent)
+        {
+            put_parent(m_records, state.m_parent);
+        }
+
+        rBase = state;
+        count ++;
+    }
+
+    put_varint(m_message, count);
+    m_message.insert(m_message.end(), m_records.begin(), m_records.end());
+
+    // Removed satellites, only the ones the receiver knows about
+    m_records.clear();
+    count = 0;
+
+    for (Satellite sat : m_universe.get_frames_removed())
+    {
+        std::size_t const index = sat_index(sat);
+
+        if (index < m_baseline.size() && m_baseline[index].m_sat == sat)
+        {
+            m_baseline[index] = ReplSatState{};
+            put_sat(m_records, sat);
+            count ++;
+        }
+    }
+
+    put_varint(m_message, count);
+    m_message.insert(m_message.end(), m_records.begin(), m_records.end());
+}
+
+ReplSatState ReplicationEncoder::quantize(Satellite sat) const
+{
+    auto const &reg = m_universe.get_reg();
+    auto const &posTraj = reg.get<UCompTransformTraj>(sat);
+
+    ReplSatState state;
+    state.m_sat = sat;
+    state.m_parent = posTraj.m_parent;
+
+    // Arithmetic shift rounds towards negative infinity, same on both sides
+    state.m_position = Vector3s(posTraj.m_position.x() >> m_posShift,
+                                posTraj.m_position.y() >> m_posShift,
+                                posTraj.m_position.z() >> m_posShift);
+
+    Quaternion const &rot = posTraj.m_rotation;
+    state.m_rotation = {
+        int32_t(std::lround(rot.vector().x() * gc_replRotationScale)),
+        int32_t(std::lround(rot.vector().y() * gc_replRotationScale)),
+        int32_t(std::lround(rot.vector().z() * gc_replRotationScale)),
+        int32_t(std::lround(rot.scalar() * gc_replRotationScale))};
+
+    if (auto const *pVel = reg.try_get<UCompVelocity>(sat))
+    {
+        state.m_velocity = {
+            int32_t(std::lround(pVel->m_velocity.x() * gc_replVelocityScale)),
+            int32_t(std::lround(pVel->m_velocity.y() * gc_replVelocityScale)),
+            int32_t(std::lround(pVel->m_velocity.z() * gc_replVelocityScale))};
+    }
+
+    return state;
+}
+
+int ReplicationDecoder::feed(Corrade::Containers::ArrayView<const char> data)
+{
+    m_pending.insert(m_pending.end(), data.begin(), data.end());
+
+    int status = 0;
+    std::size_t offset = 0;
+
+    while (m_pending.size() - offset >= c_sizePrefix)
+    {
+        uint32_t size;
+        std::memcpy(&size, m_pending.data() + offset, c_sizePrefix);
+
+        if (m_pending.size() - offset - c_sizePrefix < size)
+        {
+            break; // rest of the message hasn't arrived yet
+        }
+
+        int const result = decode({m_pending.data() + offset + c_sizePrefix,
+                                   size});
+        if (status == 0)
+        {
+            status = result;
+        }
+
+        offset += c_sizePrefix + size;
+    }
+
+    m_pending.erase(m_pending.begin(), m_pending.begin() + offset);
+
+    return status;
+}
+
+int ReplicationDecoder::decode(
+        Corrade::Containers::ArrayView<const char> message)
+{
+    MessageReader reader{message.data(), message.data() + message.size()};
+
+    uint8_t const kind = reader.raw<uint8_t>();
+
+    if (kind == gc_replKeyframe)
+    {
+        uint64_t const frame = reader.varint();
+        double const time = reader.raw<double>();
+        uint8_t const posShift = reader.raw<uint8_t>();
+        uint64_t const count = reader.varint();
+
+        if (reader.m_fail || posShift >= 64)
+        {
+            m_synced = false;
+            return 1;
+        }
+
+        std::fill(m_states.begin(), m_states.end(), ReplSatState{});
+        m_satCount = 0;
+
+        for (uint64_t i = 0; i < count && !reader.m_fail; i ++)
+        {
+            ReplSatState state;
+            state.m_sat = reader.sat();
+            state.m_parent = reader.parent();
+            for (int j = 0; j < 3; j ++)
+            {
+                state.m_position[j] = reader.zigzag();
+            }
+            for (int32_t &rValue : state.m_rotation)
+            {
+                rValue = int32_t(reader.zigzag());
+            }
+            for (int32_t &rValue : state.m_velocity)
+            {
+                rValue = int32_t(reader.zigzag());
+            }
+
+            ReplSatState &rState = m_states[state_index(m_states, state.m_sat)];
+            if (rState.m_sat == Satellite(entt::null))
+            {
+                m_satCount ++;
+            }
+            rState = state;
+        }
+
+        if (reader.m_fail)
+        {
+            m_synced = false;
+            return 1;
+        }
+
+        m_frame = frame;
+        m_time = time;
+        m_posShift = posShift;
+        m_synced = true;
+        return 0;
+    }
+
+    if (kind != gc_replDelta)
+    {
+        return 1;
+    }
+
+    uint64_t const frame = reader.varint();
+    uint64_t const baseline = reader.varint();
+    double const time = reader.raw<double>();
+
+    if (reader.m_fail)
+    {
+        m_synced = false;
+        return 1;
+    }
+
+    if (!m_synced || baseline != m_frame)
+    {
+        // Missed a frame, wait for the next keyframe
+        m_synced = false;
+        return 2;
+    }
+
+    uint64_t const count = reader.varint();
+
+    for (uint64_t i = 0; i < count && !reader.m_fail; i ++)
+    {
+        Satellite const sat = reader.sat();
+        uint8_t const mask = reader.raw<uint8_t>();
+
+        ReplSatState &rState = m_states[state_index(m_states, sat)];
+        if (rState.m_sat != sat)
+        {
+            if (rState.m_sat == Satellite(entt::null))
+            {
+                m_satCount ++;
+            }
+            rState = ReplSatState{};
+            rState.m_sat = sat;
+        }
+
+        if (mask & gc_replFieldPosition)
+        {
+            for (int j = 0; j < 3; j ++)
+            {
+                rState.m_position[j] += reader.zigzag();
+            }
+        }
+        if (mask & gc_replFieldRotation)
+        {
+            for (int32_t &rValue : rState.m_rotation)
+            {
+                rValue += int32_t(reader.zigzag());
+            }
+        }
+        if (mask & gc_replFieldVelocity)
+        {
+            for (int32_t &rValue : rState.m_velocity)
+            {
+                rValue += int32_t(reader.zigzag());
+            }
+        }
+        if (mask & gc_replFieldParent)
+        {
+            rState.m_parent = reader.parent();
+        }
+    }
+
+    uint64_t const removed = reader.varint();
+
+    for (uint64_t i = 0; i < removed && !reader.m_fail; i ++)
+    {
+        Satellite const sat = reader.sat();
+        std::size_t const index = sat_index(sat);
+
+        if (index < m_states.size() && m_states[index].m_sat == sat)
+        {
+            m_states[index] = ReplSatState{};
+            m_satCount --;
+        }
+    }
+
+    if (reader.m_fail)
+    {
+        m_synced = false;
+        return 1;
+    }
+
+    m_frame = frame;
+    m_time = time;
+    return 0;
+}
+
+ReplSatState const* ReplicationDecoder::get_state(Satellite sat) const
+{
+    std::size_t const index = sat_index(sat);
+    if (index < m_states.size() && m_states[index].m_sat == sat)
+    {
+        return &m_states[index];
+    }
+    return nullptr;
+}
+
+Quaternion ReplicationDecoder::get_rotation(ReplSatState const& state)
+{
+    return Quaternion({float(state.m_rotation[0]), float(state.m_rotation[1]),
+                       float(state.m_rotation[2])},
+                      float(state.m_rotation[3])).normalized();
+}
+
+Vector3 ReplicationDecoder::get_velocity(ReplSatState const& state)
+{
+    return Vector3(float(state.m_velocity[0]), float(state.m_velocity[1]),
+                   float(state.m_velocity[2])) / gc_replVelocityScale;
+}
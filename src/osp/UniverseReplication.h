@@ -0,0 +1,278 @@
+/**
+ * Open Space Program
+ * Copyright © 2019-2020 Open Space Program Project
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+
+#include "types.h"
+#include "universetypes.h"
+
+#include <Corrade/Containers/ArrayView.h>
+
+#include <array>
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+namespace osp::universe
+{
+
+class Universe;
+
+/*
+ * Replication streams let other processes follow a universe, such as a map
+ * view or a telemetry client, without copying every satellite each tick.
+ *
+ * A stream is a sequence of messages, each prefixed by its size as a native
+ * uint32. Integers in messages are varints, signed ones zigzag encoded.
+ *
+ * Keyframe:
+ * - uint8 gc_replKeyframe, varint frame, float64 time, uint8 position shift
+ * - varint count, then for each satellite: varint id, varint parent,
+ *   position[3], rotation[4], velocity[3]
+ *
+ * Delta:
+ * - uint8 gc_replDelta, varint frame, varint baseline frame, float64 time
+ * - varint count, then for each satellite: varint id, uint8 field mask, then
+ *   each field in the mask, as a difference from the baseline
+ * - varint count, then the varint id of each removed satellite
+ *
+ * Values are quantized before being compared or subtracted, so satellites
+ * that didn't move enough to change their quantized state cost nothing.
+ * Positions are UCompTransformTraj::m_position shifted right by the position
+ * shift, rotations are scaled by gc_replRotationScale, and velocities by
+ * gc_replVelocityScale. Parents are stored as their id plus one, so 0 is null.
+ */
+
+constexpr uint8_t gc_replKeyframe = 0;
+constexpr uint8_t gc_replDelta = 1;
+
+constexpr float gc_replRotationScale = 32767.0f;
+constexpr float gc_replVelocityScale = 256.0f; // 1/256 m/s
+
+// Bits of a delta record's field mask
+constexpr uint8_t gc_replFieldPosition = 1 << 0;
+constexpr uint8_t gc_replFieldRotation = 1 << 1;
+constexpr uint8_t gc_replFieldVelocity = 1 << 2;
+constexpr uint8_t gc_replFieldParent = 1 << 3;
+
+/**
+ * Destination for replication messages, such as a file, pipe or socket
+ */
+class IReplicationSink
+{
+public:
+    virtual ~IReplicationSink() = default;
+
+    /**
+     * Write a complete message. A message counts as acknowledged once this
+     * returns true, so it must only do so if the receiver will get it.
+     *
+     * @return true if written
+     */
+    virtual bool write(Corrade::Containers::ArrayView<const char> data) = 0;
+};
+
+/**
+ * Writes replication messages to a std::ostream, such as an std::ofstream
+ * opened on a named pipe
+ */
+class ReplicationStreamSink : public IReplicationSink
+{
+public:
+    explicit ReplicationStreamSink(std::ostream& rStream)
+     : m_rStream(rStream)
+    { }
+
+    bool write(Corrade::Containers::ArrayView<const char> data) override;
+
+private:
+    std::ostream &m_rStream;
+};
+
+/**
+ * Quantized state of a satellite, as sent over a replication stream
+ */
+struct ReplSatState
+{
+    Satellite m_sat{entt::null};
+    Satellite m_parent{entt::null};
+    Vector3s m_position{0};
+    std::array<int32_t, 4> m_rotation{0, 0, 0, 0};
+    std::array<int32_t, 3> m_velocity{0, 0, 0};
+};
+
+/**
+ * Encodes changes of a Universe into replication messages.
+ *
+ * Changes are found from Universe::get_frames_changed() and
+ * get_frames_removed(), so encode() costs time and bandwidth proportional to
+ * the number of satellites that moved, not the number of satellites. Only
+ * satellites marked dirty are looked at, so changes to UCompVelocity alone
+ * need a Universe::sat_mark_dirty() too.
+ *
+ * Each delta is against the last frame the sink acknowledged by accepting
+ * it. If the sink fails, the next frame is a keyframe.
+ */
+class ReplicationEncoder
+{
+public:
+
+    /**
+     * @param uni [in] Universe to replicate
+     * @param rSink [in] Where to write messages
+     */
+    ReplicationEncoder(Universe const& uni, IReplicationSink& rSink);
+
+    ReplicationEncoder(ReplicationEncoder const& copy) = delete;
+    ReplicationEncoder(ReplicationEncoder&& move) = delete;
+
+    /**
+     * Encode and write a frame. Call after Universe::sat_frames_update()
+     *
+     * @return false if the sink failed to write
+     */
+    bool encode();
+
+    /**
+     * Make the next frame a keyframe, such as when a new observer connects
+     * or after loading a snapshot
+     */
+    void keyframe_request() noexcept { m_keyframeNext = true; }
+
+    /**
+     * Set how often keyframes are sent, so observers that join a shared
+     * stream late or drop data can catch up
+     *
+     * @param frames [in] Frames between keyframes, 0 for only on request
+     */
+    void set_keyframe_interval(unsigned frames) noexcept
+    { m_keyframeInterval = frames; }
+
+    /**
+     * Set how many bits are cut off positions, as a power of two. Takes
+     * effect at the next keyframe. The default of 6 is 1/16 of a meter.
+     */
+    void set_position_shift(uint8_t shift) noexcept { m_posShiftNext = shift; }
+
+    constexpr uint64_t get_frame() const noexcept { return m_frame; }
+    constexpr uint64_t get_bytes_written() const noexcept
+    { return m_bytesWritten; }
+
+private:
+
+    /**
+     * Quantize the current state of a satellite
+     */
+    ReplSatState quantize(Satellite sat) const;
+
+    void encode_keyframe();
+    void encode_delta();
+
+    Universe const &m_universe;
+    IReplicationSink &m_rSink;
+
+    // Last state acknowledged for each satellite, indexed by sat_index()
+    std::vector<ReplSatState> m_baseline;
+
+    // Message being written, reused between frames
+    std::vector<char> m_message;
+    std::vector<char> m_records;
+
+    // Universe::get_frames_pass() as of the last frame
+    unsigned m_framesPass;
+
+    uint64_t m_frame{0};
+    uint64_t m_bytesWritten{0};
+    unsigned m_keyframeInterval{600};
+    unsigned m_sinceKeyframe{0};
+    uint8_t m_posShift{6};
+    uint8_t m_posShiftNext{6};
+    bool m_keyframeNext{true};
+};
+
+/**
+ * Rebuilds the satellites of a universe from replication messages
+ */
+class ReplicationDecoder
+{
+public:
+
+    /**
+     * Add bytes read from a stream. Complete messages are decoded as soon as
+     * they arrive, the rest is kept for later.
+     *
+     * @return 0 on success, or the error of the first message that failed,
+     *         see decode()
+     */
+    int feed(Corrade::Containers::ArrayView<const char> data);
+
+    /**
+     * Decode a single message, without its size prefix
+     *
+     * @return 0 on success, 1 if malformed, 2 if a delta doesn't follow the
+     *         frame it was made against. Deltas are ignored after an error
+     *         until the next keyframe.
+     */
+    int decode(Corrade::Containers::ArrayView<const char> message);
+
+    /**
+     * @return State of a satellite, or nullptr if it isn't known
+     */
+    ReplSatState const* get_state(Satellite sat) const;
+
+    /**
+     * @return Position of a satellite relative to its parent, in units
+     */
+    Vector3s get_position(ReplSatState const& state) const
+    { return state.m_position * (SpaceInt(1) << m_posShift); }
+
+    static Quaternion get_rotation(ReplSatState const& state);
+    static Vector3 get_velocity(ReplSatState const& state);
+
+    /**
+     * @return States of known satellites, indexed by sat_index(). Entries
+     *         with a null m_sat are unused
+     */
+    constexpr std::vector<ReplSatState> const& get_states() const noexcept
+    { return m_states; }
+
+    constexpr std::size_t get_sat_count() const noexcept { return m_satCount; }
+    constexpr uint64_t get_frame() const noexcept { return m_frame; }
+    constexpr double get_time() const noexcept { return m_time; }
+
+private:
+
+    std::vector<ReplSatState> m_states;
+    std::size_t m_satCount{0};
+
+    // Partial message left over from feed()
+    std::vector<char> m_pending;
+
+    uint64_t m_frame{0};
+    double m_time{0.0};
+    uint8_t m_posShift{0};
+    bool m_synced{false};
+};
+
+}
@@ -0,0 +1,989 @@
+/**
+ * Open Space Program
+ * Copyright © 2019-2020 Open Space Program Project
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "UniverseSnapshot.h"
+
+#include "Satellites/SatVehicle.h"
+#include "Resource/Package.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <unordered_map>
+
+#if !defined(_WIN32)
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+using namespace osp::universe;
+using namespace osp;
+
+using Corrade::Containers::ArrayView;
+
+namespace
+{
+
+constexpr char const c_magic[8] = {'O', 'S', 'P', 'U', 'N', 'I', 'V', '\0'};
+
+constexpr SnapshotChunkId_t c_chunkUniverse     = snapshot_chunk_id("UNIV");
+constexpr SnapshotChunkId_t c_chunkSatellites   = snapshot_chunk_id("SATS");
+constexpr SnapshotChunkId_t c_chunkTransform    = snapshot_chunk_id("TRNS");
+constexpr SnapshotChunkId_t c_chunkNames        = snapshot_chunk_id("NAME");
+constexpr SnapshotChunkId_t c_chunkType         = snapshot_chunk_id("TYPE");
+constexpr SnapshotChunkId_t c_chunkTypeNames    = snapshot_chunk_id("TYPN");
+constexpr SnapshotChunkId_t c_chunkTrajNames    = snapshot_chunk_id("TRJN");
+constexpr SnapshotChunkId_t c_chunkTrajCenters  = snapshot_chunk_id("TRJC");
+constexpr SnapshotChunkId_t c_chunkTrajData     = snapshot_chunk_id("TRJD");
+constexpr SnapshotChunkId_t c_chunkVelocity     = snapshot_chunk_id("VELO");
+constexpr SnapshotChunkId_t c_chunkActivatable  = snapshot_chunk_id("ACTV");
+constexpr SnapshotChunkId_t c_chunkVehicle      = snapshot_chunk_id("VHCL");
+constexpr SnapshotChunkId_t c_chunkBlueprints   = snapshot_chunk_id("BLPN");
+
+// Index used for null pointers
+constexpr uint32_t c_noIndex = ~uint32_t(0);
+
+// Records written in place of components that contain pointers or strings
+
+struct SnapUniverse
+{
+    double m_time;
+    Satellite m_root;
+    uint32_t m_trajectoryCount;
+};
+
+struct SnapTransformTraj
+{
+    Vector3s m_position;
+    Quaternion m_rotation;
+    Satellite m_parent;
+    uint32_t m_trajectory; // index into Universe's trajectories
+    uint32_t m_index;
+    uint32_t m_padding;
+};
+
+// Records are written in batches of this many, to limit temporary memory
+constexpr std::size_t c_batchSize = 4096;
+
+/**
+ * @param saved [in] Saved satellites by sat_index, null where there are none
+ * @param sats  [in] Satellites of a saved pool
+ * @return true if every satellite of the pool was saved, and appears once
+ */
+bool sats_saved_once(std::vector<Satellite> const& saved,
+                     ArrayView<const Satellite> sats)
+{
+    std::vector<bool> seen(saved.size(), false);
+
+    for (Satellite const sat : sats)
+    {
+        std::size_t const index = sat_index(sat);
+
+        if (index >= saved.size() || saved[index] != sat || seen[index])
+        {
+            return false;
+        }
+        seen[index] = true;
+    }
+    return true;
+}
+
+}
+
+// ---- SnapshotWriter ----
+
+SnapshotWriter::SnapshotWriter(std::string const& path)
+ : m_file(path, std::ios::binary | std::ios::trunc)
+{
+    SnapshotHeader header{};
+    std::memcpy(header.m_magic, c_magic, sizeof(c_magic));
+    header.m_version = gc_snapshotVersion;
+    m_file.write(reinterpret_cast<char const*>(&header), sizeof(header));
+}
+
+SnapshotWriter::~SnapshotWriter()
+{
+    finish();
+}
+
+void SnapshotWriter::chunk_begin(SnapshotChunkId_t id, uint32_t version,
+                                 uint64_t count, uint64_t stride)
+{
+    SnapshotChunkHeader header{id, version, count, stride, 0};
+
+    m_chunkStart = m_file.tellp();
+    m_chunkSize = 0;
+    m_file.write(reinterpret_cast<char const*>(&header), sizeof(header));
+}
+
+void SnapshotWriter::chunk_write(void const* pData, std::size_t size)
+{
+    if (size == 0)
+    {
+        return; // pData may be null, such as for empty strings
+    }
+
+    m_file.write(static_cast<char const*>(pData), size);
+    m_chunkSize += size;
+}
+
+void SnapshotWriter::chunk_pad()
+{
+    static constexpr char const sc_zeros[gc_snapshotAlign] = {};
+    std::size_t const padding = (gc_snapshotAlign
+                                 - m_chunkSize % gc_snapshotAlign)
+                              % gc_snapshotAlign;
+    chunk_write(sc_zeros, padding);
+}
+
+void SnapshotWriter::chunk_end()
+{
+    uint64_t const size = m_chunkSize;
+    chunk_pad();
+
+    // Go back and fill in the payload size
+    std::streampos const end = m_file.tellp();
+    m_file.seekp(m_chunkStart
+                 + std::streamoff(offsetof(SnapshotChunkHeader, m_size)));
+    m_file.write(reinterpret_cast<char const*>(&size), sizeof(size));
+    m_file.seekp(end);
+
+    m_chunkCount ++;
+}
+
+void SnapshotWriter::write_pool(SnapshotChunkId_t id, uint32_t version,
+                                ArrayView<const Satellite> sats,
+                                void const* pComponents, std::size_t stride)
+{
+    chunk_begin(id, version, sats.size(), stride);
+    chunk_write(sats.data(), sats.size() * sizeof(Satellite));
+    chunk_pad();
+    chunk_write(pComponents, sats.size() * stride);
+    chunk_end();
+}
+
+void SnapshotWriter::write_strings(SnapshotChunkId_t id,
+                                   std::vector<std::string_view> const& strings)
+{
+    std::vector<uint64_t> offsets;
+    offsets.reserve(strings.size() + 1);
+
+    uint64_t offset = 0;
+    for (std::string_view str : strings)
+    {
+        offsets.push_back(offset);
+        offset += str.size();
+    }
+    offsets.push_back(offset);
+
+    chunk_begin(id, 1, strings.size(), 0);
+    chunk_write(offsets.data(), offsets.size() * sizeof(uint64_t));
+    for (std::string_view str : strings)
+    {
+        chunk_write(str.data(), str.size());
+    }
+    chunk_end();
+}
+
+bool SnapshotWriter::finish()
+{
+    if (m_finished)
+    {
+        return true;
+    }
+    m_finished = true;
+
+    m_file.seekp(offsetof(SnapshotHeader, m_chunkCount));
+    m_file.write(reinterpret_cast<char const*>(&m_chunkCount),
+                 sizeof(m_chunkCount));
+    bool const good = m_file.good();
+    m_file.close();
+    return good;
+}
+
+// ---- SnapshotReader ----
+
+SnapshotReader::SnapshotReader(std::string const& path)
+{
+#if !defined(_WIN32)
+    int const fd = ::open(path.c_str(), O_RDONLY);
+    if (fd != -1)
+    {
+        struct stat info;
+        if (::fstat(fd, &info) == 0 && info.st_size > 0)
+        {
+            void *pMap = ::mmap(nullptr, std::size_t(info.st_size), PROT_READ,
+                                MAP_PRIVATE, fd, 0);
+            if (pMap != MAP_FAILED)
+            {
+                // Chunks are read front to back
+                ::madvise(pMap, std::size_t(info.st_size), MADV_SEQUENTIAL);
+                m_pData = static_cast<unsigned char const*>(pMap);
+                m_size = std::size_t(info.st_size);
+                m_mapped = true;
+            }
+        }
+        ::close(fd);
+    }
+#endif
+
+    if (!m_mapped)
+    {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file.is_open())
+        {
+            return;
+        }
+
+        m_buffer.resize(std::size_t(file.tellg()));
+        file.seekg(0);
+        file.read(reinterpret_cast<char*>(m_buffer.data()), m_buffer.size());
+        m_pData = m_buffer.data();
+        m_size = m_buffer.size();
+    }
+
+    // Check header
+
+    if (m_size < sizeof(SnapshotHeader))
+    {
+        return;
+    }
+
+    auto const &header = *reinterpret_cast<SnapshotHeader const*>(m_pData);
+
+    if (std::memcmp(header.m_magic, c_magic, sizeof(c_magic)) != 0
+        || header.m_version != gc_snapshotVersion)
+    {
+        return;
+    }
+
+    // Walk through chunks
+
+    std::size_t pos = sizeof(SnapshotHeader);
+    m_chunks.reserve(header.m_chunkCount);
+
+    for (uint32_t i = 0; i < header.m_chunkCount; i ++)
+    {
+        if (m_size - pos < sizeof(SnapshotChunkHeader))
+        {
+            return; // truncated
+        }
+
+        auto const *pChunkHeader
+                = reinterpret_cast<SnapshotChunkHeader const*>(m_pData + pos);
+        pos += sizeof(SnapshotChunkHeader);
+
+        // Checked before padding, so a corrupt size can't overflow
+        if (m_size - pos < pChunkHeader->m_size)
+        {
+            return; // truncated
+        }
+
+        uint64_t const padded = (pChunkHeader->m_size + gc_snapshotAlign - 1)
+                              / gc_snapshotAlign * gc_snapshotAlign;
+        if (m_size - pos < padded)
+        {
+            return; // truncated
+        }
+
+        m_chunks.push_back({pChunkHeader, m_pData + pos});
+        pos += padded;
+    }
+
+    m_valid = true;
+}
+
+SnapshotReader::~SnapshotReader()
+{
+#if !defined(_WIN32)
+    if (m_mapped)
+    {
+        ::munmap(const_cast<unsigned char*>(m_pData), m_size);
+    }
+#endif
+}
+
+SnapshotReader::Chunk const* SnapshotReader::find(SnapshotChunkId_t id,
+                                                  uint32_t version) const
+{
+    for (Chunk const &chunk : m_chunks)
+    {
+        if (chunk.m_pHeader->m_id == id)
+        {
+            return (chunk.m_pHeader->m_version == version) ? &chunk : nullptr;
+        }
+    }
+    return nullptr;
+}
+
+std::vector<SnapshotReader::Chunk const*> SnapshotReader::find_all(
+        SnapshotChunkId_t id, uint32_t version) const
+{
+    std::vector<Chunk const*> found;
+    for (Chunk const &chunk : m_chunks)
+    {
+        if (chunk.m_pHeader->m_id == id
+            && chunk.m_pHeader->m_version == version)
+        {
+            found.push_back(&chunk);
+        }
+    }
+    return found;
+}
+
+ArrayView<const Satellite> SnapshotReader::pool_sats(Chunk const& chunk)
+{
+    uint64_t const size = chunk.m_pHeader->m_size;
+    uint64_t const stride = chunk.m_pHeader->m_stride;
+    uint64_t const count = chunk.m_pHeader->m_count;
+
+    // Divide instead of multiplying, so a corrupt count can't overflow
+    if (count > size / sizeof(Satellite))
+    {
+        return {};
+    }
+
+    uint64_t const offset = snapshot_pool_offset(count);
+
+    if (offset > size || (stride != 0 && count > (size - offset) / stride))
+    {
+        return {};
+    }
+
+    return {reinterpret_cast<Satellite const*>(chunk.m_pData), count};
+}
+
+std::vector<std::string_view> SnapshotReader::read_strings(
+        SnapshotChunkId_t id) const
+{
+    std::vector<std::string_view> strings;
+    Chunk const *pChunk = find(id, 1);
+
+    if (pChunk == nullptr)
+    {
+        return strings;
+    }
+
+    uint64_t const size = pChunk->m_pHeader->m_size;
+    uint64_t const count = pChunk->m_pHeader->m_count;
+
+    // Divide instead of multiplying, so a corrupt count can't overflow
+    if (count >= size / sizeof(uint64_t))
+    {
+        return strings; // corrupt
+    }
+
+    uint64_t const charsOffset = (count + 1) * sizeof(uint64_t);
+    uint64_t const charsSize = size - charsOffset;
+    auto const *pOffsets = reinterpret_cast<uint64_t const*>(pChunk->m_pData);
+    auto const *pChars = reinterpret_cast<char const*>(pChunk->m_pData
+                                                       + charsOffset);
+
+    // Offsets must not decrease, and must stay within the characters
+    if (pOffsets[0] != 0 || pOffsets[count] > charsSize)
+    {
+        return strings; // corrupt
+    }
+
+    for (uint64_t i = 0; i < count; i ++)
+    {
+        if (pOffsets[i + 1] < pOffsets[i])
+        {
+            return strings; // corrupt
+        }
+    }
+
+    strings.reserve(count);
+    for (std::size_t i = 0; i < count; i ++)
+    {
+        strings.emplace_back(pChars + pOffsets[i],
+                             pOffsets[i + 1] - pOffsets[i]);
+    }
+    return strings;
+}
+
+bool osp::universe::snapshot_read(ArrayView<const unsigned char>& rData,
+                                  void* pOut, std::size_t size)
+{
+    if (rData.size() < size)
+    {
+        return false;
+    }
+
+    if (size != 0)
+    {
+        std::memcpy(pOut, rData.data(), size);
+    }
+    rData = {rData.data() + size, rData.size() - size};
+    return true;
+}
+
+// ---- Universe ----
+
+bool osp::universe::snapshot_save(Universe const& uni, SnapshotWriter& rWriter)
+{
+    auto const &reg = uni.m_registry;
+
+    // Trajectories, only written to match them up when loading
+
+    std::unordered_map<ISystemTrajectory const*, uint32_t> trajIndices;
+    std::vector<std::string_view> trajNames;
+    std::vector<Satellite> trajCenters;
+
+    for (std::unique_ptr<ISystemTrajectory> const &pTraj : uni.m_trajectories)
+    {
+        trajIndices.emplace(pTraj.get(), uint32_t(trajNames.size()));
+        trajNames.push_back(pTraj->get_type_name());
+        trajCenters.push_back(pTraj->get_center());
+    }
+
+    SnapUniverse const univ{uni.m_time, uni.m_root, uint32_t(trajNames.size())};
+    rWriter.chunk_begin(c_chunkUniverse, 1, 1, sizeof(SnapUniverse));
+    rWriter.chunk_write(&univ, sizeof(SnapUniverse));
+    rWriter.chunk_end();
+
+    rWriter.write_strings(c_chunkTrajNames, trajNames);
+    rWriter.chunk_begin(c_chunkTrajCenters, 1, trajCenters.size(),
+                        sizeof(Satellite));
+    rWriter.chunk_write(trajCenters.data(),
+                        trajCenters.size() * sizeof(Satellite));
+    rWriter.chunk_end();
+
+    // Data of each trajectory, such as orbits, that can't be recalculated
+    // from the components saved below
+    for (std::size_t t = 0; t < uni.m_trajectories.size(); t ++)
+    {
+        rWriter.chunk_begin(c_chunkTrajData, 1, t, 0);
+        uni.m_trajectories[t]->snapshot_save(rWriter);
+        rWriter.chunk_end();
+    }
+
+    // All satellites, sorted so they can be recreated in order
+
+    std::vector<Satellite> sats;
+    sats.reserve(reg.size());
+    reg.each([&sats] (Satellite sat) { sats.push_back(sat); });
+    std::sort(sats.begin(), sats.end(), [] (Satellite lhs, Satellite rhs)
+    {
+        return sat_index(lhs) < sat_index(rhs);
+    });
+
+    rWriter.chunk_begin(c_chunkSatellites, 1, sats.size(), sizeof(Satellite));
+    rWriter.chunk_write(sats.data(), sats.size() * sizeof(Satellite));
+    rWriter.chunk_end();
+
+    // UCompTransformTraj, with names split into their own chunk
+
+    std::size_t const transformCount = reg.size<UCompTransformTraj>();
+    Satellite const *pTransformSats = reg.data<UCompTransformTraj>();
+    UCompTransformTraj const *pTransforms = reg.raw<UCompTransformTraj>();
+    auto const viewTraj = reg.view<const UCompTrajectory>();
+    auto const viewName = reg.view<const UCompName>();
+
+    rWriter.chunk_begin(c_chunkTransform, 1, transformCount,
+                        sizeof(SnapTransformTraj));
+    rWriter.chunk_write(pTransformSats, transformCount * sizeof(Satellite));
+    rWriter.chunk_pad();
+
+    std::vector<SnapTransformTraj> records;
+    records.reserve(std::min(transformCount, c_batchSize));
+
+    for (std::size_t start = 0; start < transformCount; start += c_batchSize)
+    {
+        std::size_t const end = std::min(transformCount, start + c_batchSize);
+        records.clear();
+
+        for (std::size_t i = start; i < end; i ++)
+        {
+            UCompTransformTraj const &transform = pTransforms[i];
+            UCompTrajectory const &traj = viewTraj.get(pTransformSats[i]);
+            SnapTransformTraj &rRecord = records.emplace_back();
+
+            rRecord.m_position = transform.m_position;
+            rRecord.m_rotation = transform.m_rotation;
+            rRecord.m_parent = transform.m_parent;
+            rRecord.m_index = traj.m_index;
+            rRecord.m_padding = 0;
+
+            auto const found = trajIndices.find(traj.m_trajectory);
+            rRecord.m_trajectory = (found != trajIndices.end())
+                                 ? found->second : c_noIndex;
+        }
+
+        rWriter.chunk_write(records.data(),
+                            records.size() * sizeof(SnapTransformTraj));
+    }
+    rWriter.chunk_end();
+
+    // Names parallel to transforms, empty for satellites without UCompName
+    std::vector<std::string_view> names;
+    names.reserve(transformCount);
+    for (std::size_t i = 0; i < transformCount; i ++)
+    {
+        Satellite const sat = pTransformSats[i];
+        names.push_back(viewName.contains(sat) ? viewName.get(sat).m_name
+                                               : std::string_view{});
+    }
+    rWriter.write_strings(c_chunkNames, names);
+
+    // UCompType as indices into a table of type names
+
+    std::unordered_map<ITypeSatellite const*, uint32_t> typeIndices;
+    std::vector<std::string_view> typeNames;
+
+    for (auto const &[name, pType] : uni.m_satTypes)
+    {
+        typeIndices.emplace(pType.get(), uint32_t(typeNames.size()));
+        typeNames.push_back(name);
+    }
+    rWriter.write_strings(c_chunkTypeNames, typeNames);
+
+    std::size_t const typeCount = reg.size<UCompType>();
+    UCompType const *pTypes = reg.raw<UCompType>();
+    std::vector<uint32_t> typeRecords(typeCount);
+
+    for (std::size_t i = 0; i < typeCount; i ++)
+    {
+        auto const found = typeIndices.find(pTypes[i].m_type);
+        typeRecords[i] = (found != typeIndices.end()) ? found->second
+                                                      : c_noIndex;
+    }
+    rWriter.write_pool(c_chunkType, 1, {reg.data<UCompType>(), typeCount},
+                       typeRecords.data(), sizeof(uint32_t));
+
+    // Plain components
+
+    snapshot_save_pod<UCompVelocity>(uni, rWriter, c_chunkVelocity);
+    snapshot_save_pod<UCompActivatable>(uni, rWriter, c_chunkActivatable);
+
+    return rWriter.is_open();
+}
+
+int osp::universe::snapshot_load(Universe& rUni, SnapshotReader const& reader)
+{
+    using SnapshotChunk = SnapshotReader::Chunk;
+
+    if (!reader.is_valid())
+    {
+        return 1;
+    }
+
+    SnapshotChunk const *pUniv = reader.find(c_chunkUniverse, 1);
+    SnapshotChunk const *pSats = reader.find(c_chunkSatellites, 1);
+    SnapshotChunk const *pTransform = reader.find(c_chunkTransform, 1);
+    SnapshotChunk const *pType = reader.find(c_chunkType, 1);
+
+    SnapshotChunk const *pCenters = reader.find(c_chunkTrajCenters, 1);
+
+    // Everything is checked before the universe is touched, so a corrupt
+    // snapshot leaves it as it was
+
+    if (pUniv == nullptr || pSats == nullptr || pTransform == nullptr
+        || pType == nullptr
+        || pUniv->m_pHeader->m_stride != sizeof(SnapUniverse)
+        || pUniv->m_pHeader->m_size < sizeof(SnapUniverse)
+        || pSats->m_pHeader->m_stride != sizeof(Satellite)
+        || pSats->m_pHeader->m_count
+                > pSats->m_pHeader->m_size / sizeof(Satellite)
+        || (pCenters != nullptr
+            && (pCenters->m_pHeader->m_stride != sizeof(Satellite)
+                || pCenters->m_pHeader->m_count
+                        > pCenters->m_pHeader->m_size / sizeof(Satellite))))
+    {
+        return 1;
+    }
+
+    auto const &univ = *reinterpret_cast<SnapUniverse const*>(pUniv->m_pData);
+    ArrayView<const Satellite> const sats{
+            reinterpret_cast<Satellite const*>(pSats->m_pData),
+            std::size_t(pSats->m_pHeader->m_count)};
+
+    auto const transformSats = SnapshotReader::pool_sats(*pTransform);
+    auto const transforms = SnapshotReader::pool_components<SnapTransformTraj>(
+                *pTransform);
+    auto const typeSats = SnapshotReader::pool_sats(*pType);
+    auto const types = SnapshotReader::pool_components<uint32_t>(*pType);
+
+    if (transforms.size() != transformSats.size()
+        || types.size() != typeSats.size())
+    {
+        return 1;
+    }
+
+    // Satellites are created with their saved ids, which must be unique.
+    // Components can only be added to satellites that were saved
+    std::vector<Satellite> saved;
+    for (Satellite const sat : sats)
+    {
+        std::size_t const index = sat_index(sat);
+
+        if (sat == entt::null)
+        {
+            return 1;
+        }
+
+        if (index >= saved.size())
+        {
+            saved.resize(index + 1, entt::null);
+        }
+        else if (saved[index] != entt::null)
+        {
+            return 1; // duplicate
+        }
+        saved[index] = sat;
+    }
+
+    if (!sats_saved_once(saved, transformSats)
+        || !sats_saved_once(saved, typeSats)
+        || sat_index(univ.m_root) >= saved.size()
+        || saved[sat_index(univ.m_root)] != univ.m_root)
+    {
+        return 1;
+    }
+
+    int status = 0;
+
+    // Detach current satellites from trajectories
+
+    {
+        std::unordered_map<ISystemTrajectory*, std::vector<Satellite>> members;
+        auto view = rUni.m_registry.view<UCompTrajectory>();
+
+        for (Satellite sat : view)
+        {
+            ISystemTrajectory *pTraj = view.get(sat).m_trajectory;
+            if (pTraj != nullptr)
+            {
+                members[pTraj].push_back(sat);
+            }
+        }
+
+        for (auto const &[pTraj, trajSats] : members)
+        {
+            pTraj->remove({trajSats.data(), trajSats.size()});
+        }
+    }
+
+    // Replace the registry, so satellites can be created with their saved
+    // ids in order. Reusing the old one would recycle ids instead
+
+    rUni.m_registry = entt::basic_registry<Satellite>{};
+    rUni.reg_connect();
+    rUni.m_frames.clear();
+    rUni.m_framesX.clear();
+    rUni.m_framesY.clear();
+    rUni.m_framesZ.clear();
+    rUni.m_framesChanged.clear();
+    rUni.m_framesRemoved.clear();
+    rUni.m_satsRemoved.clear();
+    rUni.m_satsDirty.clear();
+    rUni.m_spatialIndex.clear();
+    rUni.m_conjunctions.clear();
+
+    auto &rReg = rUni.m_registry;
+
+    for (Satellite sat : sats)
+    {
+        rReg.create(sat);
+    }
+
+    rUni.m_root = univ.m_root;
+    rUni.m_time = univ.m_time;
+
+    // UCompTransformTraj, with UCompTrajectory filled in when satellites are
+    // added to trajectories below
+
+    {
+        std::vector<UCompTransformTraj> components(transforms.size());
+
+        for (std::size_t i = 0; i < transforms.size(); i ++)
+        {
+            UCompTransformTraj &rComp = components[i];
+            rComp.m_position = transforms[i].m_position;
+            rComp.m_rotation = transforms[i].m_rotation;
+            rComp.m_parent = transforms[i].m_parent;
+        }
+
+        rReg.insert<UCompTransformTraj>(
+                transformSats.begin(), transformSats.end(),
+                components.begin(), components.end());
+        rReg.insert<UCompTrajectory>(transformSats.begin(),
+                                     transformSats.end());
+        rUni.sat_mark_dirty({transformSats.data(), transformSats.size()});
+    }
+
+    // UCompName
+
+    std::vector<std::string_view> const names = reader.read_strings(
+                c_chunkNames);
+
+    if (names.size() == transforms.size())
+    {
+        std::vector<Satellite> namedSats;
+        std::vector<UCompName> components;
+
+        for (std::size_t i = 0; i < names.size(); i ++)
+        {
+            if (!names[i].empty())
+            {
+                namedSats.push_back(transformSats[i]);
+                components.push_back({rUni.m_names.intern(names[i])});
+            }
+        }
+
+        rReg.insert<UCompName>(
+                namedSats.begin(), namedSats.end(),
+                std::make_move_iterator(components.begin()),
+                std::make_move_iterator(components.end()));
+    }
+
+    // UCompType
+
+    {
+        std::vector<ITypeSatellite*> typeLookup;
+
+        for (std::string_view name : reader.read_strings(c_chunkTypeNames))
+        {
+            auto const found = rUni.m_satTypes.find(std::string(name));
+
+            if (found != rUni.m_satTypes.end())
+            {
+                typeLookup.push_back(found->second.get());
+            }
+            else
+            {
+                typeLookup.push_back(nullptr);
+                status = 2; // type isn't registered
+            }
+        }
+
+        std::vector<UCompType> components(types.size());
+
+        for (std::size_t i = 0; i < types.size(); i ++)
+        {
+            if (types[i] < typeLookup.size())
+            {
+                components[i].m_type = typeLookup[types[i]];
+            }
+        }
+
+        rReg.insert<UCompType>(typeSats.begin(), typeSats.end(),
+                               components.begin(), components.end());
+    }
+
+    // Plain components
+
+    if (snapshot_load_pod<UCompVelocity>(rUni, reader, c_chunkVelocity) != 0
+        || snapshot_load_pod<UCompActivatable>(rUni, reader,
+                                               c_chunkActivatable) != 0)
+    {
+        status = 2;
+    }
+
+    // Re-add satellites to matching trajectories, in their saved order
+
+    {
+        std::vector<std::string_view> const trajNames
+                = reader.read_strings(c_chunkTrajNames);
+
+        std::size_t const trajCount = std::min<std::size_t>(
+                univ.m_trajectoryCount, rUni.m_trajectories.size());
+
+        std::vector<SnapshotChunk const*> trajData(trajCount, nullptr);
+        for (SnapshotChunk const *pChunk : reader.find_all(c_chunkTrajData, 1))
+        {
+            if (pChunk->m_pHeader->m_count < trajCount)
+            {
+                trajData[pChunk->m_pHeader->m_count] = pChunk;
+            }
+        }
+
+        // (index in trajectory, satellite) for each trajectory
+        std::vector<std::vector<std::pair<uint32_t, Satellite>>> members(
+                trajCount);
+
+        for (std::size_t i = 0; i < transforms.size(); i ++)
+        {
+            uint32_t const trajIndex = transforms[i].m_trajectory;
+
+            if (trajIndex == c_noIndex)
+            {
+                continue;
+            }
+
+            if (trajIndex >= trajCount)
+            {
+                status = 2; // trajectory doesn't exist
+                continue;
+            }
+
+            members[trajIndex].emplace_back(transforms[i].m_index,
+                                            transformSats[i]);
+        }
+
+        std::vector<Satellite> trajSats;
+
+        for (std::size_t t = 0; t < trajCount; t ++)
+        {
+            ISystemTrajectory &rTraj = *rUni.m_trajectories[t];
+
+            bool const matches
+                    = t < trajNames.size()
+                    && trajNames[t] == rTraj.get_type_name()
+                    && pCenters != nullptr
+                    && t < pCenters->m_pHeader->m_count
+                    && reinterpret_cast<Satellite const*>(pCenters->m_pData)[t]
+                            == rTraj.get_center();
+
+            if (!matches)
+            {
+                if (!members[t].empty())
+                {
+                    status = 2;
+                }
+                continue;
+            }
+
+            std::sort(members[t].begin(), members[t].end());
+
+            trajSats.clear();
+            for (auto const &[index, sat] : members[t])
+            {
+                trajSats.push_back(sat);
+            }
+
+            rTraj.add({trajSats.data(), trajSats.size()});
+
+            // Adding calculates data from positions and velocities, replace
+            // it with the saved data
+            SnapshotChunk const *pData = trajData[t];
+            if (pData == nullptr
+                || rTraj.snapshot_load({pData->m_pData,
+                                        std::size_t(pData->m_pHeader->m_size)})
+                    != 0)
+            {
+                status = 2;
+            }
+        }
+
+        if (univ.m_trajectoryCount > rUni.m_trajectories.size())
+        {
+            status = 2;
+        }
+    }
+
+    rUni.sat_frames_update();
+
+    return status;
+}
+
+void osp::universe::snapshot_save_vehicles(Universe const& uni,
+                                           SnapshotWriter& rWriter)
+{
+    auto const &reg = uni.get_reg();
+
+    std::size_t const count = reg.size<UCompVehicle>();
+    UCompVehicle const *pVehicles = reg.raw<UCompVehicle>();
+
+    // Blueprints as indices into a table of resource names
+    std::vector<std::string> blueprintNames;
+    std::unordered_map<std::string, uint32_t> blueprintIndices;
+    std::vector<uint32_t> records(count);
+
+    for (std::size_t i = 0; i < count; i ++)
+    {
+        DependRes<BlueprintVehicle> const &blueprint = pVehicles[i].m_blueprint;
+
+        if (blueprint.empty())
+        {
+            records[i] = c_noIndex;
+            continue;
+        }
+
+        auto const [it, inserted] = blueprintIndices.try_emplace(
+                    blueprint.name(), uint32_t(blueprintNames.size()));
+        if (inserted)
+        {
+            blueprintNames.push_back(it->first);
+        }
+        records[i] = it->second;
+    }
+
+    rWriter.write_strings(c_chunkBlueprints, {blueprintNames.begin(),
+                                              blueprintNames.end()});
+    rWriter.write_pool(c_chunkVehicle, 1, {reg.data<UCompVehicle>(), count},
+                       records.data(), sizeof(uint32_t));
+}
+
+int osp::universe::snapshot_load_vehicles(Universe& rUni,
+                                          SnapshotReader const& reader,
+                                          Package& rPackage)
+{
+    SnapshotReader::Chunk const *pChunk = reader.find(c_chunkVehicle, 1);
+
+    if (pChunk == nullptr)
+    {
+        return 0;
+    }
+
+    auto const sats = SnapshotReader::pool_sats(*pChunk);
+    auto const records = SnapshotReader::pool_components<uint32_t>(*pChunk);
+
+    if (records.size() != sats.size()
+        || !snapshot_pool_insertable<UCompVehicle>(rUni, sats))
+    {
+        return 2;
+    }
+
+    int status = 0;
+
+    std::vector<DependRes<BlueprintVehicle>> blueprints;
+    for (std::string_view name : reader.read_strings(c_chunkBlueprints))
+    {
+        blueprints.push_back(rPackage.get<BlueprintVehicle>(name));
+        if (blueprints.back().empty())
+        {
+            status = 2; // blueprint not found
+        }
+    }
+
+    std::vector<UCompVehicle> components(records.size());
+
+    for (std::size_t i = 0; i < records.size(); i ++)
+    {
+        if (records[i] < blueprints.size())
+        {
+            components[i].m_blueprint
+                    = DependRes<BlueprintVehicle>(blueprints[records[i]]);
+        }
+    }
+
+    rUni.get_reg().insert<UCompVehicle>(
+            sats.begin(), sats.end(),
+            std::make_move_iterator(components.begin()),
+            std::make_move_iterator(components.end()));
+    return status;
+}
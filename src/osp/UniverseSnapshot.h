@@ -0,0 +1,415 @@
+/**
+ * Open Space Program
+ * Copyright © 2019-2020 Open Space Program Project
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+
+#include "Universe.h"
+
+#include <Corrade/Containers/ArrayView.h>
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace osp
+{
+class Package;
+}
+
+namespace osp::universe
+{
+
+/*
+ * Universe snapshots are binary files made of chunks. Each component pool is
+ * a chunk storing an array of satellites followed by an array of components,
+ * aligned so both can be used straight from a memory-mapped file and
+ * bulk-copied into the registry.
+ *
+ * Layout, in native byte order:
+ * - SnapshotHeader
+ * - For each chunk: SnapshotChunkHeader, then its payload padded to
+ *   gc_snapshotAlign bytes
+ *
+ * Pointers are stored as indices. UCompType::m_type indexes a table of type
+ * names, UCompTrajectory::m_trajectory indexes the Universe's
+ * trajectories, and UCompVehicle blueprints index a table of resource names.
+ *
+ * Each trajectory also gets a chunk of its own data, such as orbits, see
+ * ISystemTrajectory::snapshot_save. Its count is the trajectory's index.
+ */
+
+using SnapshotChunkId_t = uint32_t;
+
+/**
+ * @return Chunk id from a four character code, like "TRNS"
+ */
+constexpr SnapshotChunkId_t snapshot_chunk_id(char const (&code)[5])
+{
+    return SnapshotChunkId_t(uint8_t(code[0]))
+         | (SnapshotChunkId_t(uint8_t(code[1])) << 8)
+         | (SnapshotChunkId_t(uint8_t(code[2])) << 16)
+         | (SnapshotChunkId_t(uint8_t(code[3])) << 24);
+}
+
+constexpr uint32_t gc_snapshotVersion = 1;
+constexpr std::size_t gc_snapshotAlign = 16;
+
+struct SnapshotHeader
+{
+    char m_magic[8];
+    uint32_t m_version;
+    uint32_t m_chunkCount;
+    uint64_t m_reserved[2];
+};
+
+struct SnapshotChunkHeader
+{
+    SnapshotChunkId_t m_id;
+
+    // Version of this chunk's layout
+    uint32_t m_version;
+
+    // Number of elements
+    uint64_t m_count;
+
+    // Size of each element in bytes, used to reject changed layouts
+    uint64_t m_stride;
+
+    // Payload size in bytes, excluding padding at the end
+    uint64_t m_size;
+};
+
+static_assert(sizeof(SnapshotHeader) % gc_snapshotAlign == 0);
+static_assert(sizeof(SnapshotChunkHeader) % gc_snapshotAlign == 0);
+
+/**
+ * @return Offset of the components in a pool chunk, after the satellites
+ */
+constexpr std::size_t snapshot_pool_offset(std::size_t count)
+{
+    std::size_t const size = count * sizeof(Satellite);
+    return (size + gc_snapshotAlign - 1) / gc_snapshotAlign * gc_snapshotAlign;
+}
+
+/**
+ * Writes a snapshot file chunk by chunk
+ */
+class SnapshotWriter
+{
+public:
+
+    explicit SnapshotWriter(std::string const& path);
+    ~SnapshotWriter();
+
+    SnapshotWriter(SnapshotWriter const& copy) = delete;
+    SnapshotWriter(SnapshotWriter&& move) = delete;
+
+    bool is_open() const { return m_file.is_open() && m_file.good(); }
+
+    /**
+     * Start a chunk. Write its payload with chunk_write, then call chunk_end
+     *
+     * @param id [in] Chunk id, see snapshot_chunk_id
+     * @param version [in] Version of the chunk's layout
+     * @param count [in] Number of elements
+     * @param stride [in] Size of each element
+     */
+    void chunk_begin(SnapshotChunkId_t id, uint32_t version,
+                     uint64_t count, uint64_t stride);
+
+    void chunk_write(void const* pData, std::size_t size);
+
+    /**
+     * Pad the payload written so far to gc_snapshotAlign, so the next array
+     * is aligned
+     */
+    void chunk_pad();
+
+    void chunk_end();
+
+    /**
+     * Write a component pool chunk
+     *
+     * @param sats [in] Satellites that own each component
+     * @param pComponents [in] Contiguous components, same count as sats
+     * @param stride [in] Size of each component
+     */
+    void write_pool(SnapshotChunkId_t id, uint32_t version,
+                    Corrade::Containers::ArrayView<const Satellite> sats,
+                    void const* pComponents, std::size_t stride);
+
+    /**
+     * Write a chunk of strings. The payload is count + 1 uint64_t offsets,
+     * followed by all the characters
+     */
+    void write_strings(SnapshotChunkId_t id,
+                       std::vector<std::string_view> const& strings);
+
+    /**
+     * Write the chunk count into the header and close the file
+     * @return true if everything was written
+     */
+    bool finish();
+
+private:
+
+    std::ofstream m_file;
+    std::streampos m_chunkStart;
+    uint64_t m_chunkSize{0};
+    uint32_t m_chunkCount{0};
+    bool m_finished{false};
+};
+
+/**
+ * Reads a snapshot file. The file is memory-mapped where supported, or read
+ * into memory otherwise. Arrays returned point into the file's memory, and
+ * are valid as long as the reader is.
+ */
+class SnapshotReader
+{
+public:
+
+    struct Chunk
+    {
+        SnapshotChunkHeader const *m_pHeader;
+        unsigned char const *m_pData;
+    };
+
+    explicit SnapshotReader(std::string const& path);
+    ~SnapshotReader();
+
+    SnapshotReader(SnapshotReader const& copy) = delete;
+    SnapshotReader(SnapshotReader&& move) = delete;
+
+    /**
+     * @return true if the file was opened, and its header and chunks are
+     *         intact
+     */
+    constexpr bool is_valid() const noexcept { return m_valid; }
+
+    /**
+     * @return Chunk with the id and version, or nullptr if there isn't one
+     */
+    Chunk const* find(SnapshotChunkId_t id, uint32_t version) const;
+
+    /**
+     * @return Every chunk with the id and version, in file order
+     */
+    std::vector<Chunk const*> find_all(SnapshotChunkId_t id,
+                                       uint32_t version) const;
+
+    /**
+     * @return Satellites of a pool chunk
+     */
+    static Corrade::Containers::ArrayView<const Satellite> pool_sats(
+            Chunk const& chunk);
+
+    /**
+     * @return Components of a pool chunk, or an empty view if their size
+     *         doesn't match COMP_T
+     */
+    template<typename COMP_T>
+    static Corrade::Containers::ArrayView<const COMP_T> pool_components(
+            Chunk const& chunk);
+
+    /**
+     * @return Strings of a chunk written by SnapshotWriter::write_strings,
+     *         empty if there is no such chunk
+     */
+    std::vector<std::string_view> read_strings(SnapshotChunkId_t id) const;
+
+private:
+
+    unsigned char const *m_pData{nullptr};
+    std::size_t m_size{0};
+
+    // Used if memory mapping isn't available
+    std::vector<unsigned char> m_buffer;
+
+    std::vector<Chunk> m_chunks;
+    bool m_mapped{false};
+    bool m_valid{false};
+};
+
+/**
+ * Copy bytes from the front of a chunk's payload, and advance past them
+ *
+ * @param rData [in,out] Rest of the payload
+ * @param pOut [out] Destination
+ * @param size [in] Number of bytes to copy
+ *
+ * @return false if the payload is too short
+ */
+bool snapshot_read(Corrade::Containers::ArrayView<const unsigned char>& rData,
+                   void* pOut, std::size_t size);
+
+/**
+ * Save satellites, with their UCompTransformTraj, UCompName, UCompType,
+ * UCompVelocity, UCompActivatable, trajectory membership, and each
+ * trajectory's own data
+ *
+ * @return true if everything was written
+ */
+bool snapshot_save(Universe const& uni, SnapshotWriter& rWriter);
+
+/**
+ * Replace all satellites in the universe with ones from a snapshot.
+ *
+ * Satellite types and trajectories are not saved, they must already be
+ * created the same way as the saved universe. Satellites are re-added to
+ * trajectories of matching type and center, in their saved order, then
+ * each trajectory loads its own data, see ISystemTrajectory::snapshot_load.
+ *
+ * Other components can be loaded afterwards, see snapshot_load_pod and
+ * snapshot_load_vehicles.
+ *
+ * @return 0 on success, 1 if the snapshot can't be read, or 2 if some types
+ *         or trajectories didn't match. The universe is left untouched if
+ *         the snapshot can't be read
+ */
+int snapshot_load(Universe& rUni, SnapshotReader const& reader);
+
+/**
+ * Save UCompVehicle, storing blueprints by resource name
+ */
+void snapshot_save_vehicles(Universe const& uni, SnapshotWriter& rWriter);
+
+/**
+ * Load UCompVehicle, finding blueprints by name in a package
+ * @return 0 on success, 2 if some blueprints weren't found or the pool is
+ *         corrupt
+ */
+int snapshot_load_vehicles(Universe& rUni, SnapshotReader const& reader,
+                           Package& rPackage);
+
+/**
+ * Save a pool of a trivially copyable component as a single chunk
+ */
+template<typename COMP_T>
+void snapshot_save_pod(Universe const& uni, SnapshotWriter& rWriter,
+                       SnapshotChunkId_t id, uint32_t version = 1);
+
+/**
+ * Load a pool saved by snapshot_save_pod, bulk-copying components straight
+ * from the snapshot into the registry
+ *
+ * @return 0 on success or if there is no such chunk, 1 if the layout or
+ *         satellites don't match
+ */
+template<typename COMP_T>
+int snapshot_load_pod(Universe& rUni, SnapshotReader const& reader,
+                      SnapshotChunkId_t id, uint32_t version = 1);
+
+/**
+ * Check the satellites of a pool loaded after snapshot_load(), before
+ * inserting components for them
+ *
+ * @return true if every satellite exists, doesn't have a COMP_T yet, and
+ *         appears only once
+ */
+template<typename COMP_T>
+bool snapshot_pool_insertable(Universe& rUni,
+        Corrade::Containers::ArrayView<const Satellite> sats);
+
+
+template<typename COMP_T>
+Corrade::Containers::ArrayView<const COMP_T> SnapshotReader::pool_components(
+        Chunk const& chunk)
+{
+    if (chunk.m_pHeader->m_stride != sizeof(COMP_T))
+    {
+        return {};
+    }
+
+    std::size_t const count = chunk.m_pHeader->m_count;
+    return {reinterpret_cast<COMP_T const*>(
+                    chunk.m_pData + snapshot_pool_offset(count)), count};
+}
+
+template<typename COMP_T>
+void snapshot_save_pod(Universe const& uni, SnapshotWriter& rWriter,
+                       SnapshotChunkId_t id, uint32_t version)
+{
+    static_assert(std::is_trivially_copyable_v<COMP_T>);
+
+    auto const &reg = uni.get_reg();
+    std::size_t const count = reg.size<COMP_T>();
+
+    // Pools are already contiguous arrays, write them directly
+    rWriter.write_pool(id, version, {reg.data<COMP_T>(), count},
+                       reg.raw<COMP_T>(), sizeof(COMP_T));
+}
+
+template<typename COMP_T>
+int snapshot_load_pod(Universe& rUni, SnapshotReader const& reader,
+                      SnapshotChunkId_t id, uint32_t version)
+{
+    static_assert(std::is_trivially_copyable_v<COMP_T>);
+
+    SnapshotReader::Chunk const *pChunk = reader.find(id, version);
+
+    if (pChunk == nullptr)
+    {
+        return 0;
+    }
+
+    auto const sats = SnapshotReader::pool_sats(*pChunk);
+    auto const comps = SnapshotReader::pool_components<COMP_T>(*pChunk);
+
+    if (comps.size() != sats.size()
+        || !snapshot_pool_insertable<COMP_T>(rUni, sats))
+    {
+        return 1;
+    }
+
+    rUni.get_reg().insert<COMP_T>(sats.begin(), sats.end(),
+                                  comps.begin(), comps.end());
+    return 0;
+}
+
+template<typename COMP_T>
+bool snapshot_pool_insertable(Universe& rUni,
+        Corrade::Containers::ArrayView<const Satellite> sats)
+{
+    auto &reg = rUni.get_reg();
+    auto const view = reg.view<COMP_T>();
+
+    // Indices of valid satellites are below the registry's size
+    std::vector<bool> seen(reg.size(), false);
+
+    for (Satellite const sat : sats)
+    {
+        if (!reg.valid(sat) || view.contains(sat) || seen[sat_index(sat)])
+        {
+            return false;
+        }
+        seen[sat_index(sat)] = true;
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,178 @@
+/**
+ * Open Space Program
+ * Copyright © 2019-2020 Open Space Program Project
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "UniverseState.h"
+#include "Universe.h"
+
+using namespace osp::universe;
+using osp::shared_string;
+
+bool UniverseStateBuffer::publish(Universe const& uni)
+{
+    uint64_t const published = m_published.load();
+    std::size_t const publishedSlot = published & 0xff;
+
+    // Find a slot that isn't the latest and has no readers. Readers can only
+    // start reading the latest slot, so a free slot stays free
+    Slot *pSlot = nullptr;
+    std::size_t slotIndex = 0;
+
+    for (std::size_t i = 0; i < smc_slots; i ++)
+    {
+        if ((published == 0 || i != publishedSlot)
+            && m_slots[i].m_readers.load() == 0)
+        {
+            pSlot = &m_slots[i];
+            slotIndex = i;
+            break;
+        }
+    }
+
+    if (pSlot == nullptr)
+    {
+        return false;
+    }
+
+    auto const &reg = uni.get_reg();
+    auto const view = reg.view<const UCompTransformTraj>();
+    auto const viewVel = reg.view<const UCompVelocity>();
+    auto const viewType = reg.view<const UCompType>();
+    auto const viewTraj = reg.view<const UCompTrajectory>();
+    auto const viewName = reg.view<const UCompName>();
+
+    // Root-relative positions are calculated together
+    m_scratchSats.assign(view.begin(), view.end());
+    m_scratchPos.resize(m_scratchSats.size());
+    uni.sat_calc_pos(uni.sat_root(), {m_scratchSats.data(),
+                                      m_scratchSats.size()},
+                     {m_scratchPos.data(), m_scratchPos.size()});
+
+    UniverseState &rState = pSlot->m_state;
+    uint64_t const epoch = (published >> 8) + 1;
+
+    rState.m_time = uni.get_time();
+    rState.m_epoch = epoch;
+
+    rState.m_sats.resize(m_scratchSats.size());
+
+    // Types and trajectories can be destroyed and their addresses reused, so
+    // names are only cached for a single publish
+    m_scratchNames.clear();
+
+    for (std::size_t i = 0; i < m_scratchSats.size(); i ++)
+    {
+        Satellite const sat = m_scratchSats[i];
+        auto const &transform = view.get(sat);
+        SatState &rSatState = rState.m_sats[i];
+
+        rSatState.m_sat = sat;
+        rSatState.m_parent = transform.m_parent;
+        rSatState.m_position = transform.m_position;
+        rSatState.m_rootPosition = m_scratchPos[i];
+        rSatState.m_rotation = transform.m_rotation;
+        rSatState.m_velocity = viewVel.contains(sat)
+                             ? viewVel.get(sat).m_velocity : Vector3{0.0f};
+        rSatState.m_typeName = type_name_copy(
+                viewType.contains(sat) ? viewType.get(sat).m_type : nullptr);
+        rSatState.m_trajectoryName = trajectory_name_copy(
+                viewTraj.get(sat).m_trajectory);
+        rSatState.m_name = viewName.contains(sat) ? viewName.get(sat).m_name
+                                                  : shared_string{};
+    }
+
+    m_published.store((epoch << 8) | slotIndex);
+
+    return true;
+}
+
+shared_string UniverseStateBuffer::type_name_copy(ITypeSatellite *pType)
+{
+    if (pType == nullptr)
+    {
+        return {};
+    }
+
+    if (shared_string const *pFound = name_find(pType))
+    {
+        return *pFound;
+    }
+
+    return m_scratchNames.emplace_back(
+            pType, create_shared_string(pType->get_name())).second;
+}
+
+shared_string UniverseStateBuffer::trajectory_name_copy(
+        ISystemTrajectory *pTraj)
+{
+    if (pTraj == nullptr)
+    {
+        return {};
+    }
+
+    if (shared_string const *pFound = name_find(pTraj))
+    {
+        return *pFound;
+    }
+
+    return m_scratchNames.emplace_back(
+            pTraj, create_shared_string(pTraj->get_type_name())).second;
+}
+
+shared_string const* UniverseStateBuffer::name_find(void const* pOwner) const
+{
+    for (auto const &[pKey, name] : m_scratchNames)
+    {
+        if (pKey == pOwner)
+        {
+            return &name;
+        }
+    }
+
+    return nullptr;
+}
+
+UniverseStateBuffer::Handle UniverseStateBuffer::acquire() const
+{
+    while (true)
+    {
+        uint64_t const published = m_published.load();
+
+        if (published == 0)
+        {
+            return {};
+        }
+
+        Slot const &slot = m_slots[published & 0xff];
+        slot.m_readers.fetch_add(1);
+
+        // If something newer was published in the meantime, the writer might
+        // have picked this slot before it was marked as read. Try again
+        if (m_published.load() == published)
+        {
+            return Handle(&slot);
+        }
+
+        slot.m_readers.fetch_sub(1);
+    }
+}
@@ -0,0 +1,206 @@
+/**
+ * Open Space Program
+ * Copyright © 2019-2020 Open Space Program Project
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+
+#include "shared_string.h"
+#include "types.h"
+#include "universetypes.h"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace osp::universe
+{
+
+class Universe;
+
+/**
+ * Copy of a satellite's frequently read components
+ */
+struct SatState
+{
+    Satellite m_sat;
+    Satellite m_parent;
+
+    // Relative to m_parent
+    Vector3s m_position;
+
+    // Relative to the universe's root
+    Vector3s m_rootPosition;
+
+    Quaternion m_rotation;
+
+    // Zero if the satellite has no UCompVelocity
+    Vector3 m_velocity;
+
+    // Copied at publish, so readers never touch the live type or trajectory.
+    // Empty if the satellite has none
+    shared_string m_typeName;
+    shared_string m_trajectoryName;
+
+    // Shares storage with the satellite's UCompName, empty if it has none
+    shared_string m_name;
+};
+
+/**
+ * All satellites of a universe, as of a single publish
+ */
+struct UniverseState
+{
+    // Universe time when published
+    double m_time{0.0};
+
+    // Number of publishes before and including this one
+    uint64_t m_epoch{0};
+
+    std::vector<SatState> m_sats;
+};
+
+/**
+ * Lets other threads read the universe while it's being simulated.
+ *
+ * The simulation thread calls publish() once a frame is complete, copying the
+ * universe into a free slot and making it the latest. Any number of readers
+ * can then acquire() the latest copy without locks. A slot is not written
+ * again until every reader holding it lets go, so readers never see a
+ * half-written state, and the writer never waits for readers.
+ *
+ * Only one thread may publish.
+ */
+class UniverseStateBuffer
+{
+    struct Slot
+    {
+        UniverseState m_state;
+        mutable std::atomic<uint32_t> m_readers{0};
+    };
+
+public:
+
+    /**
+     * Read access to a published state. Keeps its slot from being reused
+     * until destroyed, so don't hold on to it for longer than needed.
+     */
+    class Handle
+    {
+        friend class UniverseStateBuffer;
+    public:
+        Handle() = default;
+        Handle(Handle const& copy) = delete;
+        Handle(Handle&& move) noexcept
+         : m_pSlot(std::exchange(move.m_pSlot, nullptr))
+        { }
+        ~Handle() { release(); }
+
+        Handle& operator=(Handle const& copy) = delete;
+        Handle& operator=(Handle&& move) noexcept
+        {
+            release();
+            m_pSlot = std::exchange(move.m_pSlot, nullptr);
+            return *this;
+        }
+
+        /**
+         * @return false if nothing was published yet
+         */
+        explicit operator bool() const noexcept { return m_pSlot != nullptr; }
+
+        UniverseState const& operator*() const noexcept
+        { return m_pSlot->m_state; }
+        UniverseState const* operator->() const noexcept
+        { return &m_pSlot->m_state; }
+
+    private:
+        explicit Handle(Slot const* pSlot) noexcept : m_pSlot(pSlot) { }
+
+        void release() noexcept
+        {
+            if (m_pSlot != nullptr)
+            {
+                m_pSlot->m_readers.fetch_sub(1);
+                m_pSlot = nullptr;
+            }
+        }
+
+        Slot const *m_pSlot{nullptr};
+    };
+
+    // One slot for the latest state, one being written, and two more so
+    // slow readers don't hold up publishing
+    static constexpr std::size_t smc_slots = 4;
+
+    /**
+     * Copy the universe's satellites into a free slot, then make it the
+     * latest state. Call only from the thread simulating the universe, after
+     * it has finished updating.
+     *
+     * @return false if every other slot is still held by readers, in which
+     *         case nothing is published this time
+     */
+    bool publish(Universe const& uni);
+
+    /**
+     * @return Handle to the latest published state, empty if nothing was
+     *         published yet. Safe to call from any thread.
+     */
+    Handle acquire() const;
+
+    /**
+     * @return Number of times a state was published
+     */
+    uint64_t get_epoch() const noexcept { return m_published.load() >> 8; }
+
+private:
+
+    std::array<Slot, smc_slots> m_slots;
+
+    // Latest state, as (epoch << 8) | slot index. 0 if none published
+    std::atomic<uint64_t> m_published{0};
+
+    /**
+     * Copy the name of a type or trajectory, or reuse the copy made earlier
+     * in the same publish. Empty if nullptr
+     */
+    shared_string type_name_copy(ITypeSatellite *pType);
+    shared_string trajectory_name_copy(ISystemTrajectory *pTraj);
+
+    /**
+     * @return Name copied for a type or trajectory, nullptr if there is none
+     */
+    shared_string const* name_find(void const* pOwner) const;
+
+    // Reused by publish()
+    std::vector<Satellite> m_scratchSats;
+    std::vector<Vector3s> m_scratchPos;
+
+    // Names copied by the current publish, by the type or trajectory they
+    // belong to. There are only a few of these, so a vector is searched
+    std::vector<std::pair<void const*, shared_string>> m_scratchNames;
+};
+
+}
@@ -0,0 +1,189 @@
+/**
+ * Open Space Program
+ * Copyright © 2019-2020 Open Space Program Project
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "WorkerPool.h"
+
+using namespace osp;
+
+namespace
+{
+
+// True while this thread is running a task, so nested calls don't deadlock
+thread_local bool t_inTask = false;
+
+/**
+ * Sets t_inTask for as long as it exists, restoring it even if a task throws
+ */
+struct InTaskScope
+{
+    InTaskScope() : m_prev(t_inTask) { t_inTask = true; }
+    ~InTaskScope() { t_inTask = m_prev; }
+
+    InTaskScope(InTaskScope const& copy) = delete;
+
+    bool m_prev;
+};
+
+}
+
+WorkerPool::WorkerPool(unsigned threads)
+{
+    m_threads.reserve(threads);
+    for (unsigned i = 0; i < threads; i ++)
+    {
+        m_threads.emplace_back(&WorkerPool::worker_loop, this);
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+
+    for (std::thread &thread : m_threads)
+    {
+        thread.join();
+    }
+}
+
+unsigned WorkerPool::default_thread_count()
+{
+    unsigned const hardware = std::thread::hardware_concurrency();
+    return (hardware > 1) ? (hardware - 1) : 0;
+}
+
+void WorkerPool::for_each(std::size_t count, Task_t const& task)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    if (m_threads.empty() || count == 1 || t_inTask)
+    {
+        // Not worth waking up the workers, or they're busy running the task
+        // that called this
+        for (std::size_t i = 0; i < count; i ++)
+        {
+            task(i);
+        }
+        return;
+    }
+
+    std::lock_guard<std::mutex> jobLock(m_jobMutex);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pTask = &task;
+        m_count = count;
+        m_next = 0;
+        m_busy = m_threads.size();
+        m_exception = nullptr;
+        m_generation ++;
+    }
+    m_wake.notify_all();
+
+    run_tasks(task, count);
+
+    // Every worker has to check in before the next job can be started, so
+    // none of them can miss a generation
+    std::exception_ptr exception;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [this] { return m_busy == 0; });
+        m_pTask = nullptr;
+        exception = std::move(m_exception);
+        m_exception = nullptr;
+    }
+
+    if (exception)
+    {
+        std::rethrow_exception(exception);
+    }
+}
+
+void WorkerPool::worker_loop()
+{
+    unsigned generationDone = 0;
+
+    while (true)
+    {
+        Task_t const *pTask;
+        std::size_t count;
+
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [this, generationDone] {
+                return m_stop || m_generation != generationDone;
+            });
+
+            if (m_stop)
+            {
+                return;
+            }
+
+            generationDone = m_generation;
+            pTask = m_pTask;
+            count = m_count;
+        }
+
+        run_tasks(*pTask, count);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_busy --;
+            if (m_busy == 0)
+            {
+                m_done.notify_one();
+            }
+        }
+    }
+}
+
+void WorkerPool::run_tasks(Task_t const& task, std::size_t count)
+{
+    InTaskScope const inTask;
+
+    try
+    {
+        for (std::size_t i = m_next ++; i < count; i = m_next ++)
+        {
+            task(i);
+        }
+    }
+    catch (...)
+    {
+        // Skip the remaining indices, and pass the exception to the caller
+        m_next = count;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_exception)
+        {
+            m_exception = std::current_exception();
+        }
+    }
+}
@@ -0,0 +1,120 @@
+/**
+ * Open Space Program
+ * Copyright © 2019-2020 Open Space Program Project
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace osp
+{
+
+/**
+ * A fixed set of worker threads that run indexed tasks in parallel.
+ *
+ * The thread calling for_each() works alongside the workers, so a pool with
+ * zero threads simply runs everything on the caller.
+ */
+class WorkerPool
+{
+public:
+
+    using Task_t = std::function<void(std::size_t)>;
+
+    /**
+     * @param threads [in] Number of worker threads to start
+     */
+    explicit WorkerPool(unsigned threads = default_thread_count());
+    ~WorkerPool();
+
+    WorkerPool(WorkerPool const& copy) = delete;
+    WorkerPool(WorkerPool&& move) = delete;
+
+    /**
+     * @return One less than the number of hardware threads, as the calling
+     *         thread also does work
+     */
+    static unsigned default_thread_count();
+
+    /**
+     * Call task(i) for every i in [0, count), spread over the workers and the
+     * calling thread. Blocks until all calls are done.
+     *
+     * Calling for_each from inside a task (of any pool) runs the nested
+     * tasks on the calling thread, as the workers are already busy. This
+     * lets a task use the pool when it happens to run alone, such as a
+     * single trajectory being updated.
+     *
+     * The pool runs one job at a time. If several threads that aren't
+     * running a task call for_each at once, the calls wait for each other.
+     *
+     * If a task throws, no more indices are claimed, and the first exception
+     * is rethrown on the calling thread once the workers are done.
+     *
+     * @param count [in] Number of indices
+     * @param task [in] Function to call with each index
+     */
+    void for_each(std::size_t count, Task_t const& task);
+
+    std::size_t get_thread_count() const noexcept { return m_threads.size(); }
+
+private:
+
+    void worker_loop();
+
+    /**
+     * Claim and run indices of the current job until there are none left
+     */
+    void run_tasks(Task_t const& task, std::size_t count);
+
+    std::vector<std::thread> m_threads;
+
+    // Held by the caller for the duration of a job, so concurrent callers
+    // don't overwrite each other's job
+    std::mutex m_jobMutex;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake; // notifies workers of a new job
+    std::condition_variable m_done; // notifies caller that workers are done
+
+    // Current job, guarded by m_mutex
+    Task_t const *m_pTask{nullptr};
+    std::size_t m_count{0};
+    unsigned m_generation{0};
+    unsigned m_busy{0}; // workers that haven't finished the current job
+    bool m_stop{false};
+
+    // First exception thrown by a task of the current job
+    std::exception_ptr m_exception;
+
+    // Next index to claim from the current job
+    std::atomic<std::size_t> m_next{0};
+};
+
+}
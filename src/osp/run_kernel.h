@@ -0,0 +1,71 @@
+/**
+ * Open Space Program
+ * Copyright © 2019-2020 Open Space Program Project
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+
+// Kernels run through run_kernel() are built a second time for AVX2 and FMA,
+// picked at runtime. The default build flags only allow SSE2
+#if (defined(__x86_64__) || defined(__i386__)) \
+    && (defined(__GNUC__) || defined(__clang__))
+    #define OSP_KERNEL_AVX2
+#endif
+
+namespace osp
+{
+
+#ifdef OSP_KERNEL_AVX2
+
+/**
+ * Call func with everything it calls inlined and built for AVX2 and FMA
+ */
+template<typename FUNC_T>
+__attribute__((target("avx2,fma"), flatten))
+void run_avx2(FUNC_T const& func)
+{
+    func();
+}
+
+#endif
+
+/**
+ * Call a function that runs a kernel, using the AVX2 build of the kernel if
+ * the CPU supports it
+ */
+template<typename FUNC_T>
+void run_kernel(FUNC_T const& func)
+{
+#ifdef OSP_KERNEL_AVX2
+    static bool const s_hasAvx2 = __builtin_cpu_supports("avx2")
+                               && __builtin_cpu_supports("fma");
+    if (s_hasAvx2)
+    {
+        run_avx2(func);
+        return;
+    }
+#endif
+
+    func();
+}
+
+}
@@ -26,13 +26,30 @@
 #define INCLUDED_OSP_SHARED_STRING_H_56F463BF_C8A5_4633_B906_D7250C06E2DB
 #pragma once
 
+#include <algorithm>
+#include <iterator>
 #include <memory>
+#include <string>
 #include <string_view>
 #include <type_traits>
 
 namespace osp
 {
 
+template<typename CHAR_T, typename LIFETIME_T>
+class basic_shared_string;
+
+/**
+ * The concrete implementation, see basic_shared_string below.
+ */
+using shared_string = basic_shared_string<char, std::shared_ptr<const char[]>>;
+
+// Declared ahead so basic_shared_string can befriend them
+shared_string create_shared_string(std::string_view view, std::shared_ptr<const char[]> buf) noexcept;
+shared_string create_shared_string(const char * data, size_t len) noexcept(false);
+shared_string create_shared_string(std::string_view view) noexcept(false);
+shared_string create_reference_shared_string(std::string_view view) noexcept;
+
 /**
  * A class representing a read-only string with shared ownership of the underlying storage for the string.
  * The interface is a std::string_view, and the lifetime management is conducted through move construction / assignment
@@ -80,18 +97,18 @@ class basic_shared_string : public std::basic_string_view<CHAR_T>
     static_assert(std::is_nothrow_destructible_v<ViewBase_t>);
 
 public:
-    using traits_type            = ViewBase_t::traits_type;
-    using value_type             = ViewBase_t::value_type;
-    using pointer                = ViewBase_t::pointer;
-    using const_pointer          = ViewBase_t::const_pointer;
-    using reference              = ViewBase_t::reference;
-    using const_reference        = ViewBase_t::const_reference;
-    using const_iterator         = ViewBase_t::const_iterator;
-    using iterator               = ViewBase_t::iterator;
-    using const_reverse_iterator = ViewBase_t::const_reverse_iterator;
-    using reverse_iterator       = ViewBase_t::reverse_iterator;
-    using size_type              = ViewBase_t::size_type;
-    using difference_type        = ViewBase_t::difference_type;
+    using traits_type            = typename ViewBase_t::traits_type;
+    using value_type             = typename ViewBase_t::value_type;
+    using pointer                = typename ViewBase_t::pointer;
+    using const_pointer          = typename ViewBase_t::const_pointer;
+    using reference              = typename ViewBase_t::reference;
+    using const_reference        = typename ViewBase_t::const_reference;
+    using const_iterator         = typename ViewBase_t::const_iterator;
+    using iterator               = typename ViewBase_t::iterator;
+    using const_reverse_iterator = typename ViewBase_t::const_reverse_iterator;
+    using reverse_iterator       = typename ViewBase_t::reverse_iterator;
+    using size_type              = typename ViewBase_t::size_type;
+    using difference_type        = typename ViewBase_t::difference_type;
 
     constexpr basic_shared_string(void) noexcept( std::is_nothrow_default_constructible_v<LIFETIME_T> ) = default;
     basic_shared_string(basic_shared_string &&) noexcept( std::is_nothrow_move_constructible_v<LIFETIME_T> )  = default;
@@ -127,20 +144,19 @@ public:
      * @brief operator std::basic_string<CHAR_T>
      * Convienience function for getting an std::basic_string<CHAR_T> from this basic_shared_string
      */
-    explicit operator std::basic_string<CHAR_T>() noexcept( noexcept( std::basic_string<CHAR_T>(data(), size()) ) )
+    explicit operator std::basic_string<CHAR_T>() const noexcept(false) // allocates
     {
-        return { data(), size() };
+        return { ViewBase_t::data(), ViewBase_t::size() };
     }
 
 protected:
-    friend basic_shared_string create_shared_string(ViewBase_t, LIFETIME_T) noexcept( std::is_nothrow_move_constructible_v<LIFETIME_T> );
+    // Friends are declared for shared_string above, as friends of a template
+    // with dependent types would declare new functions instead
+    friend shared_string create_shared_string(std::string_view, std::shared_ptr<const char[]>) noexcept;
+    friend shared_string create_shared_string(const char * data, size_t len) noexcept(false); // allocates
+    friend shared_string create_shared_string(std::string_view) noexcept(false); // allocates
 
-    template<typename IT_T>
-    friend basic_shared_string create_shared_string(IT_T&&, IT_T&&) noexcept(false); // allocates
-    friend shared_string create_shared_string(const char * data, size_t len) noexcept(false);
-    friend basic_shared_string create_shared_string(ViewBase_t) noexcept(false); // allocates
-
-    friend constexpr basic_shared_string create_reference_shared_string(ViewBase_t) noexcept( std::is_nothrow_default_constructible_v<LIFETIME_T> );
+    friend shared_string create_reference_shared_string(std::string_view) noexcept;
 
     explicit constexpr basic_shared_string(ViewBase_t view) noexcept( std::is_nothrow_default_constructible_v<LIFETIME_T> )
      : ViewBase_t{ view }
@@ -155,13 +171,7 @@ private:
     LIFETIME_T m_lifetime;
 }; // class basic_shared_string
 
-/**
- * The concrete implementation.
- */
-using shared_string = basic_shared_string<char, std::shared_ptr<const CHAR_T[]>>;
-
-
-shared_string create_shared_string(std::string_view view, std::shared_ptr<const CHAR_T[]> buf) noexcept
+inline shared_string create_shared_string(std::string_view view, std::shared_ptr<const char[]> buf) noexcept
 {
     return shared_string{ view, std::move(buf) };
 }
@@ -173,7 +183,7 @@ shared_string create_shared_string(IT_T && begin, IT_T && end) noexcept(false) /
     auto len = static_cast<std::size_t>(std::distance(begin, end));
 
     // Make space to copy the string
-    auto buf = std::make_shared<char[]>(len);
+    auto buf = std::shared_ptr<char[]>(new char[len]);
 
     // Do the copy
     std::copy(std::forward<IT_T>(begin), std::forward<IT_T>(end), buf.get());
@@ -186,10 +196,10 @@ shared_string create_shared_string(IT_T && begin, IT_T && end) noexcept(false) /
     return create_shared_string(view, std::move(buf));
 }
 
-shared_string create_shared_string(const char * data, size_t len) noexcept(false) // allocates
+inline shared_string create_shared_string(const char * data, size_t len) noexcept(false) // allocates
 {
     // Make space to copy the string
-    auto buf = std::make_shared<char[]>(len);
+    auto buf = std::shared_ptr<char[]>(new char[len]);
 
     // Do the copy
     std::copy(data, data+len, buf.get());
@@ -202,7 +212,7 @@ shared_string create_shared_string(const char * data, size_t len) noexcept(false
     return create_shared_string(view, std::move(buf));
 }
 
-shared_string create_shared_string(std::string_view view) noexcept(false) // allocates
+inline shared_string create_shared_string(std::string_view view) noexcept(false) // allocates
 {
     return create_shared_string(view.begin(), view.end());
 }
@@ -212,9 +222,9 @@ shared_string create_shared_string(std::string_view view) noexcept(false) // all
  * @param view
  * @return a shared_string that does not attempt lifetime management at all.
  */
-constexpr shared_string create_reference_shared_string(std::string_view view) noexcept
+inline shared_string create_reference_shared_string(std::string_view view) noexcept
 {
-    return shared_string{ std::string_view };
+    return shared_string{ view };
 }
 
 } // namespace osp
@@ -0,0 +1,72 @@
+/**
+ * Open Space Program
+ * Copyright © 2019-2020 Open Space Program Project
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+
+#include <entt/entity/registry.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace osp::universe
+{
+
+class ISystemTrajectory;
+class ITypeSatellite;
+
+//using Satellite = entt::entity;
+//ENTT_OPAQUE_TYPE(Satellite, uint32_t);
+enum class Satellite: entt::id_type {};
+
+/**
+ * @return Entity index of a satellite, without the version. Useful for
+ *         indexing arrays parallel to the universe's registry
+ */
+constexpr std::size_t sat_index(Satellite sat)
+{
+    return entt::to_integral(sat) & entt::entt_traits<Satellite>::entity_mask;
+}
+
+using SatTypeIndex_t = uint32_t;
+
+/**
+ * @return A new index for sat_type_index(). Don't call this directly
+ */
+SatTypeIndex_t sat_type_index_next() noexcept;
+
+/**
+ * Dense index of an ITypeSatellite, counting up from 0 in the order types
+ * first ask for one. Universe uses it to find types in a flat array instead
+ * of looking them up by name.
+ *
+ * @tparam TYPESAT_T Type of ITypeSatellite
+ */
+template<typename TYPESAT_T>
+SatTypeIndex_t sat_type_index() noexcept
+{
+    static SatTypeIndex_t const sc_index = sat_type_index_next();
+    return sc_index;
+}
+
+}
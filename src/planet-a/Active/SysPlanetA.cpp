@@ -67,7 +67,7 @@ StatusActivated SysPlanetA::activate_sat(
     auto &loadMePlanet = uni.get_reg().get<universe::UCompPlanet>(tgtSat);
 
     // Convert position of the satellite to position in scene
-    Vector3 positionInScene = uni.sat_calc_pos_meters(areaSat, tgtSat);
+    Vector3 positionInScene = area.sat_scene_pos(tgtSat);
 
     // Create planet entity and add components to it
 
@@ -77,6 +77,7 @@ StatusActivated SysPlanetA::activate_sat(
     auto &rPlanetTransform = scene.get_registry()
                              .emplace<osp::active::ACompTransform>(planetEnt);
     rPlanetTransform.m_transform = Matrix4::translation(positionInScene);
+    scene.hier_mark_dirty(planetEnt);
     scene.reg_emplace<ACompFloatingOrigin>(planetEnt);
 
     auto &rPlanetPlanet = scene.reg_emplace<ACompPlanet>(planetEnt);
@@ -111,7 +112,7 @@ int SysPlanetA::deactivate_sat(osp::active::ActiveScene &scene,
                                osp::universe::Satellite tgtSat,
                                osp::active::ActiveEnt tgtEnt)
 {
-    // TODO: Delete the planet entity from the scene
+    scene.hier_destroy(tgtEnt);
     return 0;
 }
 
@@ -169,6 +170,7 @@ void SysPlanetA::debug_create_chunk_collider(osp::active::ActiveEnt ent,
     // Set some stuff
     fishShape.m_shape = ECollisionShape::TERRAIN;
     fishTransform.m_transform = m_scene.reg_get<ACompTransform>(ent).m_transform;
+    m_scene.hier_mark_dirty(fish);
 
     // Get triangle iterators to start and end triangles of the specified chunk
     auto itsChunk = planet.m_planet->iterate_chunk(chunk);
@@ -249,6 +249,7 @@ void DebugCameraController::update_physics_post()
 
     // look at target
     xform = Matrix4::lookAt(xform.translation(), xformTgt.translation(), xform[1].xyz());
+    m_scene.hier_mark_dirty(m_ent);
 }
 
 void DebugCameraController::view_orbit(ActiveEnt ent)
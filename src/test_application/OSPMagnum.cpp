@@ -81,6 +81,10 @@ void OSPMagnum::drawEvent()
 
     m_userInput.update_controls();
 
+    // Tick the universe, so scenes see fresh positions in the spatial index
+    osp::universe::Universe &rUni = m_ospApp.get_universe();
+    rUni.update(rUni.get_time() + 1.0 / 60.0, m_ospApp.get_workers());
+
     for (auto &[name, scene] : m_scenes)
     {
         scene.update();
@@ -88,6 +92,9 @@ void OSPMagnum::drawEvent()
 
     m_userInput.clear_events();
 
+    // Frame is done changing the universe, let other threads see it
+    rUni.state_publish();
+
     for (auto &[name, scene] : m_scenes)
     {
         scene.update_hierarchy_transforms();
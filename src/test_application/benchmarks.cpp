@@ -0,0 +1,705 @@
+/**
+ * Open Space Program
+ * Copyright © 2019-2020 Open Space Program Project
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "benchmarks.h"
+
+#include <osp/Active/TransformBatch.h>
+#include <osp/Trajectories/Ephemeris.h>
+#include <osp/Trajectories/Kepler.h>
+#include <osp/Trajectories/NBody.h>
+#include <osp/UniversePrediction.h>
+#include <osp/WorkerPool.h>
+
+#include <Magnum/Math/Functions.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using osp::active::gc_batchNoParent;
+using osp::universe::KeplerOrbit;
+using osp::universe::Satellite;
+using osp::universe::TrajEphemeris;
+using osp::universe::TrajKepler;
+using osp::universe::TrajNBody;
+using osp::universe::TrajectoryPredictor;
+using osp::universe::Universe;
+using osp::universe::UCompGravity;
+using osp::universe::UCompTransformTraj;
+using osp::universe::UCompVelocity;
+
+using Clock_t = std::chrono::steady_clock;
+
+namespace
+{
+
+/**
+ * @return Milliseconds between two time points
+ */
+double elapsed_ms(Clock_t::time_point start, Clock_t::time_point end)
+{
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+/**
+ * UCompTransformTraj as it was before its trajectory, index and name were
+ * split off into UCompTrajectory and UCompName
+ */
+struct UCompTransformTrajOld
+{
+    osp::Vector3s m_position;
+    osp::Quaternion m_rotation;
+    Satellite m_parent;
+    osp::universe::ISystemTrajectory *m_trajectory{nullptr};
+    unsigned m_index;
+    bool m_dirty{true};
+    std::string m_name;
+};
+
+/**
+ * Satellite type with a few components, for timing satellite creation
+ */
+class SatBench : public osp::universe::CommonTypeSat<
+        SatBench, UCompVelocity, osp::universe::UCompActivatable>
+{
+public:
+    SatBench(Universe& universe) : CommonTypeSat(universe) { }
+    std::string get_name() override { return "Bench"; }
+};
+
+/**
+ * Sweep over every component in a pool to find the bounding box of their
+ * positions
+ *
+ * @return Milliseconds per sweep
+ */
+template<typename COMP_T>
+double time_sweep(Universe const& uni, int passes, osp::Vector3s& rMinOut,
+                  osp::Vector3s& rMaxOut)
+{
+    auto const &reg = uni.get_reg();
+    COMP_T const *pComps = reg.raw<COMP_T>();
+    std::size_t const size = reg.size<COMP_T>();
+
+    Clock_t::time_point const start = Clock_t::now();
+    for (int pass = 0; pass < passes; pass ++)
+    {
+        osp::Vector3s min{std::numeric_limits<osp::SpaceInt>::max()};
+        osp::Vector3s max{std::numeric_limits<osp::SpaceInt>::min()};
+
+        for (std::size_t i = 0; i < size; i ++)
+        {
+            osp::Vector3s const &pos = pComps[i].m_position;
+            min = Magnum::Math::min(min, pos);
+            max = Magnum::Math::max(max, pos);
+        }
+
+        rMinOut = min;
+        rMaxOut = max;
+    }
+    Clock_t::time_point const end = Clock_t::now();
+
+    return elapsed_ms(start, end) / passes;
+}
+
+struct PassTimes
+{
+    double m_min;
+    double m_median;
+    double m_max;
+};
+
+/**
+ * @param rTimes [in,out] Milliseconds of each run, not empty. Sorted
+ *
+ * @return Fastest, median, and slowest run
+ */
+PassTimes times_summarize(std::vector<double>& rTimes)
+{
+    std::sort(rTimes.begin(), rTimes.end());
+
+    std::size_t const mid = rTimes.size() / 2;
+    double const median = (rTimes.size() % 2 == 1)
+                        ? rTimes[mid] : (rTimes[mid - 1] + rTimes[mid]) * 0.5;
+
+    return {rTimes.front(), median, rTimes.back()};
+}
+
+/**
+ * Run a function a number of times
+ *
+ * @return Milliseconds taken by the fastest, median, and slowest run
+ */
+template<typename FUNC_T>
+PassTimes time_passes(int passes, FUNC_T func)
+{
+    std::vector<double> times(std::size_t(std::max(passes, 1)));
+    for (double &rTime : times)
+    {
+        Clock_t::time_point const start = Clock_t::now();
+        func();
+        rTime = elapsed_ms(start, Clock_t::now());
+    }
+
+    return times_summarize(times);
+}
+
+}
+
+void testapp::bench_kepler(std::size_t count, int ticks)
+{
+    constexpr double c_earthGravParam = 3.986004418e14;
+    constexpr double c_tickLength = 1.0 / 60.0;
+
+    Universe uni;
+    auto &traj = uni.trajectory_create<TrajKepler>(uni, uni.sat_root(),
+                                                   c_earthGravParam);
+
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> semiMajorAxis(6.6e6, 4.2e7);
+    std::uniform_real_distribution<double> eccentricity(0.0, 0.9);
+    std::uniform_real_distribution<double> angle(0.0, 6.283185307179586);
+
+    for (std::size_t i = 0; i < count; i ++)
+    {
+        KeplerOrbit orbit;
+        orbit.m_semiMajorAxis = semiMajorAxis(gen);
+        orbit.m_eccentricity = eccentricity(gen);
+        orbit.m_inclination = angle(gen) * 0.5;
+        orbit.m_longAscending = angle(gen);
+        orbit.m_argPeriapsis = angle(gen);
+        orbit.m_meanAnomalyEpoch = angle(gen);
+
+        traj.add(uni.sat_create(), orbit);
+    }
+
+    // Regular ticks, solved relative to the previous update
+    Clock_t::time_point const stepStart = Clock_t::now();
+    for (int i = 1; i <= ticks; i ++)
+    {
+        uni.set_time(i * c_tickLength);
+        traj.update();
+    }
+    Clock_t::time_point const stepEnd = Clock_t::now();
+
+    // Time warp, every update needs a full solve
+    Clock_t::time_point const warpStart = Clock_t::now();
+    for (int i = 1; i <= ticks; i ++)
+    {
+        uni.set_time(uni.get_time() + 3600.0);
+        traj.update();
+    }
+    Clock_t::time_point const warpEnd = Clock_t::now();
+
+    // Regular ticks should take under 1 ms per 100k satellites
+    double const msRegular = elapsed_ms(stepStart, stepEnd) / ticks;
+    double const msTarget = double(count) / 100000.0;
+
+    std::cout << "TrajKepler, " << count << " satellites, "
+              << ticks << " ticks:\n"
+              << "* Regular:   " << msRegular << " ms/tick ("
+              << (msRegular <= msTarget ? "within" : "over") << " the "
+              << msTarget << " ms target)\n"
+              << "* Time warp: " << elapsed_ms(warpStart, warpEnd) / ticks
+              << " ms/tick\n";
+}
+
+void testapp::bench_transform_sweep(std::size_t count, int passes)
+{
+    Universe uni;
+    auto &reg = uni.get_reg();
+
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<osp::SpaceInt> coord(-(1ll << 40),
+                                                       1ll << 40);
+
+    for (std::size_t i = 0; i < count; i ++)
+    {
+        Satellite const sat = uni.sat_create();
+        osp::Vector3s const pos{coord(gen), coord(gen), coord(gen)};
+        std::string name = "Satellite " + std::to_string(i);
+
+        reg.get<UCompTransformTraj>(sat).m_position = pos;
+        uni.sat_set_name(sat, name);
+
+        auto &old = reg.emplace<UCompTransformTrajOld>(sat);
+        old.m_position = pos;
+        old.m_name = std::move(name);
+    }
+
+    osp::Vector3s minOld, maxOld, minNew, maxNew;
+    double const msOld = time_sweep<UCompTransformTrajOld>(uni, passes,
+                                                           minOld, maxOld);
+    double const msNew = time_sweep<UCompTransformTraj>(uni, passes,
+                                                        minNew, maxNew);
+
+    std::cout << "Position sweep, " << count << " satellites, "
+              << passes << " passes:\n"
+              << "* Before: " << msOld << " ms/sweep, "
+              << sizeof(UCompTransformTrajOld) << " bytes/satellite\n"
+              << "* After:  " << msNew << " ms/sweep, "
+              << sizeof(UCompTransformTraj) << " bytes/satellite\n";
+
+    if (minOld != minNew || maxOld != maxNew)
+    {
+        std::cout << "Bounds don't match!\n";
+    }
+}
+
+void testapp::bench_nbody(std::size_t count, int ticks)
+{
+    static constexpr double c_earthGravParam = 3.986004418e14;
+    static constexpr double c_tickLength = 1.0 / 60.0;
+
+    // Pools are made first, so they outlive the trajectories using them
+    osp::WorkerPool single(0);
+    osp::WorkerPool multi;
+
+    auto const time_ticks = [count, ticks] (osp::WorkerPool& rWorkers)
+    {
+        Universe uni;
+        auto &traj = uni.trajectory_create<TrajNBody>(
+                uni, uni.sat_root(), rWorkers, c_earthGravParam);
+        auto &reg = uni.get_reg();
+
+        // Swarm of 1 to 1000 tonne rocks in a 100km ball, 7000km from the
+        // center, moving roughly in a circular orbit
+        std::mt19937 gen(42);
+        std::normal_distribution<double> offset(0.0, 1.0e5);
+        std::uniform_real_distribution<double> mass(1.0e3, 1.0e6);
+        double const radius = 7.0e6;
+        double const speed = std::sqrt(c_earthGravParam / radius);
+
+        for (std::size_t i = 0; i < count; i ++)
+        {
+            Satellite const sat = uni.sat_create();
+            osp::Vector3d const pos{radius + offset(gen), offset(gen),
+                                    offset(gen)};
+            reg.get<UCompTransformTraj>(sat).m_position
+                    = osp::Vector3s(pos * osp::gc_units_per_meter);
+            reg.emplace<UCompVelocity>(sat, osp::Vector3(0.0f, float(speed),
+                                                         0.0f));
+            traj.add(sat, mass(gen));
+        }
+
+        Clock_t::time_point const start = Clock_t::now();
+        for (int i = 1; i <= ticks; i ++)
+        {
+            uni.set_time(i * c_tickLength);
+            traj.update();
+        }
+        Clock_t::time_point const end = Clock_t::now();
+
+        return elapsed_ms(start, end) / ticks;
+    };
+
+    double const msSingle = time_ticks(single);
+    double const msMulti = time_ticks(multi);
+
+    std::cout << "TrajNBody, " << count << " satellites, "
+              << ticks << " ticks:\n"
+              << "* 1 thread:  " << msSingle << " ms/tick\n"
+              << "* " << (multi.get_thread_count() + 1) << " threads: "
+              << msMulti << " ms/tick\n";
+}
+
+void testapp::bench_create(std::size_t count)
+{
+    double msSingle;
+    double msMany;
+
+    {
+        Universe uni;
+        SatBench &rType = uni.type_register<SatBench>(uni);
+
+        Clock_t::time_point const start = Clock_t::now();
+        for (std::size_t i = 0; i < count; i ++)
+        {
+            rType.add(uni.sat_create());
+        }
+        msSingle = elapsed_ms(start, Clock_t::now());
+    }
+
+    {
+        Universe uni;
+        SatBench &rType = uni.type_register<SatBench>(uni);
+
+        Clock_t::time_point const start = Clock_t::now();
+        uni.sat_create_many(count, &rType);
+        msMany = elapsed_ms(start, Clock_t::now());
+    }
+
+    std::cout << "Satellite creation, " << count << " satellites:\n"
+              << "* sat_create:      " << msSingle << " ms\n"
+              << "* sat_create_many: " << msMany << " ms\n";
+}
+
+void testapp::bench_transform_batch(std::size_t count, int passes)
+{
+    // Vehicles of 500 entities, each made of parts attached to the vehicle,
+    // and some smaller things attached to parts
+    constexpr std::size_t c_vehicleSize = 500;
+
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<float> coord(-1.0f, 1.0f);
+    std::uniform_int_distribution<int> attach(0, 2);
+
+    std::vector<uint32_t> parents(count);
+    std::vector<osp::Matrix4> local(count);
+
+    uint32_t vehicle = 0;
+    uint32_t part = 0;
+    for (std::size_t i = 0; i < count; i ++)
+    {
+        if (i % c_vehicleSize == 0)
+        {
+            parents[i] = gc_batchNoParent;
+            vehicle = uint32_t(i);
+            part = uint32_t(i);
+        }
+        else if (attach(gen) != 0)
+        {
+            parents[i] = vehicle;
+            part = uint32_t(i);
+        }
+        else
+        {
+            parents[i] = part;
+        }
+
+        osp::Vector3 const axis = osp::Vector3{coord(gen), coord(gen),
+                                               coord(gen) + 2.0f}.normalized();
+        local[i] = osp::Matrix4::translation({coord(gen), coord(gen),
+                                              coord(gen)})
+                 * osp::Matrix4::rotation(Magnum::Rad(coord(gen) * 3.0f),
+                                          axis);
+    }
+
+    std::vector<osp::Matrix4> worldLoop(count);
+    std::vector<osp::Matrix4> worldBatch(count);
+    std::vector<osp::Matrix4> worldScalar(count);
+
+    // How update_hierarchy_transforms calculated transforms before
+    PassTimes const msLoop = time_passes(passes, [&] ()
+    {
+        for (std::size_t i = 0; i < count; i ++)
+        {
+            worldLoop[i] = (parents[i] == gc_batchNoParent)
+                         ? local[i] : worldLoop[parents[i]] * local[i];
+        }
+    });
+
+    PassTimes const msBatch = time_passes(passes, [&] ()
+    {
+        osp::active::transform_batch_world(parents.data(), local.data(),
+                                           worldBatch.data(), count);
+    });
+
+    PassTimes const msScalar = time_passes(passes, [&] ()
+    {
+        osp::active::transform_batch_world_scalar(
+                parents.data(), local.data(), worldScalar.data(), count);
+    });
+
+    float diffMax = 0.0f;
+    for (std::size_t i = 0; i < count; i ++)
+    {
+        for (std::size_t j = 0; j < 16; j ++)
+        {
+            diffMax = std::max({diffMax,
+                    std::abs(worldLoop[i].data()[j] - worldBatch[i].data()[j]),
+                    std::abs(worldLoop[i].data()[j]
+                             - worldScalar[i].data()[j])});
+        }
+    }
+
+    std::cout << "World transforms, " << count << " transforms, "
+              << passes << " passes, median / min:\n"
+              << "* Matrix4 loop: " << msLoop.m_median << " / "
+              << msLoop.m_min << " ms\n"
+              << "* Batch:        " << msBatch.m_median << " / "
+              << msBatch.m_min << " ms ("
+              << msLoop.m_median / msBatch.m_median << "x median)\n"
+              << "* Batch scalar: " << msScalar.m_median << " / "
+              << msScalar.m_min << " ms\n"
+              << "* Largest difference: " << diffMax << "\n";
+}
+
+void testapp::bench_predict(std::size_t count, int frames)
+{
+    static constexpr double c_earthGravParam = 3.986004418e14;
+    static constexpr double c_moonGravParam = 4.9048695e12;
+    static constexpr double c_moonDistance = 3.844e8;
+
+    // Sphere of influence radii, in meters. The Earth's is against the Sun
+    static constexpr double c_earthSoi = 9.25e8;
+    static constexpr double c_moonSoi = 6.61e7;
+    static constexpr double c_frameLength = 1.0 / 60.0;
+
+    // Time warp, in seconds per frame. Predictions are extended every
+    // half horizon, which warp reaches every 72 frames
+    static constexpr double c_warpLength = 600.0;
+
+    // A craft thrusts, and is predicted again from scratch, this often
+    static constexpr int c_thrustInterval = 10;
+
+    osp::WorkerPool workers(0);
+    Universe uni;
+    auto &reg = uni.get_reg();
+
+    // Earth at the root, with the Moon orbiting it. Craft orbit the Earth,
+    // some of them on transfers out to the Moon's distance
+    Satellite const earth = uni.sat_root();
+    reg.emplace<UCompGravity>(earth, UCompGravity{c_earthGravParam,
+                                                  c_earthSoi});
+
+    auto &traj = uni.trajectory_create<TrajKepler>(uni, earth,
+                                                   c_earthGravParam);
+
+    Satellite const moon = uni.sat_create();
+    KeplerOrbit moonOrbit;
+    moonOrbit.m_semiMajorAxis = c_moonDistance;
+    moonOrbit.m_eccentricity = 0.0549;
+    traj.add(moon, moonOrbit);
+    reg.emplace<UCompGravity>(moon, UCompGravity{c_moonGravParam, c_moonSoi});
+
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> angle(0.0, 6.283185307179586);
+    std::uniform_real_distribution<double> leo(6.6e6, 8.0e6);
+    std::uniform_real_distribution<double> apogee(3.0e8, 4.2e8);
+
+    std::vector<Satellite> craft(count);
+    for (std::size_t i = 0; i < count; i ++)
+    {
+        craft[i] = uni.sat_create();
+
+        KeplerOrbit orbit;
+        double const perigee = leo(gen);
+        double const apo = (i % 2 == 0) ? perigee : apogee(gen);
+        orbit.m_semiMajorAxis = 0.5 * (perigee + apo);
+        orbit.m_eccentricity = (apo - perigee) / (apo + perigee);
+        orbit.m_inclination = 0.1 * angle(gen);
+        orbit.m_longAscending = angle(gen);
+        orbit.m_argPeriapsis = angle(gen);
+        orbit.m_meanAnomalyEpoch = angle(gen);
+        traj.add(craft[i], orbit);
+    }
+
+    TrajectoryPredictor predictor(uni);
+    std::size_t segments = 0;
+
+    auto const predict_all = [&predictor, &craft, &segments] ()
+    {
+        segments = 0;
+        for (Satellite sat : craft)
+        {
+            segments += predictor.predict(sat).size();
+        }
+    };
+
+    // Time one predict() for every craft each frame, with the universe
+    // moving forward by a frame between them
+    auto const time_frames = [&] (double frameLength, double& rTime)
+    {
+        std::vector<double> times(std::size_t(std::max(frames, 1)));
+        for (std::size_t f = 0; f < times.size(); f ++)
+        {
+            rTime += frameLength;
+            uni.update(rTime, workers);
+
+            if (f % c_thrustInterval == 0)
+            {
+                predictor.invalidate(craft[(f / c_thrustInterval) % count]);
+            }
+
+            Clock_t::time_point const start = Clock_t::now();
+            predict_all();
+            times[f] = elapsed_ms(start, Clock_t::now());
+        }
+        return times_summarize(times);
+    };
+
+    double time = 0.0;
+    uni.update(time, workers);
+
+    Clock_t::time_point const start = Clock_t::now();
+    predict_all();
+    double const msFirst = elapsed_ms(start, Clock_t::now());
+    uint64_t const computedFirst = predictor.get_segments_computed();
+
+    PassTimes const msFrame = time_frames(c_frameLength, time);
+    PassTimes const msWarp = time_frames(c_warpLength, time);
+
+    std::cout << "TrajectoryPredictor, " << count << " craft, "
+              << frames << " frames each, "
+              << predictor.get_horizon() << " s horizon:\n"
+              << "* First prediction: " << msFirst << " ms, "
+              << computedFirst << " segments\n"
+              << "* Per frame (median / min / max): " << msFrame.m_median
+              << " / " << msFrame.m_min << " / " << msFrame.m_max << " ms\n"
+              << "* Per frame at " << c_warpLength << " s/frame: "
+              << msWarp.m_median << " / " << msWarp.m_min << " / "
+              << msWarp.m_max << " ms\n"
+              << "* Segments computed: " << predictor.get_segments_computed()
+              << ", last frame holds " << segments << "\n";
+}
+
+void testapp::bench_ephemeris(std::size_t count, int frames)
+{
+    static constexpr double c_sunGravParam = 1.32712440018e20;
+
+    // 100000x time warp at 60 frames per second
+    static constexpr double c_frameLength = 100000.0 / 60.0;
+
+    // Gap between frames standing in for the rest of a frame, which is when
+    // the background thread catches up
+    static constexpr std::chrono::milliseconds c_frameGap{1};
+
+    // Predictions are made up to this far ahead of the current time
+    static constexpr double c_predictAhead = 60.0 * c_frameLength;
+
+    // The fitter is made first, so it outlives the trajectory using it
+    osp::universe::EphemerisFitter fitter;
+    Universe uni;
+
+    auto &ephemeris = uni.trajectory_create<TrajEphemeris>(
+            uni, uni.sat_root(), fitter, c_sunGravParam);
+    auto &kepler = uni.trajectory_create<TrajKepler>(
+            uni, uni.sat_root(), c_sunGravParam);
+
+    // Planets from Mercury's distance out to Neptune's, each added to both
+    // trajectories to compare them
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> semiMajorAxis(5.8e10, 4.5e12);
+    std::uniform_real_distribution<double> eccentricity(0.0, 0.25);
+    std::uniform_real_distribution<double> angle(0.0, 6.283185307179586);
+
+    std::vector<Satellite> ephSats(count);
+    std::vector<Satellite> kepSats(count);
+
+    for (std::size_t i = 0; i < count; i ++)
+    {
+        KeplerOrbit orbit;
+        orbit.m_semiMajorAxis = semiMajorAxis(gen);
+        orbit.m_eccentricity = eccentricity(gen);
+        orbit.m_inclination = angle(gen) * 0.05;
+        orbit.m_longAscending = angle(gen);
+        orbit.m_argPeriapsis = angle(gen);
+        orbit.m_meanAnomalyEpoch = angle(gen);
+
+        ephSats[i] = uni.sat_create();
+        kepSats[i] = uni.sat_create();
+        ephemeris.add(ephSats[i], orbit);
+        kepler.add(kepSats[i], orbit);
+    }
+
+    // Updates in time warp
+
+    std::vector<double> ephTimes(std::size_t(std::max(frames, 1)));
+    std::vector<double> kepTimes(ephTimes.size());
+
+    for (std::size_t f = 0; f < ephTimes.size(); f ++)
+    {
+        uni.set_time(uni.get_time() + c_frameLength);
+
+        Clock_t::time_point const ephStart = Clock_t::now();
+        ephemeris.update();
+        Clock_t::time_point const kepStart = Clock_t::now();
+        kepler.update();
+        Clock_t::time_point const kepEnd = Clock_t::now();
+
+        ephTimes[f] = elapsed_ms(ephStart, kepStart);
+        kepTimes[f] = elapsed_ms(kepStart, kepEnd);
+
+        std::this_thread::sleep_for(c_frameGap);
+    }
+
+    uint64_t const fitsWaitedWarp = ephemeris.get_fits_waited();
+
+    // Predictions at random times ahead, answered from the cached windows,
+    // compared against solving the orbit
+
+    std::size_t const queries = count * 1000;
+    std::uniform_real_distribution<double> ahead(0.0, c_predictAhead);
+    std::uniform_int_distribution<std::size_t> pick(0, count - 1);
+
+    std::vector<std::pair<std::size_t, double>> picks(queries);
+    for (auto &[index, time] : picks)
+    {
+        index = pick(gen);
+        time = uni.get_time() + ahead(gen);
+    }
+
+    double sum = 0.0; // used so the queries aren't optimized out
+    double diffMax = 0.0;
+
+    Clock_t::time_point const ephStart = Clock_t::now();
+    for (auto const &[index, time] : picks)
+    {
+        sum += ephemeris.get_position(ephSats[index], time).x();
+    }
+    Clock_t::time_point const kepStart = Clock_t::now();
+    for (auto const &[index, time] : picks)
+    {
+        osp::Vector3d pos, vel;
+        kepler.predict_state(kepSats[index], time, pos, vel);
+        sum -= pos.x();
+    }
+    Clock_t::time_point const kepEnd = Clock_t::now();
+
+    for (std::size_t i = 0; i < count; i ++)
+    {
+        double const time = uni.get_time() + c_predictAhead;
+        osp::Vector3d pos, vel;
+        kepler.predict_state(kepSats[i], time, pos, vel);
+        diffMax = std::max(diffMax, (ephemeris.get_position(ephSats[i], time)
+                                     - pos).length());
+    }
+
+    PassTimes const msEph = times_summarize(ephTimes);
+    PassTimes const msKep = times_summarize(kepTimes);
+    double const nsEph = elapsed_ms(ephStart, kepStart) * 1.0e6 / queries;
+    double const nsKep = elapsed_ms(kepStart, kepEnd) * 1.0e6 / queries;
+
+    std::cout << "TrajEphemeris, " << count << " planets, 100000x warp, "
+              << frames << " frames, "
+              << ephemeris.get_window_length() << " s windows:\n"
+              << "* Update (median / min / max): " << msEph.m_median << " / "
+              << msEph.m_min << " / " << msEph.m_max << " ms, "
+              << fitsWaitedWarp << " windows not fitted in time\n"
+              << "* TrajKepler update:          " << msKep.m_median << " / "
+              << msKep.m_min << " / " << msKep.m_max << " ms\n"
+              << "* Prediction up to " << c_predictAhead << " s ahead: "
+              << nsEph << " ns, TrajKepler " << nsKep << " ns ("
+              << (ephemeris.get_fits_waited() - fitsWaitedWarp)
+              << " windows not fitted in time)\n"
+              << "* Largest difference from TrajKepler: " << diffMax
+              << " m (checksum " << sum << ")\n";
+}
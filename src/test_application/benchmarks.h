@@ -0,0 +1,100 @@
+/**
+ * Open Space Program
+ * Copyright © 2019-2020 Open Space Program Project
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+
+#include <cstddef>
+
+namespace testapp
+{
+
+/**
+ * Time TrajKepler::update() on a separate universe filled with random orbits,
+ * and print results to stdout, including whether regular ticks are within
+ * the target of 1 ms per 100k satellites
+ *
+ * @param count [in] Number of satellites to create
+ * @param ticks [in] Number of updates to time
+ */
+void bench_kepler(std::size_t count, int ticks);
+
+/**
+ * Time a sweep over the positions of every satellite, comparing
+ * UCompTransformTraj against its old layout that also held the trajectory,
+ * index and name, and print results to stdout
+ *
+ * @param count [in] Number of satellites to create
+ * @param passes [in] Number of sweeps to time
+ */
+void bench_transform_sweep(std::size_t count, int passes);
+
+/**
+ * Time TrajNBody::update() for a swarm of bodies around a planet, on a single
+ * thread and on a worker pool, and print results to stdout
+ *
+ * @param count [in] Number of satellites to create
+ * @param ticks [in] Number of updates to time
+ */
+void bench_nbody(std::size_t count, int ticks);
+
+/**
+ * Time creating satellites of a type one at a time, compared to
+ * Universe::sat_create_many(), and print results to stdout
+ *
+ * @param count [in] Number of satellites to create
+ */
+void bench_create(std::size_t count);
+
+/**
+ * Time calculating world transforms for a hierarchy of random vehicles,
+ * comparing a loop of Matrix4 multiplies against transform_batch_world(),
+ * and print the median and fastest pass of each to stdout
+ *
+ * @param count [in] Number of transforms
+ * @param passes [in] Number of passes to time
+ */
+void bench_transform_batch(std::size_t count, int passes);
+
+/**
+ * Time TrajectoryPredictor::predict() for craft orbiting the Earth, some out
+ * to the Moon, called for every craft each frame at normal speed and in time
+ * warp. A craft thrusts every few frames. Prints the first prediction, then
+ * the median, fastest, and slowest frame, to stdout
+ *
+ * @param count [in] Number of craft
+ * @param frames [in] Number of frames to time at each speed
+ */
+void bench_predict(std::size_t count, int frames);
+
+/**
+ * Time TrajEphemeris in 100000x time warp against TrajKepler with the same
+ * orbits, both updating every frame and answering predictions at random
+ * times ahead, and print results to stdout
+ *
+ * @param count [in] Number of planets
+ * @param frames [in] Number of frames to time
+ */
+void bench_ephemeris(std::size_t count, int frames);
+
+}
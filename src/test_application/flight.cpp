@@ -90,6 +90,9 @@ void testapp::test_flight(std::unique_ptr<OSPMagnum>& pMagnumApp,
     // Create an ActiveScene
     osp::active::ActiveScene& scene = pMagnumApp->scene_create("Area 1");
 
+    // Vehicles are separate subtrees, update their transforms in parallel
+    scene.hier_set_parallel(true);
+
     // Register dynamic systems needed for flight scene
 
     auto &sysPhysics        = scene.dynamic_system_create<osp::active::SysPhysics_t>();
@@ -130,6 +133,7 @@ void testapp::test_flight(std::unique_ptr<OSPMagnum>& pMagnumApp,
     auto &cameraComp = scene.get_registry().emplace<ACompCamera>(camera);
 
     cameraTransform.m_transform = Matrix4::translation(Vector3(0, 0, 25));
+    scene.hier_mark_dirty(camera);
     scene.reg_emplace<ACompFloatingOrigin>(camera);
 
     cameraComp.m_viewport
@@ -25,17 +25,25 @@
 
 #include "OSPMagnum.h"
 #include "flight.h"
+#include "benchmarks.h"
+#include "tests.h"
 
 #include "universes/simple.h"
 #include "universes/planets.h"
 
+#include <osp/HeadlessDriver.h>
 #include <osp/Resource/AssetImporter.h>
 #include <osp/string_concat.h>
 
 #include <osp/Satellites/SatVehicle.h>
+#include <osp/UniverseReplication.h>
+#include <osp/UniverseSnapshot.h>
 
 #include <planet-a/Satellites/SatPlanet.h>
 
+#include <algorithm>
+#include <atomic>
+#include <fstream>
 #include <iostream>
 #include <memory>
 #include <thread>
@@ -62,6 +70,28 @@ void register_universe_types();
  */
 bool destroy_universe();
 
+/**
+ * Save or load all satellites to a snapshot file
+ * @return true if successful
+ */
+bool save_universe(std::string const& path);
+bool load_universe(std::string const& path);
+
+/**
+ * Advance the universe without starting Magnum, then print how fast it went
+ * @param ticks [in] Number of 1/60s ticks to run
+ */
+void simulate_universe(uint64_t ticks);
+
+/**
+ * Tick the universe like simulate_universe, while writing a replication
+ * stream of it to a file. The file can be a named pipe.
+ *
+ * @param path [in] File to write the stream to
+ * @param ticks [in] Number of ticks to run
+ */
+void replicate_universe(std::string const& path, uint64_t ticks);
+
 /**
  * The spaghetti command line interface that gets inputs from stdin. This
  * function will only return once the user exits.
@@ -85,6 +115,11 @@ osp::OSPApplication g_osp;
 std::unique_ptr<OSPMagnum> g_ospMagnum;
 std::thread g_magnumThread;
 
+// Set by the CLI thread before starting the Magnum thread, and cleared by the
+// Magnum thread once it stops touching the universe. While set, only the
+// Magnum thread may publish the universe's state
+std::atomic<bool> g_magnumRunning{false};
+
 // lazily save the arguments to pass to Magnum
 int g_argc;
 char** g_argv;
@@ -141,8 +176,12 @@ int debug_cli_loop()
             {
                 g_magnumThread.join();
             }
-            std::thread t(test_flight, std::ref(g_ospMagnum), std::ref(g_osp),
-                          OSPMagnum::Arguments{g_argc, g_argv});
+            g_magnumRunning = true;
+            std::thread t([] (OSPMagnum::Arguments args)
+            {
+                test_flight(g_ospMagnum, g_osp, args);
+                g_magnumRunning = false;
+            }, OSPMagnum::Arguments{g_argc, g_argv});
             g_magnumThread.swap(t);
         }
         else if (command == "list_uni")
@@ -157,6 +196,63 @@ int debug_cli_loop()
         {
             debug_print_update_order();
         }
+        else if (command == "save_uni")
+        {
+            std::string path;
+            std::cin >> path;
+            save_universe(path);
+        }
+        else if (command == "load_uni")
+        {
+            std::string path;
+            std::cin >> path;
+            load_universe(path);
+        }
+        else if (command == "simulate")
+        {
+            uint64_t ticks = 0;
+            std::cin >> ticks;
+            simulate_universe(ticks);
+        }
+        else if (command == "replicate")
+        {
+            std::string path;
+            uint64_t ticks = 0;
+            std::cin >> path >> ticks;
+            replicate_universe(path, ticks);
+        }
+        else if (command == "bench_kepler")
+        {
+            bench_kepler(100000, 100);
+        }
+        else if (command == "bench_sweep")
+        {
+            bench_transform_sweep(1000000, 20);
+        }
+        else if (command == "bench_nbody")
+        {
+            bench_nbody(100000, 10);
+        }
+        else if (command == "bench_create")
+        {
+            bench_create(1000000);
+        }
+        else if (command == "bench_xform")
+        {
+            bench_transform_batch(100000, 50);
+        }
+        else if (command == "bench_predict")
+        {
+            bench_predict(50, 600);
+        }
+        else if (command == "bench_ephem")
+        {
+            bench_ephemeris(20, 600);
+        }
+        else if (command == "test_area")
+        {
+            test_area_removed_sat();
+        }
         else if (command == "exit")
         {
             if (g_ospMagnum)
@@ -185,7 +281,7 @@ int debug_cli_loop()
 bool destroy_universe()
 {
     // Make sure no application is open
-    if (g_ospMagnum != nullptr)
+    if (g_magnumRunning)
     {
         std::cout << "Application must be closed to destroy universe.\n";
         return false;
@@ -202,6 +298,125 @@ bool destroy_universe()
     return true;
 }
 
+// Planets aren't part of osp, so save them here
+constexpr osp::universe::SnapshotChunkId_t gc_chunkPlanet
+        = osp::universe::snapshot_chunk_id("PLNT");
+
+bool save_universe(std::string const& path)
+{
+    using namespace osp::universe;
+
+    // Make sure no application is open
+    if (g_magnumRunning)
+    {
+        std::cout << "Application must be closed to save universe.\n";
+        return false;
+    }
+
+    Universe &rUni = g_osp.get_universe();
+    SnapshotWriter writer(path);
+
+    snapshot_save(rUni, writer);
+    snapshot_save_vehicles(rUni, writer);
+    snapshot_save_pod<planeta::universe::UCompPlanet>(rUni, writer,
+                                                      gc_chunkPlanet);
+
+    if (!writer.finish())
+    {
+        std::cout << "Failed to write " << path << "\n";
+        return false;
+    }
+
+    std::cout << "Saved " << rUni.get_reg().size() << " satellites to "
+              << path << "\n";
+    return true;
+}
+
+bool load_universe(std::string const& path)
+{
+    using namespace osp::universe;
+
+    // Make sure no application is open
+    if (g_magnumRunning)
+    {
+        std::cout << "Application must be closed to load universe.\n";
+        return false;
+    }
+
+    Universe &rUni = g_osp.get_universe();
+    SnapshotReader reader(path);
+
+    int status = snapshot_load(rUni, reader);
+
+    if (status == 1)
+    {
+        std::cout << "Failed to read " << path << "\n";
+        return false;
+    }
+
+    status = std::max(status, snapshot_load_vehicles(
+                rUni, reader, g_osp.debug_find_package("lzdb")));
+
+    if (snapshot_load_pod<planeta::universe::UCompPlanet>(
+                rUni, reader, gc_chunkPlanet) != 0)
+    {
+        status = 2;
+    }
+
+    if (status != 0)
+    {
+        std::cout << "Some types, trajectories, or blueprints didn't match\n";
+    }
+
+    std::cout << "Loaded " << rUni.get_reg().size() << " satellites from "
+              << path << "\n";
+    return true;
+}
+
+void simulate_universe(uint64_t ticks)
+{
+    // The Magnum thread ticks the same universe
+    if (g_magnumRunning)
+    {
+        std::cout << "Application must be closed to simulate.\n";
+        return;
+    }
+
+    osp::HeadlessDriver driver(g_osp);
+    osp::HeadlessDriver::Stats const stats = driver.run(ticks);
+
+    std::cout << "Simulated " << stats.m_ticks << " ticks ("
+              << stats.m_simSeconds << "s) in " << stats.m_seconds << "s\n"
+              << "* " << stats.ticks_per_second() << " ticks/s, "
+              << stats.time_warp() << "x time warp\n";
+}
+
+void replicate_universe(std::string const& path, uint64_t ticks)
+{
+    if (g_magnumRunning)
+    {
+        std::cout << "Application must be closed to replicate.\n";
+        return;
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open())
+    {
+        std::cout << "Could not open " << path << "\n";
+        return;
+    }
+
+    osp::universe::ReplicationStreamSink sink(file);
+    osp::universe::ReplicationEncoder encoder(g_osp.get_universe(), sink);
+
+    osp::HeadlessDriver driver(g_osp);
+    driver.replication_add(encoder);
+    osp::HeadlessDriver::Stats const stats = driver.run(ticks);
+
+    std::cout << "Replicated " << stats.m_ticks << " ticks to " << path
+              << ", " << encoder.get_bytes_written() << " bytes\n";
+}
+
 void load_a_bunch_of_stuff()
 {
     // Create a new package
@@ -271,6 +486,18 @@ void debug_print_help()
         << "* list_uni  - List Satellites in the universe\n"
         << "* list_ent  - List Entities in active scene\n"
         << "* list_upd  - List Update order from active scene\n"
+        << "* save_uni <file> - Save satellites to a snapshot file\n"
+        << "* load_uni <file> - Replace satellites with ones from a snapshot\n"
+        << "* simulate <ticks> - Tick the universe without Magnum\n"
+        << "* replicate <file> <ticks> - Simulate, streaming changes to a file\n"
+        << "* bench_kepler - Time Kepler orbits for 100k satellites\n"
+        << "* bench_sweep  - Time position sweeps over 1M satellites\n"
+        << "* bench_nbody  - Time N-body gravity for 100k satellites\n"
+        << "* bench_create - Time creating 1M satellites\n"
+        << "* bench_xform  - Time world transforms for 100k entities\n"
+        << "* bench_predict - Time trajectory predictions for 50 craft\n"
+        << "* bench_ephem  - Time planet ephemerides in 100000x warp\n"
+        << "* test_area    - Test deactivating removed satellites\n"
         << "* help      - Show this again\n"
         << "* exit      - Deallocate everything and return memory to OS\n";
 }
@@ -307,86 +534,71 @@ void debug_print_hier()
 
     std::cout << "ActiveScene Entity Hierarchy:\n";
 
-    std::vector<ActiveEnt> parentNextSibling;
     ActiveScene const &scene = g_ospMagnum->get_scenes().begin()->second;
-    ActiveEnt currentEnt = scene.hier_get_root();
-
-    parentNextSibling.reserve(16);
 
-    while (true)
+    auto const print_ent = [&scene] (ActiveEnt ent)
     {
-        // print some info about the entitysize() != 0
-        auto const &hier = scene.reg_get<ACompHierarchy>(currentEnt);
+        // print some info about the entity
+        auto const &hier = scene.reg_get<ACompHierarchy>(ent);
         for (unsigned i = 0; i < hier.m_level; i ++)
         {
             // print arrows to indicate level
             std::cout << "  ->";
         }
-        std::cout << "[" << int(currentEnt) << "]: " << hier.m_name << "\n";
-
-        if (hier.m_childCount != 0)
-        {
-            // entity has some children
-            currentEnt = hier.m_childFirst;
+        std::cout << "[" << int(ent) << "]: " << hier.m_name << "\n";
+    };
 
+    print_ent(scene.hier_get_root());
 
-            // save next sibling for later if it exists
-            if (hier.m_siblingNext != entt::null)
-            {
-                parentNextSibling.push_back(hier.m_siblingNext);
-            }
-        }
-        else if (hier.m_siblingNext != entt::null)
-        {
-            // no children, move to next sibling
-            currentEnt = hier.m_siblingNext;
-        }
-        else if (!parentNextSibling.empty())
-        {
-            // last sibling, and not done yet
-            // is last sibling, move to parent's (or ancestor's) next sibling
-            currentEnt = parentNextSibling.back();
-            parentNextSibling.pop_back();
-        }
-        else
-        {
-            break;
-        }
+    for (ActiveEnt ent : scene.hier_descendants(scene.hier_get_root()))
+    {
+        print_ent(ent);
     }
 }
 
 void debug_print_sats()
 {
-    using osp::universe::UCompTransformTraj;
-    using osp::universe::UCompType;
+    using osp::universe::SatState;
+    using osp::universe::UniverseStateBuffer;
 
-    osp::universe::Universe const &universe = g_osp.get_universe();
+    osp::universe::Universe &rUni = g_osp.get_universe();
 
-    auto const view = universe.get_reg().view<const UCompTransformTraj,
-                                              const UCompType>();
+    // Nothing else is touching the universe if Magnum isn't running, so
+    // publish its current state. Otherwise, read what the Magnum thread last
+    // published. g_ospMagnum is set from the Magnum thread after it starts,
+    // so checking it here would race with it
+    if (!g_magnumRunning)
+    {
+        rUni.state_publish();
+    }
 
-    for (osp::universe::Satellite sat : view)
+    UniverseStateBuffer::Handle const state = rUni.get_state_buffer().acquire();
+
+    if (!state)
     {
-        auto const &posTraj = view.get<const UCompTransformTraj>(sat);
-        auto const &type = view.get<const UCompType>(sat);
+        std::cout << "Universe hasn't been published yet\n";
+        return;
+    }
 
-        osp::Vector3s const &pos = posTraj.m_position;
+    for (SatState const &sat : state->m_sats)
+    {
+        osp::Vector3s const &pos = sat.m_position;
 
-        std::cout << "SATELLITE: \"" << posTraj.m_name << "\" \n";
-        if (type.m_type != nullptr)
+        std::cout << "SATELLITE: \"" << sat.m_name << "\" \n";
+        if (!sat.m_typeName.empty())
         {
-            std::cout << " * Type: " << type.m_type->get_name() << "\n";
+            std::cout << " * Type: " << sat.m_typeName << "\n";
         }
 
-        if (posTraj.m_trajectory != nullptr)
+        if (!sat.m_trajectoryName.empty())
         {
-            std::cout << " * Trajectory: "
-                      << posTraj.m_trajectory->get_type_name() << "\n";
+            std::cout << " * Trajectory: " << sat.m_trajectoryName << "\n";
         }
 
         std::cout << " * Position: ["
                   << pos.x() << ", " << pos.y() << ", " << pos.z() << "]\n";
     }
 
-
+    std::cout << "Universe time: " << state->m_time << "s, published "
+              << state->m_epoch << " times\n";
 }
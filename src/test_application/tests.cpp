@@ -0,0 +1,168 @@
+/**
+ * Open Space Program
+ * Copyright © 2019-2020 Open Space Program Project
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "tests.h"
+
+#include <osp/Active/ActiveScene.h>
+#include <osp/Active/SysAreaAssociate.h>
+#include <osp/OSPApplication.h>
+#include <osp/Resource/Package.h>
+#include <osp/Satellites/SatActiveArea.h>
+#include <osp/Trajectories/Stationary.h>
+#include <osp/UserInputHandler.h>
+
+#include <iostream>
+#include <string>
+
+using osp::active::ACompTransform;
+using osp::active::ActiveEnt;
+using osp::active::ActiveScene;
+using osp::active::IActivator;
+using osp::active::StatusActivated;
+using osp::active::SysAreaAssociate;
+using osp::universe::SatActiveArea;
+using osp::universe::Satellite;
+using osp::universe::TrajStationary;
+using osp::universe::UCompActivatable;
+using osp::universe::UCompTransformTraj;
+using osp::universe::Universe;
+
+namespace
+{
+
+/**
+ * Satellite type that only has a bounding radius, for activating
+ */
+class SatTest : public osp::universe::CommonTypeSat<SatTest, UCompActivatable>
+{
+public:
+    SatTest(Universe& universe) : CommonTypeSat(universe) { }
+    std::string get_name() override { return "Test"; }
+};
+
+/**
+ * Activator that creates a bare entity, and writes its position back to the
+ * universe when deactivated, like SysVehicle does
+ */
+class ActivatorTest : public IActivator
+{
+public:
+    StatusActivated activate_sat(
+            ActiveScene &scene, SysAreaAssociate &area,
+            Satellite areaSat, Satellite tgtSat) override
+    {
+        ActiveEnt const ent = scene.hier_create_child(scene.hier_get_root(),
+                                                      "Test");
+        auto &entTransform = scene.reg_emplace<ACompTransform>(ent);
+        entTransform.m_transform = osp::Matrix4::translation(
+                area.sat_scene_pos(tgtSat));
+        return {0, ent, true};
+    }
+
+    int deactivate_sat(
+            ActiveScene &scene, SysAreaAssociate &area,
+            Satellite areaSat, Satellite tgtSat, ActiveEnt tgtEnt) override
+    {
+        area.sat_transform_update(tgtEnt);
+        scene.hier_destroy(tgtEnt);
+        return 0;
+    }
+};
+
+} // namespace
+
+int testapp::test_area_removed_sat()
+{
+    int status = 0;
+    auto const check = [&status] (bool pass, char const* what)
+    {
+        if (!pass)
+        {
+            std::cout << "* FAILED: " << what << "\n";
+            status = 1;
+        }
+    };
+
+    osp::OSPApplication app;
+    Universe &uni = app.get_universe();
+    auto &reg = uni.get_reg();
+
+    SatActiveArea &typeArea = uni.type_register<SatActiveArea>(uni);
+    SatTest &typeTest = uni.type_register<SatTest>(uni);
+
+    auto &stationary = uni.trajectory_create<TrajStationary>(
+                                        uni, uni.sat_root());
+
+    // Area at the root, with the satellite 10 meters away from it
+    Satellite const areaSat = uni.sat_create();
+    typeArea.add(areaSat);
+    stationary.add(areaSat);
+
+    Satellite const sat = uni.sat_create();
+    typeTest.add(sat);
+    reg.get<UCompTransformTraj>(sat).m_position
+            = osp::Vector3s(10l * 1024l, 0l, 0l);
+    uni.sat_mark_dirty(sat);
+    stationary.add(sat);
+
+    uni.sat_frames_update();
+
+    osp::UserInputHandler input(0);
+    osp::Package pkg("test", "Test");
+    ActiveScene scene(input, app, pkg);
+
+    ActivatorTest activator;
+    auto &sysArea = scene.dynamic_system_create<SysAreaAssociate>(uni);
+    sysArea.activator_add(&typeTest, activator);
+    sysArea.connect(areaSat);
+
+    sysArea.update_scan(scene);
+
+    auto viewActivated = scene.get_registry()
+            .view<osp::active::ACompActivatedSat>();
+    check(viewActivated.size() == 1, "satellite was not activated");
+
+    // Remove the satellite while it's activated, and create another that is
+    // likely to reuse its entity
+    stationary.remove(sat);
+    uni.sat_remove(sat);
+
+    Satellite const other = uni.sat_create();
+    osp::Vector3s const otherPos(-20l * 1024l, 0l, 0l);
+    reg.get<UCompTransformTraj>(other).m_position = otherPos;
+    stationary.add(other);
+    uni.sat_frames_update();
+
+    sysArea.update_scan(scene);
+    scene.hier_destroy_flush();
+
+    check(viewActivated.size() == 0, "removed satellite was not deactivated");
+    check(reg.get<UCompTransformTraj>(other).m_position == otherPos,
+          "new satellite was moved by the deactivated entity");
+
+    std::cout << "Area associate removed satellite test: "
+              << (status == 0 ? "passed" : "failed") << "\n";
+
+    return status;
+}
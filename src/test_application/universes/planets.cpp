@@ -45,11 +45,16 @@ using osp::universe::SatVehicle;
 
 using osp::universe::TrajStationary;
 
+using osp::universe::UCompActivatable;
+using osp::universe::UCompGravity;
 using osp::universe::UCompTransformTraj;
 
 using planeta::universe::SatPlanet;
 using planeta::universe::UCompPlanet;
 
+// Gravitational constant in m^3/(kg s^2)
+constexpr double c_gravConstant = 6.6743E-11;
+
 
 void testapp::create_real_moon(osp::OSPApplication& ospApp)
 {
@@ -57,8 +62,7 @@ void testapp::create_real_moon(osp::OSPApplication& ospApp)
     Package &rPkg = ospApp.debug_find_package("lzdb");
 
     // Get the planet system used to create a UCompPlanet
-    SatPlanet &typePlanet = static_cast<planeta::universe::SatPlanet&>(
-            *rUni.sat_type_find("Planet")->second);
+    SatPlanet &typePlanet = rUni.sat_type_find<SatPlanet>();
 
     // Create trajectory that will make things added to the universe stationary
     auto &stationary = rUni.trajectory_create<TrajStationary>(
@@ -74,7 +78,7 @@ void testapp::create_real_moon(osp::OSPApplication& ospApp)
         auto &posTraj = rUni.get_reg().get<UCompTransformTraj>(sat);
 
         posTraj.m_position = osp::Vector3s(i * 1024l * 5l, 0l, 0l);
-        posTraj.m_dirty = true;
+        rUni.sat_mark_dirty(sat);
 
         stationary.add(sat);
     }
@@ -82,7 +86,7 @@ void testapp::create_real_moon(osp::OSPApplication& ospApp)
     Satellite sat = debug_add_deterministic_vehicle(rUni, rPkg, "Stomper Mk. I");
     auto& posTraj = rUni.get_reg().get<UCompTransformTraj>(sat);
     posTraj.m_position = osp::Vector3s(22 * 1024l * 5l, 0l, 0l);
-    posTraj.m_dirty = true;
+    rUni.sat_mark_dirty(sat);
     stationary.add(sat);
 
 
@@ -99,8 +103,15 @@ void testapp::create_real_moon(osp::OSPApplication& ospApp)
 
             // Create the real world moon
             planet.m_radius = 1.737E+6;
+            // activate the planet when an ActiveArea reaches its surface
+            rUni.get_reg().get<UCompActivatable>(sat).m_radius = planet.m_radius;
             planet.m_mass = 7.347673E+22;
 
+            // Orbits near the planet are patched conics around it, see
+            // TrajectoryPredictor. Its sphere of influence is against the Earth
+            rUni.get_reg().emplace<UCompGravity>(
+                    sat, UCompGravity{c_gravConstant * planet.m_mass, 6.61E+7});
+
             planet.m_resolutionScreenMax = 0.056f;
             planet.m_resolutionSurfaceMax = 12.0f;
 
@@ -45,11 +45,16 @@ using osp::universe::SatVehicle;
 
 using osp::universe::TrajStationary;
 
+using osp::universe::UCompActivatable;
+using osp::universe::UCompGravity;
 using osp::universe::UCompTransformTraj;
 
 using planeta::universe::SatPlanet;
 using planeta::universe::UCompPlanet;
 
+// Gravitational constant in m^3/(kg s^2)
+constexpr double c_gravConstant = 6.6743E-11;
+
 
 void testapp::create_simple_solar_system(osp::OSPApplication& ospApp)
 {
@@ -57,8 +62,7 @@ void testapp::create_simple_solar_system(osp::OSPApplication& ospApp)
     Package &pkg = ospApp.debug_find_package("lzdb");
 
     // Get the planet system used to create a UCompPlanet
-    SatPlanet &typePlanet = static_cast<planeta::universe::SatPlanet&>(
-            *uni.sat_type_find("Planet")->second);
+    SatPlanet &typePlanet = uni.sat_type_find<SatPlanet>();
 
     // Create trajectory that will make things added to the universe stationary
     auto &stationary = uni.trajectory_create<TrajStationary>(
@@ -74,7 +78,7 @@ void testapp::create_simple_solar_system(osp::OSPApplication& ospApp)
         auto &posTraj = uni.get_reg().get<UCompTransformTraj>(sat);
 
         posTraj.m_position = osp::Vector3s(i * 1024l * 5l, 0l, 0l);
-        posTraj.m_dirty = true;
+        uni.sat_mark_dirty(sat);
 
         stationary.add(sat);
     }*/
@@ -83,7 +87,7 @@ void testapp::create_simple_solar_system(osp::OSPApplication& ospApp)
     Satellite sat = testapp::debug_add_part_vehicle(uni, pkg, "Placeholder Mk. I");
     auto& posTraj = uni.get_reg().get<UCompTransformTraj>(sat);
     posTraj.m_position = osp::Vector3s(22 * 1024l * 5l, 0l, 0l);
-    posTraj.m_dirty = true;
+    uni.sat_mark_dirty(sat);
     stationary.add(sat);
 
 
@@ -100,8 +104,16 @@ void testapp::create_simple_solar_system(osp::OSPApplication& ospApp)
 
             // Configure planet as a 256m radius sphere of black hole
             planet.m_radius = 256;
+            // activate the planet when an ActiveArea reaches its surface
+            uni.get_reg().get<UCompActivatable>(sat).m_radius = planet.m_radius;
             planet.m_mass = 7.03E7 * 99999999; // volume of sphere * density
 
+            // Orbits near the planet are patched conics around it, see
+            // TrajectoryPredictor. Nothing else pulls, so its sphere of
+            // influence only needs to cover the play area
+            uni.get_reg().emplace<UCompGravity>(
+                    sat, UCompGravity{c_gravConstant * planet.m_mass, 1.0E+6});
+
             planet.m_resolutionScreenMax = 0.056f;
             planet.m_resolutionSurfaceMax = 2.0f;
 
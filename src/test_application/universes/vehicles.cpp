@@ -89,12 +89,10 @@ osp::universe::Satellite testapp::debug_add_deterministic_vehicle(
     Satellite sat = uni.sat_create();
 
     // Set name
-    auto& posTraj = uni.get_reg().get<UCompTransformTraj>(sat);
-    posTraj.m_name = name;
+    uni.sat_set_name(sat, name);
 
     // Make it into a vehicle
-    auto& typeVehicle = *static_cast<SatVehicle*>(
-            uni.sat_type_find("Vehicle")->second.get());
+    auto& typeVehicle = uni.sat_type_find<SatVehicle>();
 
     UCompVehicle &vehicle = typeVehicle.add_get_ucomp(sat);
     vehicle.m_blueprint = std::move(depend);
@@ -151,12 +149,10 @@ osp::universe::Satellite testapp::debug_add_random_vehicle(
     Satellite sat = uni.sat_create();
 
     // Set the name
-    auto &posTraj = uni.get_reg().get<UCompTransformTraj>(sat);
-    posTraj.m_name = name;
+    uni.sat_set_name(sat, name);
 
     // Make it into a vehicle
-    auto &typeVehicle = *static_cast<SatVehicle*>(
-            uni.sat_type_find("Vehicle")->second.get());
+    auto &typeVehicle = uni.sat_type_find<SatVehicle>();
     UCompVehicle &UCompVehicle = typeVehicle.add_get_ucomp(sat);
 
     // set the SatVehicle's blueprint to the one just made
@@ -281,12 +277,10 @@ osp::universe::Satellite testapp::debug_add_part_vehicle(
     Satellite sat = uni.sat_create();
 
     // Set the name
-    auto& posTraj = uni.get_reg().get<osp::universe::UCompTransformTraj>(sat);
-    posTraj.m_name = name;
+    uni.sat_set_name(sat, name);
 
     // Make it into a vehicle
-    auto& typeVehicle = *static_cast<osp::universe::SatVehicle*>(
-        uni.sat_type_find("Vehicle")->second.get());
+    auto& typeVehicle = uni.sat_type_find<osp::universe::SatVehicle>();
     osp::universe::UCompVehicle& compVeh = typeVehicle.add_get_ucomp(sat);
 
     // Set the SatVehicle's blueprint to the one just made